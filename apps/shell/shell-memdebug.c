@@ -41,6 +41,7 @@
 
 #include "contiki.h"
 #include "shell-memdebug.h"
+#include "lib/memb.h"
 
 #include <stdio.h>
 #include <string.h>
@@ -56,6 +57,11 @@ SHELL_COMMAND(peek_command,
 	      "peek",
 	      "peek <address>: read a byte from address <address>",
 	      &shell_peek_process);
+PROCESS(shell_memb_process, "memb");
+SHELL_COMMAND(memb_command,
+	      "memb",
+	      "memb: show memory block pool usage",
+	      &shell_memb_process);
 /*---------------------------------------------------------------------------*/
 PROCESS_THREAD(shell_poke_process, ev, data)
 {
@@ -120,10 +126,29 @@ PROCESS_THREAD(shell_peek_process, ev, data)
   PROCESS_END();
 }
 /*---------------------------------------------------------------------------*/
+PROCESS_THREAD(shell_memb_process, ev, data)
+{
+  struct memb_pool *p;
+  char buf[64];
+
+  PROCESS_BEGIN();
+
+  shell_output_str(&memb_command, "name size used/num max fail badfree", "");
+  for(p = memb_pool_list(); p != NULL; p = p->next) {
+    snprintf(buf, sizeof(buf), "%s %u %u/%u %u %u %u",
+	     p->name, p->memb->size, p->used, p->memb->num,
+	     p->max_used, p->failures, p->bad_frees);
+    shell_output_str(&memb_command, buf, "");
+  }
+
+  PROCESS_END();
+}
+/*---------------------------------------------------------------------------*/
 void
 shell_memdebug_init(void)
 {
   shell_register_command(&poke_command);
   shell_register_command(&peek_command);
+  shell_register_command(&memb_command);
 }
 /*---------------------------------------------------------------------------*/
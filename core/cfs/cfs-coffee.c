@@ -44,6 +44,7 @@
  */
 
 #include <limits.h>
+#include <stddef.h>
 #include <string.h>
 
 #define DEBUG 0
@@ -58,6 +59,10 @@
 #include "cfs/cfs.h"
 #include "cfs-coffee-arch.h"
 #include "cfs/cfs-coffee.h"
+#if COFFEE_GC_PROCESS
+#include "sys/clock.h"
+#include "sys/process.h"
+#endif
 
 /* Micro logs enable modifications on storage types that do not support
    in-place updates. This applies primarily to flash memories. */
@@ -90,6 +95,69 @@
 #define COFFEE_EXTENDED_WEAR_LEVELLING	1
 #endif
 
+/*
+ * Keep a table in RAM that maps file names to the pages of their
+ * headers, so that opening a file does not scan the flash. The table
+ * has COFFEE_NAME_INDEX_SIZE entries of four bytes (with 16-bit pages)
+ * and should be larger than the number of files; if the files do not
+ * fit, looking up a name that is not in the table falls back to the
+ * flash scan. Zero disables the table.
+ */
+#ifndef COFFEE_NAME_INDEX_SIZE
+#define COFFEE_NAME_INDEX_SIZE	0
+#endif
+
+/*
+ * Keep the free space of every sector in RAM, so that allocation does
+ * not read page headers and the garbage collector can erase only the
+ * sectors that make room for the file being reserved. The map takes
+ * one page number per sector, so it is off by default; platforms with
+ * few sectors and RAM to spare can turn it on.
+ */
+#ifndef COFFEE_FREE_MAP
+#define COFFEE_FREE_MAP		0
+#endif
+
+/*
+ * Run the garbage collector as a process that erases sectors between
+ * the other processes, so that writes seldom have to wait for an erase.
+ * The process keeps a free extent of COFFEE_GC_RESERVE bytes, or more
+ * when asked with cfs_coffee_reclaim(). It goes on erasing for up to
+ * COFFEE_GC_BUDGET clock ticks before it yields; with a budget of zero
+ * it erases one sector per turn. Without COFFEE_FREE_MAP, each turn
+ * reads the status of every sector, even when there is room already.
+ */
+#ifndef COFFEE_GC_PROCESS
+#define COFFEE_GC_PROCESS	0
+#endif
+
+#ifndef COFFEE_GC_RESERVE
+#define COFFEE_GC_RESERVE	COFFEE_DYN_SIZE
+#endif
+
+#ifndef COFFEE_GC_BUDGET
+#define COFFEE_GC_BUDGET	0
+#endif
+
+/*
+ * Buffers that collect adjacent small writes to a log record, so that
+ * the record is written to the micro log once. A file descriptor gets
+ * one with cfs_coffee_set_io_semantics() and CFS_COFFEE_IO_BUFFERED.
+ * Each buffer takes a page of RAM; the buffers need micro logs and
+ * the I/O semantics interface.
+ */
+#ifndef COFFEE_WRITE_BUFFERS
+#define COFFEE_WRITE_BUFFERS	0
+#endif
+
+#if !COFFEE_MICRO_LOGS || !COFFEE_IO_SEMANTICS
+#undef COFFEE_WRITE_BUFFERS
+#define COFFEE_WRITE_BUFFERS	0
+#endif
+
+/* Collectors that erase only the sectors a free extent needs. */
+#define COFFEE_EXTENT_GC	(COFFEE_FREE_MAP || COFFEE_GC_PROCESS)
+
 #if COFFEE_START & (COFFEE_SECTOR_SIZE - 1)
 #error COFFEE_START must point to the first byte in a sector.
 #endif
@@ -147,6 +215,22 @@
 				!HDR_OBSOLETE(hdr)  && \
 				!HDR_ISOLATED(hdr))
 
+/*
+ * The end-of-file hint in the file header bounds the search for the
+ * end of the data. Bit 0 tells that the hint is kept up to date; it is
+ * set when the file is reserved, so files written by older versions
+ * are searched from their last page. Bit k (1 to 7) is set before any
+ * data is written in page EOF_HINT_PAGE(max_pages, k) of the file or
+ * further, so the data ends before the page of the lowest unset bit,
+ * even after a reset. Bits that map to page 0 carry no information and
+ * are never written. Bits are only ever added, which flash allows
+ * without an erase.
+ */
+#define EOF_HINT_VALID		0x1
+#define EOF_HINT_BITS		8
+#define EOF_HINT_PAGE(max_pages, k)	\
+	((coffee_page_t)((long)(max_pages) * (k) / EOF_HINT_BITS))
+
 /* Shortcuts derived from the hardware-dependent configuration of Coffee. */
 #define COFFEE_SECTOR_COUNT	(unsigned)(COFFEE_SIZE / COFFEE_SECTOR_SIZE)
 #define COFFEE_PAGE_COUNT	\
@@ -159,6 +243,8 @@ struct sector_status {
   coffee_page_t active;
   coffee_page_t obsolete;
   coffee_page_t free;
+  /* Pages of an obsolete extent that go on beyond the sector. */
+  coffee_page_t spill;
 };
 
 /* The structure of cached file objects. */
@@ -169,6 +255,7 @@ struct file {
   int16_t record_count;
   uint8_t references;
   uint8_t flags;
+  uint8_t eof_hint;
 };
 
 /* The file descriptor structure. */
@@ -188,11 +275,31 @@ struct file_header {
   uint16_t log_records;
   uint16_t log_record_size;
   coffee_page_t max_pages;
-  uint8_t deprecated_eof_hint;
+  uint8_t eof_hint;
   uint8_t flags;
   char name[COFFEE_NAME_LENGTH];
 };
 
+#if COFFEE_NAME_INDEX_SIZE > 0
+/* A name index entry. A hash of zero marks an empty entry. */
+struct name_entry {
+  coffee_page_t page;
+  uint16_t hash;
+};
+#endif
+
+#if COFFEE_WRITE_BUFFERS > 0
+/* A write buffer holds the bytes start to end of one log record. */
+struct write_buffer {
+  uint16_t region;
+  uint16_t record_size;
+  uint16_t start;
+  uint16_t end;
+  uint8_t owner;	/* The file descriptor plus one, or 0 if free. */
+  char data[COFFEE_PAGE_SIZE];
+};
+#endif
+
 /* This is needed because of a buggy compiler. */
 struct log_param {
   cfs_offset_t offset;
@@ -211,11 +318,47 @@ static struct protected_mem_t {
   struct file_desc coffee_fd_set[COFFEE_FD_SET_SIZE];
   coffee_page_t next_free;
   char gc_wait;
+#if COFFEE_NAME_INDEX_SIZE > 0
+  struct name_entry name_index[COFFEE_NAME_INDEX_SIZE];
+  char name_index_complete;
+#endif
+#if COFFEE_FREE_MAP
+  coffee_page_t free_map[COFFEE_SECTOR_COUNT];
+  char free_map_valid;
+#endif
+#if COFFEE_WRITE_BUFFERS > 0
+  struct write_buffer write_buffers[COFFEE_WRITE_BUFFERS];
+#endif
 } protected_mem;
 static struct file * const coffee_files = protected_mem.coffee_files;
 static struct file_desc * const coffee_fd_set = protected_mem.coffee_fd_set;
 static coffee_page_t * const next_free = &protected_mem.next_free;
 static char * const gc_wait = &protected_mem.gc_wait;
+#if COFFEE_NAME_INDEX_SIZE > 0
+static struct name_entry * const name_index = protected_mem.name_index;
+static char * const name_index_complete = &protected_mem.name_index_complete;
+#endif
+#if COFFEE_FREE_MAP
+/* The first free page of each sector, relative to the sector start. */
+static coffee_page_t * const free_map = protected_mem.free_map;
+static char * const free_map_valid = &protected_mem.free_map_valid;
+#endif
+#if COFFEE_WRITE_BUFFERS > 0
+static struct write_buffer * const write_buffers = protected_mem.write_buffers;
+#endif
+#if COFFEE_EXTENT_GC
+/*
+ * Erasures of each sector since the system started. The counts are not
+ * stored in the flash and start over at every boot, so they only spread
+ * the erasures of the collectors within one run of the system.
+ */
+static uint16_t sector_erases[COFFEE_SECTOR_COUNT];
+#endif
+#if COFFEE_GC_PROCESS
+/* The free extent requested with cfs_coffee_reclaim(), in pages. */
+static coffee_page_t gc_target;
+PROCESS(coffee_gc_process, "Coffee GC");
+#endif
 
 /*---------------------------------------------------------------------------*/
 static void
@@ -284,6 +427,7 @@ get_sector_status(uint16_t sector, struct sector_status *stats)
     if(skip_pages >= COFFEE_PAGES_PER_SECTOR) {
       stats->obsolete = COFFEE_PAGES_PER_SECTOR;
       skip_pages -= COFFEE_PAGES_PER_SECTOR;
+      stats->spill = skip_pages;
       return skip_pages >= COFFEE_PAGES_PER_SECTOR ? 0 : skip_pages;
     }
     obsolete = skip_pages;
@@ -330,6 +474,9 @@ get_sector_status(uint16_t sector, struct sector_status *stats)
   stats->active = active;
   stats->obsolete = obsolete;
   stats->free = free;
+  if(!last_pages_are_active && skip_pages > 0) {
+    stats->spill = skip_pages;
+  }
 
   /*
    * To avoid unnecessary page isolation, we notify the callee that 
@@ -360,6 +507,34 @@ isolate_pages(coffee_page_t start, coffee_page_t skip_pages)
   PRINTF("Coffee: Isolated %u pages starting in sector %d\n",
          (unsigned)skip_pages, (int)start / COFFEE_PAGES_PER_SECTOR);
 
+}
+/*---------------------------------------------------------------------------*/
+static void
+erase_sector(uint16_t sector, coffee_page_t isolation_count)
+{
+  coffee_page_t first_page;
+
+  first_page = sector * COFFEE_PAGES_PER_SECTOR;
+  if(first_page < *next_free) {
+    *next_free = first_page;
+  }
+
+  /*
+   * A count of a whole sector means that the next sector is erased as
+   * well, so there is nothing to isolate.
+   */
+  if(isolation_count > 0 && isolation_count < COFFEE_PAGES_PER_SECTOR) {
+    isolate_pages(first_page + COFFEE_PAGES_PER_SECTOR, isolation_count);
+  }
+
+  COFFEE_ERASE(sector);
+  PRINTF("Coffee: Erased sector %d!\n", sector);
+#if COFFEE_EXTENT_GC
+  sector_erases[sector]++;
+#endif
+#if COFFEE_FREE_MAP
+  *free_map_valid = 0;
+#endif
 }
 /*---------------------------------------------------------------------------*/
 static void
@@ -367,7 +542,7 @@ collect_garbage(int mode)
 {
   uint16_t sector;
   struct sector_status stats;
-  coffee_page_t first_page, isolation_count;
+  coffee_page_t isolation_count;
 
   PRINTF("Coffee: Running the file system garbage collector in %s mode\n",
 	 mode == GC_RELUCTANT ? "reluctant" : "greedy");
@@ -387,17 +562,7 @@ collect_garbage(int mode)
 
     if((mode == GC_RELUCTANT && stats.free == 0) ||
        (mode == GC_GREEDY && stats.obsolete > 0)) {
-      first_page = sector * COFFEE_PAGES_PER_SECTOR;
-      if(first_page < *next_free) {
-        *next_free = first_page;
-      }
-
-      if(isolation_count > 0) {
-        isolate_pages(first_page + COFFEE_PAGES_PER_SECTOR, isolation_count);
-      }
-
-      COFFEE_ERASE(sector);
-      PRINTF("Coffee: Erased sector %d!\n", sector);
+      erase_sector(sector, isolation_count);
 
       if(mode == GC_RELUCTANT && isolation_count > 0) {
         break;
@@ -427,6 +592,102 @@ next_file(coffee_page_t page, struct file_header *hdr)
   return page + hdr->max_pages;    
 }
 /*---------------------------------------------------------------------------*/
+#if COFFEE_NAME_INDEX_SIZE > 0
+static uint16_t
+name_hash(const char *name)
+{
+  uint16_t hash;
+  int i;
+
+  hash = 0;
+  for(i = 0; i < COFFEE_NAME_LENGTH && name[i] != '\0'; i++) {
+    hash = hash * 31 + (unsigned char)name[i];
+  }
+  return hash == 0 ? 1 : hash;
+}
+#endif /* COFFEE_NAME_INDEX_SIZE > 0 */
+/*---------------------------------------------------------------------------*/
+#if COFFEE_NAME_INDEX_SIZE > 0
+static void
+index_add(coffee_page_t page, const char *name)
+{
+  uint16_t hash;
+  unsigned i, n;
+
+  /* Open addressing with linear probing. */
+  hash = name_hash(name);
+  i = hash % COFFEE_NAME_INDEX_SIZE;
+  for(n = 0; n < COFFEE_NAME_INDEX_SIZE; n++) {
+    if(name_index[i].hash == 0) {
+      name_index[i].page = page;
+      name_index[i].hash = hash;
+      return;
+    }
+    i = (i + 1) % COFFEE_NAME_INDEX_SIZE;
+  }
+
+  /* The table is full, so it no longer lists every file. */
+  *name_index_complete = 0;
+}
+#endif /* COFFEE_NAME_INDEX_SIZE > 0 */
+/*---------------------------------------------------------------------------*/
+#if COFFEE_NAME_INDEX_SIZE > 0
+static void
+index_remove(coffee_page_t page, const char *name)
+{
+  unsigned i, j, home, n;
+
+  i = name_hash(name) % COFFEE_NAME_INDEX_SIZE;
+  for(n = 0; name_index[i].page != page || name_index[i].hash == 0; n++) {
+    if(name_index[i].hash == 0 || n == COFFEE_NAME_INDEX_SIZE) {
+      return;
+    }
+    i = (i + 1) % COFFEE_NAME_INDEX_SIZE;
+  }
+
+  /*
+   * Move the following entries of the probe sequence back into the
+   * hole if it lies between their home position and their current
+   * position, so that lookups need no deletion markers.
+   */
+  j = i;
+  for(n = 1; n < COFFEE_NAME_INDEX_SIZE; n++) {
+    j = (j + 1) % COFFEE_NAME_INDEX_SIZE;
+    if(name_index[j].hash == 0) {
+      break;
+    }
+    home = name_index[j].hash % COFFEE_NAME_INDEX_SIZE;
+    if(i <= j ? (home <= i || home > j) : (home <= i && home > j)) {
+      name_index[i] = name_index[j];
+      i = j;
+    }
+  }
+  name_index[i].hash = 0;
+}
+#endif /* COFFEE_NAME_INDEX_SIZE > 0 */
+/*---------------------------------------------------------------------------*/
+#if COFFEE_NAME_INDEX_SIZE > 0
+static coffee_page_t
+index_find(const char *name, struct file_header *hdr)
+{
+  uint16_t hash;
+  unsigned i, n;
+
+  hash = name_hash(name);
+  i = hash % COFFEE_NAME_INDEX_SIZE;
+  for(n = 0; n < COFFEE_NAME_INDEX_SIZE && name_index[i].hash != 0; n++) {
+    if(name_index[i].hash == hash) {
+      read_header(hdr, name_index[i].page);
+      if(HDR_ACTIVE(*hdr) && !HDR_LOG(*hdr) && strcmp(name, hdr->name) == 0) {
+	return name_index[i].page;
+      }
+    }
+    i = (i + 1) % COFFEE_NAME_INDEX_SIZE;
+  }
+  return INVALID_PAGE;
+}
+#endif /* COFFEE_NAME_INDEX_SIZE > 0 */
+/*---------------------------------------------------------------------------*/
 static struct file *
 load_file(coffee_page_t start, struct file_header *hdr)
 {
@@ -459,6 +720,7 @@ load_file(coffee_page_t start, struct file_header *hdr)
   file->page = start;
   file->end = UNKNOWN_OFFSET;
   file->max_pages = hdr->max_pages;
+  file->eof_hint = hdr->eof_hint;
   file->flags = 0;
   if(HDR_MODIFIED(*hdr)) {
     file->flags |= COFFEE_FILE_MODIFIED;
@@ -469,6 +731,65 @@ load_file(coffee_page_t start, struct file_header *hdr)
   return file;
 }
 /*---------------------------------------------------------------------------*/
+#if COFFEE_NAME_INDEX_SIZE > 0
+static struct file *
+find_file(const char *name)
+{
+  int i;
+  struct file_header hdr;
+  coffee_page_t page, found;
+
+  page = index_find(name, &hdr);
+  if(page == INVALID_PAGE) {
+    if(*name_index_complete) {
+      return NULL;
+    }
+
+    /*
+     * The index is not built yet, or some files did not fit in it.
+     * Check the cached files, then rebuild the index while scanning
+     * the flash for the file. The scan goes on to the end of the
+     * flash, so that later lookups do not start it over.
+     */
+    for(i = 0; i < COFFEE_MAX_OPEN_FILES; i++) {
+      if(FILE_FREE(&coffee_files[i])) {
+	continue;
+      }
+      read_header(&hdr, coffee_files[i].page);
+      if(HDR_ACTIVE(hdr) && !HDR_LOG(hdr) && strcmp(name, hdr.name) == 0) {
+	return &coffee_files[i];
+      }
+    }
+
+    memset(name_index, 0, sizeof(protected_mem.name_index));
+    *name_index_complete = 1;
+    found = INVALID_PAGE;
+    for(page = 0; page < COFFEE_PAGE_COUNT; page = next_file(page, &hdr)) {
+      read_header(&hdr, page);
+      if(HDR_ACTIVE(hdr) && !HDR_LOG(hdr)) {
+	index_add(page, hdr.name);
+	if(found == INVALID_PAGE && strcmp(name, hdr.name) == 0) {
+	  found = page;
+	}
+      }
+    }
+    if(found == INVALID_PAGE) {
+      return NULL;
+    }
+    page = found;
+    /* The scan left the last header in hdr. */
+    read_header(&hdr, page);
+  }
+
+  /* The file metadata may be cached already. */
+  for(i = 0; i < COFFEE_MAX_OPEN_FILES; i++) {
+    if(!FILE_FREE(&coffee_files[i]) && coffee_files[i].page == page) {
+      return &coffee_files[i];
+    }
+  }
+  return load_file(page, &hdr);
+}
+#else /* COFFEE_NAME_INDEX_SIZE > 0 */
 static struct file *
 find_file(const char *name)
 {
@@ -498,41 +819,167 @@ find_file(const char *name)
 
   return NULL;
 }
+#endif /* COFFEE_NAME_INDEX_SIZE > 0 */
+/*---------------------------------------------------------------------------*/
+static void
+set_eof_hint(struct file *file, cfs_offset_t end)
+{
+  coffee_page_t last;
+  uint8_t hint;
+  int k;
+
+  if(!(file->eof_hint & EOF_HINT_VALID) || end <= 0) {
+    return;
+  }
+
+  /* Mark every range that the last byte reaches. */
+  last = (sizeof(struct file_header) + end - 1) / COFFEE_PAGE_SIZE;
+  hint = file->eof_hint;
+  for(k = 1;
+      k < EOF_HINT_BITS && EOF_HINT_PAGE(file->max_pages, k) <= last; k++) {
+    if(EOF_HINT_PAGE(file->max_pages, k) > 0) {
+      hint |= 1 << k;
+    }
+  }
+
+  if(hint != file->eof_hint) {
+    file->eof_hint = hint;
+    COFFEE_WRITE(&hint, sizeof(hint), file->page * COFFEE_PAGE_SIZE +
+		 offsetof(struct file_header, eof_hint));
+  }
+}
 /*---------------------------------------------------------------------------*/
 static cfs_offset_t
 file_end(coffee_page_t start)
 {
   struct file_header hdr;
-  unsigned char buf[COFFEE_PAGE_SIZE];
-  coffee_page_t page;
-  int i;
+  union {
+    unsigned char bytes[COFFEE_PAGE_SIZE];
+    unsigned long words[COFFEE_PAGE_SIZE / sizeof(unsigned long)];
+  } buf;
+  coffee_page_t page, end_page;
+  int i, k;
 
   read_header(&hdr, start);
 
+  /* Skip the pages that the end-of-file hint rules out. */
+  end_page = hdr.max_pages;
+  if(hdr.eof_hint & EOF_HINT_VALID) {
+    for(k = 1; k < EOF_HINT_BITS &&
+	  (EOF_HINT_PAGE(hdr.max_pages, k) == 0 || (hdr.eof_hint & (1 << k)));
+	k++);
+    if(k < EOF_HINT_BITS) {
+      end_page = EOF_HINT_PAGE(hdr.max_pages, k);
+    }
+  }
+
   /*
    * Move from the end of the range towards the beginning and look for
-   * a byte that has been modified.
+   * a byte that has been modified, one word at a time.
    *
    * An important implication of this is that if the last written bytes
    * are zeroes, then these are skipped from the calculation.
    */
 
-  for(page = hdr.max_pages - 1; page >= 0; page--) {
-    COFFEE_READ(buf, sizeof(buf), (start + page) * COFFEE_PAGE_SIZE);
-    for(i = COFFEE_PAGE_SIZE - 1; i >= 0; i--) {
-      if(buf[i] != 0) {
-	if(page == 0 && i < sizeof(hdr)) {
-	  return 0;
-	}
-	return 1 + i + (page * COFFEE_PAGE_SIZE) - sizeof(hdr);
-      }
+  for(page = end_page - 1; page >= 0; page--) {
+    COFFEE_READ(buf.bytes, sizeof(buf), (start + page) * COFFEE_PAGE_SIZE);
+    for(i = sizeof(buf.words) / sizeof(buf.words[0]) - 1;
+	i >= 0 && buf.words[i] == 0; i--);
+    if(i < 0) {
+      continue;
     }
+    for(i = (i + 1) * sizeof(buf.words[0]) - 1; buf.bytes[i] == 0; i--);
+    if(page == 0 && i < sizeof(hdr)) {
+      return 0;
+    }
+    return 1 + i + (page * COFFEE_PAGE_SIZE) - sizeof(hdr);
   }
 
   /* All bytes are writable. */
   return 0;
 }
 /*---------------------------------------------------------------------------*/
+#if COFFEE_FREE_MAP
+static void
+build_free_map(void)
+{
+  struct file_header hdr;
+  coffee_page_t page;
+  unsigned sector;
+
+  /*
+   * Every sector holds allocated pages followed by free pages, and
+   * next_file() jumps from the first free page to the next sector, so
+   * the walk reads one header per file and per sector.
+   */
+  for(sector = 0; sector < COFFEE_SECTOR_COUNT; sector++) {
+    free_map[sector] = COFFEE_PAGES_PER_SECTOR;
+  }
+  for(page = 0; page < COFFEE_PAGE_COUNT; page = next_file(page, &hdr)) {
+    read_header(&hdr, page);
+    if(HDR_FREE(hdr)) {
+      free_map[page / COFFEE_PAGES_PER_SECTOR] =
+	page % COFFEE_PAGES_PER_SECTOR;
+    }
+  }
+  *free_map_valid = 1;
+}
+#endif /* COFFEE_FREE_MAP */
+/*---------------------------------------------------------------------------*/
+#if COFFEE_FREE_MAP
+static coffee_page_t
+find_extent(coffee_page_t amount)
+{
+  coffee_page_t start, length, best, best_length;
+  unsigned sector;
+
+  if(!*free_map_valid) {
+    build_free_map();
+  }
+
+  /*
+   * A free extent is the free end of a sector followed by the sectors
+   * that are entirely free. Take the smallest extent that fits.
+   */
+  best = INVALID_PAGE;
+  best_length = 0;
+  for(sector = 0; sector < COFFEE_SECTOR_COUNT;) {
+    if(free_map[sector] == COFFEE_PAGES_PER_SECTOR) {
+      sector++;
+      continue;
+    }
+    start = sector * COFFEE_PAGES_PER_SECTOR + free_map[sector];
+    for(sector++; sector < COFFEE_SECTOR_COUNT && free_map[sector] == 0;
+	sector++);
+    length = sector * COFFEE_PAGES_PER_SECTOR - start;
+    if(length >= amount && (best == INVALID_PAGE || length < best_length)) {
+      best = start;
+      best_length = length;
+    }
+  }
+  return best;
+}
+/*---------------------------------------------------------------------------*/
+static coffee_page_t
+find_contiguous_pages(coffee_page_t amount)
+{
+  coffee_page_t best, end;
+  unsigned sector;
+
+  best = find_extent(amount);
+  if(best != INVALID_PAGE) {
+    end = best + amount;
+    for(sector = best / COFFEE_PAGES_PER_SECTOR;
+	sector * COFFEE_PAGES_PER_SECTOR < end; sector++) {
+      free_map[sector] = end - sector * COFFEE_PAGES_PER_SECTOR;
+      if(free_map[sector] > COFFEE_PAGES_PER_SECTOR) {
+	free_map[sector] = COFFEE_PAGES_PER_SECTOR;
+      }
+    }
+  }
+  return best;
+}
+#else /* COFFEE_FREE_MAP */
 static coffee_page_t
 find_contiguous_pages(coffee_page_t amount)
 {
@@ -568,6 +1015,196 @@ find_contiguous_pages(coffee_page_t amount)
   }
   return INVALID_PAGE;
 }
+#endif /* COFFEE_FREE_MAP */
+/*---------------------------------------------------------------------------*/
+#if COFFEE_EXTENT_GC
+/*
+ * In isolation[], a sector whose obsolete extent covers the whole next
+ * sector. There is no header left to isolate in the next sector, so it
+ * must be erased along with this one.
+ */
+#define ERASE_NEXT		COFFEE_PAGES_PER_SECTOR
+
+/* The status of every sector, as the extent collectors see it. */
+struct sector_map {
+  /* Free pages at the end of each sector. */
+  coffee_page_t free[COFFEE_SECTOR_COUNT];
+  /*
+   * Pages at the start of each sector that an obsolete file starting
+   * in an earlier sector still claims, unless that sector is erased.
+   */
+  coffee_page_t lead[COFFEE_SECTOR_COUNT];
+  /*
+   * Pages to isolate in the next sector when erasing each sector, or
+   * INVALID_PAGE if the sector cannot be erased.
+   */
+  coffee_page_t isolation[COFFEE_SECTOR_COUNT];
+};
+
+static void
+scan_sectors(struct sector_map *map)
+{
+  struct sector_status stats;
+  coffee_page_t spill;
+  unsigned sector;
+
+  spill = 0;
+  for(sector = 0; sector < COFFEE_SECTOR_COUNT; sector++) {
+    map->lead[sector] = spill < COFFEE_PAGES_PER_SECTOR ?
+			spill : COFFEE_PAGES_PER_SECTOR;
+    map->isolation[sector] = get_sector_status(sector, &stats);
+    map->free[sector] = stats.free;
+    spill = stats.spill;
+    if(stats.active > 0 || stats.obsolete == 0) {
+      map->isolation[sector] = INVALID_PAGE;
+    } else if(spill >= COFFEE_PAGES_PER_SECTOR) {
+      map->isolation[sector] = ERASE_NEXT;
+    }
+  }
+}
+/*---------------------------------------------------------------------------*/
+/*
+ * Whether erasing a sector on its own frees more than the pages that
+ * an obsolete file from an earlier sector still claims.
+ */
+static int
+sector_gains(const struct sector_map *map, unsigned sector)
+{
+  return map->isolation[sector] != INVALID_PAGE &&
+    map->lead[sector] < COFFEE_PAGES_PER_SECTOR - map->free[sector];
+}
+/*---------------------------------------------------------------------------*/
+/*
+ * Find the run of sectors that becomes a free extent of the requested
+ * size with the fewest erasures: it starts with the free end of a
+ * sector, or with an erasable sector if erasing it frees more than the
+ * pages claimed from before, and goes on with sectors that are free or
+ * erasable. A run may not end on a sector that must be erased along
+ * with the next one. Among runs with as many erasures, take the one
+ * whose sectors have been erased the least since boot. Return the
+ * number of erasures, or -1 if no run is large enough.
+ */
+static int
+find_window(coffee_page_t amount, const struct sector_map *map,
+	    unsigned *best_first, unsigned *best_last)
+{
+  coffee_page_t length;
+  unsigned first, last, erases, count, best_erases, best_count;
+
+  best_erases = best_count = UINT_MAX;
+  *best_first = *best_last = 0;
+  for(first = 0; first < COFFEE_SECTOR_COUNT; first++) {
+    if(sector_gains(map, first)) {
+      length = COFFEE_PAGES_PER_SECTOR - map->lead[first];
+      erases = 1;
+      count = sector_erases[first];
+    } else if(map->free[first] > 0) {
+      length = map->free[first];
+      erases = count = 0;
+    } else {
+      continue;
+    }
+    for(last = first; last + 1 < COFFEE_SECTOR_COUNT &&
+	(length < amount || map->isolation[last] == ERASE_NEXT);) {
+      last++;
+      if(map->isolation[last] != INVALID_PAGE) {
+	erases++;
+	count += sector_erases[last];
+      } else if(map->free[last] != COFFEE_PAGES_PER_SECTOR) {
+	break;
+      }
+      length += COFFEE_PAGES_PER_SECTOR;
+    }
+    if(length >= amount && map->isolation[last] != ERASE_NEXT &&
+       (erases < best_erases ||
+	(erases == best_erases && count < best_count))) {
+      best_erases = erases;
+      best_count = count;
+      *best_first = first;
+      *best_last = last;
+    }
+  }
+
+  return best_erases == UINT_MAX ? -1 : (int)best_erases;
+}
+#endif /* COFFEE_EXTENT_GC */
+/*---------------------------------------------------------------------------*/
+#if COFFEE_FREE_MAP
+static int
+collect_extent(coffee_page_t amount)
+{
+  struct sector_map map;
+  unsigned sector, first, last;
+
+  scan_sectors(&map);
+  if(find_window(amount, &map, &first, &last) <= 0) {
+    return 0;
+  }
+
+  PRINTF("Coffee: Erasing sectors %u to %u for %u pages\n",
+	 first, last, (unsigned)amount);
+  if(!sector_gains(&map, first)) {
+    first++;
+  }
+  for(sector = first; sector <= last; sector++) {
+    if(map.isolation[sector] != INVALID_PAGE) {
+      erase_sector(sector, map.isolation[sector]);
+    }
+  }
+
+  return 1;
+}
+#endif /* COFFEE_FREE_MAP */
+/*---------------------------------------------------------------------------*/
+#if COFFEE_GC_PROCESS
+/*
+ * One turn of the incremental collector: if there is no free extent of
+ * the requested size, erase the first sector that the cheapest window
+ * needs, with the sectors that an obsolete file covers along with it.
+ * Return 1 if a sector was erased, 0 if the extent is free already, or
+ * -1 if even erasing every erasable sector would not make one.
+ */
+static int
+gc_step(coffee_page_t amount)
+{
+  struct sector_map map;
+  unsigned sector, first, last;
+  int erases;
+
+#if COFFEE_FREE_MAP
+  if(find_extent(amount) != INVALID_PAGE) {
+    return 0;
+  }
+#endif
+
+  scan_sectors(&map);
+  erases = find_window(amount, &map, &first, &last);
+  if(erases <= 0) {
+    return erases;
+  }
+
+  sector = first;
+  if(!sector_gains(&map, first)) {
+    for(sector++; map.isolation[sector] == INVALID_PAGE; sector++);
+  }
+  PRINTF("Coffee: Collecting sector %u for %u pages\n",
+	 sector, (unsigned)amount);
+  do {
+    erase_sector(sector, map.isolation[sector]);
+  } while(map.isolation[sector++] == ERASE_NEXT);
+
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
+static void
+gc_poll(void)
+{
+  if(!process_is_running(&coffee_gc_process)) {
+    process_start(&coffee_gc_process, NULL);
+  }
+  process_poll(&coffee_gc_process);
+}
+#endif /* COFFEE_GC_PROCESS */
 /*---------------------------------------------------------------------------*/
 static int
 remove_by_page(coffee_page_t page, int remove_log, int close_fds,
@@ -589,6 +1226,11 @@ remove_by_page(coffee_page_t page, int remove_log, int close_fds,
 
   hdr.flags |= HDR_FLAG_OBSOLETE;
   write_header(&hdr, page);
+#if COFFEE_NAME_INDEX_SIZE > 0
+  if(!HDR_LOG(hdr)) {
+    index_remove(page, hdr.name);
+  }
+#endif
 
   *gc_wait = 0;
 
@@ -599,6 +1241,15 @@ remove_by_page(coffee_page_t page, int remove_log, int close_fds,
 	coffee_fd_set[i].flags = COFFEE_FD_FREE;
       }
     }
+#if COFFEE_WRITE_BUFFERS > 0
+    /* The buffered data of the removed file is dropped. */
+    for(i = 0; i < COFFEE_WRITE_BUFFERS; i++) {
+      if(write_buffers[i].owner != 0 &&
+	 coffee_fd_set[write_buffers[i].owner - 1].flags == COFFEE_FD_FREE) {
+	memset(&write_buffers[i], 0, sizeof(write_buffers[i]));
+      }
+    }
+#endif
   }
 
   for(i = 0; i < COFFEE_MAX_OPEN_FILES; i++) {
@@ -614,6 +1265,11 @@ remove_by_page(coffee_page_t page, int remove_log, int close_fds,
     collect_garbage(GC_RELUCTANT);
   }
 #endif
+#if COFFEE_GC_PROCESS
+  if(gc_allowed) {
+    gc_poll();
+  }
+#endif
 
   return 0;
 }
@@ -642,8 +1298,19 @@ reserve(const char *name, coffee_page_t pages,
     if(*gc_wait) {
       return NULL;
     }
+#if COFFEE_FREE_MAP
+    /* Erase only what the file needs if possible. */
+    if(collect_extent(pages)) {
+      page = find_contiguous_pages(pages);
+    }
+    if(page == INVALID_PAGE) {
+      collect_garbage(GC_GREEDY);
+      page = find_contiguous_pages(pages);
+    }
+#else
     collect_garbage(GC_GREEDY);
     page = find_contiguous_pages(pages);
+#endif
     if(page == INVALID_PAGE) {
       *gc_wait = 1;
       return NULL;
@@ -653,12 +1320,23 @@ reserve(const char *name, coffee_page_t pages,
   memset(&hdr, 0, sizeof(hdr));
   memcpy(hdr.name, name, sizeof(hdr.name) - 1);
   hdr.max_pages = pages;
+  hdr.eof_hint = EOF_HINT_VALID;
   hdr.flags = HDR_FLAG_ALLOCATED | flags;
   write_header(&hdr, page);
+#if COFFEE_NAME_INDEX_SIZE > 0
+  if(!HDR_LOG(hdr)) {
+    index_add(page, hdr.name);
+  }
+#endif
 
   PRINTF("Coffee: Reserved %u pages starting from %u for file %s\n",
       pages, page, name);
 
+#if COFFEE_GC_PROCESS
+  /* Make room for the next files while the system is idle. */
+  gc_poll();
+#endif
+
   file = load_file(page, &hdr);
   if(file != NULL) {
     file->end = 0;
@@ -824,6 +1502,8 @@ merge_log(coffee_page_t file_page, int extend)
     return -1;
   }
 
+  set_eof_hint(new_file, coffee_fd_set[fd].file->end);
+
   offset = 0;
   do {
     char buf[hdr.log_record_size == 0 ? COFFEE_PAGE_SIZE : hdr.log_record_size];
@@ -979,6 +1659,114 @@ write_log_page(struct file *file, struct log_param *lp)
 }
 #endif /* COFFEE_MICRO_LOGS */
 /*---------------------------------------------------------------------------*/
+#if COFFEE_WRITE_BUFFERS > 0
+static struct write_buffer *
+fd_buffer(int fd)
+{
+  int i;
+
+  for(i = 0; i < COFFEE_WRITE_BUFFERS; i++) {
+    if(write_buffers[i].owner == fd + 1) {
+      return &write_buffers[i];
+    }
+  }
+  return NULL;
+}
+/*---------------------------------------------------------------------------*/
+static int
+flush_buffer(struct write_buffer *wb)
+{
+  struct log_param lp;
+  uint16_t start, end;
+  int r;
+
+  start = wb->start;
+  end = wb->end;
+  if(start == end) {
+    return 0;
+  }
+
+  /*
+   * Empty the buffer before writing the record: if the log is full,
+   * write_log_page() merges it, and the merge reads the file.
+   */
+  wb->start = wb->end = 0;
+  do {
+    lp.offset = (cfs_offset_t)wb->region * wb->record_size + start;
+    lp.buf = &wb->data[start];
+    lp.size = end - start;
+    r = write_log_page(coffee_fd_set[wb->owner - 1].file, &lp);
+  } while(r == 0);
+
+  return r < 0 ? -1 : 0;
+}
+/*---------------------------------------------------------------------------*/
+/*
+ * Write out the buffers that hold data of a file, except one. Writes
+ * through a buffer first flush the others, so at most one buffer holds
+ * data of a file at any time.
+ */
+static int
+flush_buffers(struct file *file, struct write_buffer *keep)
+{
+  int i, r;
+
+  r = 0;
+  for(i = 0; i < COFFEE_WRITE_BUFFERS; i++) {
+    if(&write_buffers[i] != keep && write_buffers[i].owner != 0 &&
+       coffee_fd_set[write_buffers[i].owner - 1].file == file &&
+       flush_buffer(&write_buffers[i]) < 0) {
+      r = -1;
+    }
+  }
+  return r;
+}
+/*---------------------------------------------------------------------------*/
+/*
+ * Copy the part of a write that falls in one log record to the buffer.
+ * Return the number of bytes taken, 0 if the buffered data had to be
+ * written out first and the file may have moved, or -1 on failure.
+ */
+static int
+buffer_write(struct write_buffer *wb, struct file *file, struct log_param *lp)
+{
+  struct file_header hdr;
+  uint16_t region, log_records;
+  cfs_offset_t offset;
+
+  if(wb->start == wb->end) {
+    read_header(&hdr, file->page);
+    adjust_log_config(&hdr, &wb->record_size, &log_records);
+  }
+
+  offset = lp->offset;
+  region = modify_log_buffer(wb->record_size, &offset, &lp->size);
+
+  if(wb->start == wb->end) {
+    wb->region = region;
+    wb->start = offset;
+    wb->end = offset;
+  } else if(region != wb->region ||
+	    offset > wb->end || offset + lp->size < wb->start) {
+    /* The write is not adjacent to the buffered data. */
+    return flush_buffer(wb);
+  }
+
+  memcpy(&wb->data[offset], lp->buf, lp->size);
+  if(offset < wb->start) {
+    wb->start = offset;
+  }
+  if(offset + lp->size > wb->end) {
+    wb->end = offset + lp->size;
+  }
+
+  if(wb->start == 0 && wb->end == wb->record_size && flush_buffer(wb) < 0) {
+    return -1;
+  }
+  return lp->size;
+}
+#endif /* COFFEE_WRITE_BUFFERS > 0 */
+/*---------------------------------------------------------------------------*/
 static int
 get_available_fd(void)
 {
@@ -1031,11 +1819,25 @@ cfs_open(const char *name, int flags)
 void
 cfs_close(int fd)
 {
-  if(FD_VALID(fd)) {
-    coffee_fd_set[fd].flags = COFFEE_FD_FREE;
-    coffee_fd_set[fd].file->references--;
-    coffee_fd_set[fd].file = NULL;
+#if COFFEE_WRITE_BUFFERS > 0
+  struct write_buffer *wb;
+#endif
+
+  if(!FD_VALID(fd)) {
+    return;
+  }
+
+#if COFFEE_WRITE_BUFFERS > 0
+  wb = fd_buffer(fd);
+  if(wb != NULL) {
+    flush_buffer(wb);
+    wb->owner = 0;
   }
+#endif
+
+  coffee_fd_set[fd].flags = COFFEE_FD_FREE;
+  coffee_fd_set[fd].file->references--;
+  coffee_fd_set[fd].file = NULL;
 }
 /*---------------------------------------------------------------------------*/
 cfs_offset_t
@@ -1106,6 +1908,11 @@ cfs_read(int fd, void *buf, unsigned size)
   }
 
   fdp = &coffee_fd_set[fd];
+#if COFFEE_WRITE_BUFFERS > 0
+  if(flush_buffers(fdp->file, NULL) < 0) {
+    return -1;
+  }
+#endif
   file = fdp->file;
   if(fdp->offset + size > file->end) {
     size = file->end - fdp->offset;
@@ -1157,6 +1964,9 @@ cfs_write(int fd, const void *buf, unsigned size)
   cfs_offset_t bytes_left;
   const char dummy[1] = { 0xff };
 #endif
+#if COFFEE_WRITE_BUFFERS > 0
+  struct write_buffer *wb;
+#endif
 
   if(!(FD_VALID(fd) && FD_WRITABLE(fd))) {
     return -1;
@@ -1187,12 +1997,24 @@ cfs_write(int fd, const void *buf, unsigned size)
      (FILE_MODIFIED(file) || fdp->offset < file->end)) {
 #else
   if(FILE_MODIFIED(file) || fdp->offset < file->end) {
+#endif
+#if COFFEE_WRITE_BUFFERS > 0
+    wb = fd_buffer(fd);
+    if(flush_buffers(file, wb) < 0) {
+      return -1;
+    }
+    file = fdp->file;
 #endif
     for(bytes_left = size; bytes_left > 0;) {
       lp.offset = fdp->offset;
       lp.buf = buf;
       lp.size = bytes_left;
+#if COFFEE_WRITE_BUFFERS > 0
+      i = wb != NULL ? buffer_write(wb, file, &lp) : write_log_page(file, &lp);
+      file = fdp->file;
+#else
       i = write_log_page(file, &lp);
+#endif
       if(i < 0) {
 	/* Return -1 if we wrote nothing because the log write failed. */
 	if(size == bytes_left) {
@@ -1218,6 +2040,7 @@ cfs_write(int fd, const void *buf, unsigned size)
 
     if(fdp->offset > file->end) {
       /* Update the original file's end with a dummy write. */
+      set_eof_hint(file, fdp->offset + 1);
       COFFEE_WRITE(dummy, 1, absolute_offset(file->page, fdp->offset));
     }
   } else {
@@ -1227,7 +2050,14 @@ cfs_write(int fd, const void *buf, unsigned size)
       return -1;
     }
 #endif /* COFFEE_APPEND_ONLY */
+#if COFFEE_WRITE_BUFFERS > 0
+    if(flush_buffers(file, NULL) < 0) {
+      return -1;
+    }
+    file = fdp->file;
+#endif
 
+    set_eof_hint(file, fdp->offset + size);
     COFFEE_WRITE(buf, size, absolute_offset(file->page, fdp->offset));
     fdp->offset += size;
 #if COFFEE_MICRO_LOGS
@@ -1324,10 +2154,30 @@ cfs_coffee_configure_log(const char *filename, unsigned log_size,
 int
 cfs_coffee_set_io_semantics(int fd, unsigned flags)
 {
+#if COFFEE_WRITE_BUFFERS > 0
+  int i;
+#endif
+
   if(!FD_VALID(fd)) {
     return -1;
   }
 
+  if(flags & CFS_COFFEE_IO_BUFFERED) {
+#if COFFEE_WRITE_BUFFERS > 0
+    for(i = 0; i < COFFEE_WRITE_BUFFERS && fd_buffer(fd) == NULL; i++) {
+      if(write_buffers[i].owner == 0) {
+	memset(&write_buffers[i], 0, sizeof(write_buffers[i]));
+	write_buffers[i].owner = fd + 1;
+      }
+    }
+    if(fd_buffer(fd) == NULL) {
+      return -1;
+    }
+#else
+    return -1;
+#endif
+  }
+
   coffee_fd_set[fd].io_flags |= flags;
 
   return 0;
@@ -1356,6 +2206,74 @@ cfs_coffee_format(void)
   return 0;
 }
 /*---------------------------------------------------------------------------*/
+#if COFFEE_GC_PROCESS
+static int
+gc_turn(void)
+{
+  /* A reclaimed extent comes first, then the standing reserve. */
+  if(gc_target > 0) {
+    if(gc_step(gc_target) > 0) {
+      return 1;
+    }
+    gc_target = 0;
+  }
+  return gc_step(page_count(COFFEE_GC_RESERVE)) > 0;
+}
+/*---------------------------------------------------------------------------*/
+PROCESS_THREAD(coffee_gc_process, ev, data)
+{
+  static clock_time_t start;
+
+  PROCESS_BEGIN();
+
+  while(1) {
+    PROCESS_WAIT_EVENT_UNTIL(ev == PROCESS_EVENT_POLL);
+
+    start = clock_time();
+    while(gc_turn()) {
+      if(clock_time() - start >= COFFEE_GC_BUDGET) {
+	PROCESS_PAUSE();
+	start = clock_time();
+      }
+    }
+  }
+
+  PROCESS_END();
+}
+/*---------------------------------------------------------------------------*/
+int
+cfs_coffee_reclaim(cfs_offset_t size)
+{
+  struct sector_map map;
+  coffee_page_t pages;
+  unsigned first, last;
+  int status;
+
+  if(size < 0 || size > (cfs_offset_t)COFFEE_SIZE) {
+    return -1;
+  }
+  pages = page_count(size);
+#if COFFEE_FREE_MAP
+  if(find_extent(pages) != INVALID_PAGE) {
+    return 0;
+  }
+#endif
+  if(gc_target >= pages) {
+    return 1;
+  }
+
+  /* Check that collecting can make the extent before asking for it. */
+  scan_sectors(&map);
+  status = find_window(pages, &map, &first, &last);
+  if(status > 0) {
+    gc_target = pages;
+    gc_poll();
+    return 1;
+  }
+  return status;
+}
+#endif /* COFFEE_GC_PROCESS */
+/*---------------------------------------------------------------------------*/
 void *
 cfs_coffee_get_protected_mem(unsigned *size)
 {
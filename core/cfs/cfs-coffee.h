@@ -63,6 +63,21 @@
  */
 #define CFS_COFFEE_IO_FIRM_SIZE		0x2
 
+/**
+ * Instruct Coffee to collect adjacent small writes to a file with a
+ * micro log in a RAM buffer, and to write them to the log as one
+ * record. The buffer is written out when the record is full, before
+ * a write that is not adjacent, before the file is read, and when the
+ * file descriptor is closed. Data still in the buffer is lost on a
+ * reset, and a failure to write it out on close is not reported.
+ *
+ * Coffee has COFFEE_WRITE_BUFFERS buffers; cfs_coffee_set_io_semantics()
+ * fails if none is free.
+ *
+ * \sa cfs_coffee_set_io_semantics()
+ */
+#define CFS_COFFEE_IO_BUFFERED		0x4
+
 /**
  * \file
  *	Header for the Coffee file system.
@@ -113,9 +128,25 @@ int cfs_coffee_configure_log(const char *file, unsigned log_size,
  * switch the /O semantics on a file that is accessed through a 
  * particular file descriptor.
  *
+ * \return 0 on success, -1 on failure.
  */
 int cfs_coffee_set_io_semantics(int fd, unsigned flags);
 
+/**
+ * \brief Make room for a file ahead of time.
+ * \param size The size of the file.
+ * \return 0 if there is room already, 1 if the garbage collector
+ * process will make room, -1 if collecting garbage cannot make room.
+ *
+ * When Coffee is built with COFFEE_GC_PROCESS, its garbage collector
+ * runs as a process that erases one sector at a time while the system
+ * is idle. This function asks the process to free a contiguous area
+ * for a file of the given size, so that a burst of writes that is
+ * known to come will not wait for sector erasures. The process also
+ * starts by itself when files are reserved or removed.
+ */
+int cfs_coffee_reclaim(cfs_offset_t size);
+
 /**
  * \brief Format the storage area assigned to Coffee.
  * \return 0 on success, -1 on failure.
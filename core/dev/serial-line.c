@@ -114,11 +114,11 @@ PROCESS_THREAD(serial_line_process, ev, data)
         buf[ptr++] = (uint8_t)'\0';
 
         /* Broadcast event */
-        process_post(PROCESS_BROADCAST, serial_line_event_message, buf);
+        process_post_high(PROCESS_BROADCAST, serial_line_event_message, buf);
 
         /* Wait until all processes have handled the serial line event */
         if(PROCESS_ERR_OK ==
-          process_post(PROCESS_CURRENT(), PROCESS_EVENT_CONTINUE, NULL)) {
+          process_post_high(PROCESS_CURRENT(), PROCESS_EVENT_CONTINUE, NULL)) {
           PROCESS_WAIT_EVENT_UNTIL(ev == PROCESS_EVENT_CONTINUE);
         }
         ptr = 0;
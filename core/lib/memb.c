@@ -48,12 +48,68 @@
 #include "contiki.h"
 #include "lib/memb.h"
 
+static struct memb_pool *pools;
+/*---------------------------------------------------------------------------*/
+/* Link all blocks of a MEMB_FREELIST() pool in its free list. */
+static void
+pool_init(struct memb *m)
+{
+  struct memb_pool *p = m->pool;
+  char *block;
+  int i;
+
+  p->free = NULL;
+  block = (char *)m->mem + m->num * m->size;
+  for(i = 0; i < m->num; ++i) {
+    block -= m->size;
+    *(void **)block = p->free;
+    p->free = block;
+  }
+  p->used = p->max_used = p->failures = p->bad_frees = 0;
+
+  if(p->memb == NULL) {
+    p->memb = m;
+    p->next = pools;
+    pools = p;
+  }
+}
 /*---------------------------------------------------------------------------*/
 void
 memb_init(struct memb *m)
 {
-  memset(m->count, 0, m->num);
+  if(m->count != NULL) {
+    memset(m->count, 0, m->num);
+  }
   memset(m->mem, 0, m->size * m->num);
+  if(m->pool != NULL) {
+    pool_init(m);
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void *
+pool_alloc(struct memb *m)
+{
+  struct memb_pool *p = m->pool;
+  void *block;
+
+  if(p->memb == NULL) {
+    /* The pool is used without memb_init(). */
+    pool_init(m);
+  }
+
+  block = p->free;
+  if(block == NULL) {
+    ++p->failures;
+    return NULL;
+  }
+  p->free = *(void **)block;
+#if MEMB_CHECK
+  m->count[((char *)block - (char *)m->mem) / m->size] = 1;
+#endif
+  if(++p->used > p->max_used) {
+    p->max_used = p->used;
+  }
+  return block;
 }
 /*---------------------------------------------------------------------------*/
 void *
@@ -61,6 +117,10 @@ memb_alloc(struct memb *m)
 {
   int i;
 
+  if(m->pool != NULL) {
+    return pool_alloc(m);
+  }
+
   for(i = 0; i < m->num; ++i) {
     if(m->count[i] == 0) {
       /* If this block was unused, we increase the reference count to
@@ -76,12 +136,41 @@ memb_alloc(struct memb *m)
   return NULL;
 }
 /*---------------------------------------------------------------------------*/
+static char
+pool_free(struct memb *m, void *ptr)
+{
+  struct memb_pool *p = m->pool;
+#if MEMB_CHECK
+  int offset;
+
+  if(!memb_inmemb(m, ptr)) {
+    ++p->bad_frees;
+    return -1;
+  }
+  offset = (char *)ptr - (char *)m->mem;
+  if(offset % m->size != 0 || m->count[offset / m->size] == 0) {
+    /* Not the start of a block, or a block that is already free. */
+    ++p->bad_frees;
+    return offset % m->size != 0 ? -1 : 0;
+  }
+  m->count[offset / m->size] = 0;
+#endif
+  *(void **)ptr = p->free;
+  p->free = ptr;
+  --p->used;
+  return 0;
+}
+/*---------------------------------------------------------------------------*/
 char
 memb_free(struct memb *m, void *ptr)
 {
   int i;
   char *ptr2;
 
+  if(m->pool != NULL) {
+    return pool_free(m, ptr);
+  }
+
   /* Walk through the list of blocks and try to find the block to
      which the pointer "ptr" points to. */
   ptr2 = (char *)m->mem;
@@ -108,5 +197,11 @@ memb_inmemb(struct memb *m, void *ptr)
     (char *)ptr < (char *)m->mem + (m->num * m->size);
 }
 /*---------------------------------------------------------------------------*/
+struct memb_pool *
+memb_pool_list(void)
+{
+  return pools;
+}
+/*---------------------------------------------------------------------------*/
 
 /** @} */
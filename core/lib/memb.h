@@ -47,7 +47,9 @@
  * size. A set of memory blocks is statically declared with the
  * MEMB() macro. Memory blocks are allocated from the declared
  * memory by the memb_alloc() function, and are deallocated with the
- * memb_free() function.
+ * memb_free() function. Blocks declared with MEMB_FREELIST() are
+ * allocated and deallocated in constant time and keep usage
+ * statistics.
  *
  * @{
  */
@@ -94,11 +96,86 @@ MEMB(connections, struct connection, 16);
                                           CC_CONCAT(name,_memb_count), \
                                           (void *)CC_CONCAT(name,_memb_mem)}
 
+/**
+ * Check memb_free() calls on MEMB_FREELIST() pools.
+ *
+ * With the check, every block has a used flag, as in MEMB(), and
+ * freeing a free block or a pointer into the middle of a block is
+ * counted and ignored. Without it, such a call corrupts the free list.
+ */
+#ifdef MEMB_CONF_CHECK
+#define MEMB_CHECK MEMB_CONF_CHECK
+#else
+#define MEMB_CHECK 1
+#endif
+
+#if MEMB_CHECK
+#define MEMB_COUNT_DECL(name, num) \
+        static char CC_CONCAT(name,_memb_count)[num];
+#define MEMB_COUNT(name) CC_CONCAT(name,_memb_count)
+#else
+#define MEMB_COUNT_DECL(name, num)
+#define MEMB_COUNT(name) 0
+#endif
+
+/**
+ * Declare a memory block with constant time allocation.
+ *
+ * This macro declares a memory block like MEMB(), used with the same
+ * functions. The unused blocks are linked in a free list that runs
+ * through the blocks themselves, so memb_alloc() and memb_free() do
+ * not search the block, and the block keeps usage statistics (see
+ * memb_pool_list()). A block is at least as large as a pointer.
+ *
+ * Unlike with MEMB(), a block that has been freed does not hold zeros
+ * when it is allocated again, and a block has no reference count:
+ * memb_free() always frees it.
+ *
+ * \param name The name of the memory block.
+ *
+ * \param structure The name of the struct that the memory block holds
+ *
+ * \param num The total number of memory chunks in the block.
+ *
+ */
+#define MEMB_FREELIST(name, structure, num) \
+        MEMB_COUNT_DECL(name, num) \
+        static union { \
+          structure s; \
+          void *next; \
+        } CC_CONCAT(name,_memb_mem)[num]; \
+        static struct memb_pool CC_CONCAT(name,_memb_pool) = {0, #name}; \
+        static struct memb name = {sizeof(CC_CONCAT(name,_memb_mem)[0]), num, \
+                                   MEMB_COUNT(name), \
+                                   (void *)CC_CONCAT(name,_memb_mem), \
+                                   &CC_CONCAT(name,_memb_pool)}
+
+/**
+ * Free list and statistics of a MEMB_FREELIST() memory block.
+ */
+struct memb_pool {
+  struct memb_pool *next;
+  const char *name;
+  struct memb *memb;
+  /** First free block */
+  void *free;
+  /** Blocks in use */
+  unsigned short used;
+  /** Highest value of used since memb_init() */
+  unsigned short max_used;
+  /** memb_alloc() calls that found no free block */
+  unsigned short failures;
+  /** memb_free() calls on free blocks or invalid pointers */
+  unsigned short bad_frees;
+};
+
 struct memb {
   unsigned short size;
   unsigned short num;
   char *count;
   void *mem;
+  /* NULL for MEMB() */
+  struct memb_pool *pool;
 };
 
 /**
@@ -131,6 +208,16 @@ char  memb_free(struct memb *m, void *ptr);
 
 int memb_inmemb(struct memb *m, void *ptr);
 
+/**
+ * Get the MEMB_FREELIST() memory blocks in use.
+ *
+ * \return The first pool in the list, linked with the next field.
+ *
+ * A pool is added to the list when it is initialized, by memb_init()
+ * or by its first memb_alloc().
+ */
+struct memb_pool *memb_pool_list(void);
+
 
 /** @} */
 /** @} */
@@ -0,0 +1,320 @@
+/**
+ * \addtogroup tlsf
+ * @{
+ */
+
+/**
+ * \file
+ *         Size-class memory allocator (two-level segregated fit)
+ */
+
+#include "contiki-conf.h"
+#include "lib/tlsf.h"
+#include <string.h>
+
+#ifdef TLSF_CONF_SIZE
+#define TLSF_SIZE TLSF_CONF_SIZE
+#else
+#define TLSF_SIZE 4096
+#endif
+
+/*
+ * Every block starts with a header: the block before it in memory and
+ * its own size, whose lowest bit is set while the block is free. A free
+ * block keeps its free list links in the first bytes of its payload,
+ * which sets the smallest payload. The heap ends with a used block of
+ * size 0, so the last real block has a neighbour that never merges.
+ */
+struct block {
+  struct block *prev_phys;
+  size_t size;
+  struct block *next_free;
+  struct block *prev_free;
+};
+
+#define HEADER    offsetof(struct block, next_free)
+#define MIN_SIZE  (sizeof(struct block) - HEADER)
+#define ALIGN     sizeof(void *)
+#define FREE_BIT  ((size_t)1)
+#define SIZE(b)   ((b)->size & ~FREE_BIT)
+#define NEXT(b)   ((struct block *)((char *)(b) + HEADER + SIZE(b)))
+
+/* Payload of the single free block of an empty heap */
+#define AREA      ((TLSF_SIZE - 2 * HEADER) & ~(ALIGN - 1))
+
+/* Integer log2 of a constant, for array sizes */
+#define LOG2_4(n)  ((n) & 0xc ? ((n) & 0x8 ? 3 : 2) : ((n) & 0x2 ? 1 : 0))
+#define LOG2_8(n)  ((n) & 0xf0 ? 4 + LOG2_4((n) >> 4) : LOG2_4(n))
+#define LOG2_16(n) ((n) & 0xff00 ? 8 + LOG2_8((n) >> 8) : LOG2_8(n))
+#define LOG2(n)    ((n) & 0xffff0000UL ? 16 + LOG2_16((n) >> 16) : LOG2_16(n))
+
+/*
+ * Size classes. Payloads below SMALL have one class per ALIGN bytes.
+ * Above, every range [2^f, 2^(f+1)) is a first level class split into
+ * SL_COUNT second level classes of equal width. A request is rounded up
+ * to the next class boundary before the search, so any block in the
+ * class found is large enough and no list is searched.
+ */
+#define SL_BITS   2
+#define SL_COUNT  (1 << SL_BITS)
+#define FL_SHIFT  (SL_BITS + LOG2(ALIGN))
+#define SMALL     ((size_t)1 << FL_SHIFT)
+#define FL_COUNT  (LOG2(TLSF_SIZE) - FL_SHIFT + 2)
+
+static union {
+  struct block align;
+  char bytes[TLSF_SIZE];
+} heap;
+
+static struct block *heads[FL_COUNT][SL_COUNT];
+/* One bit per first level class with a non-empty list */
+static unsigned int fl_bitmap;
+/* One bit per non-empty second level list */
+static unsigned char sl_bitmap[FL_COUNT];
+
+static size_t used, max_used, free_bytes;
+static unsigned int blocks, failures;
+/*---------------------------------------------------------------------------*/
+/* Lowest set bit */
+static unsigned char
+ffs_bit(unsigned int x)
+{
+#ifdef __GNUC__
+  return __builtin_ctz(x);
+#else
+  unsigned char n = 0;
+
+  while(!(x & 1)) {
+    x >>= 1;
+    n++;
+  }
+  return n;
+#endif
+}
+/*---------------------------------------------------------------------------*/
+/* Highest set bit */
+static unsigned char
+fls_bit(size_t x)
+{
+#ifdef __GNUC__
+  return sizeof(unsigned long) * 8 - 1 - __builtin_clzl((unsigned long)x);
+#else
+  unsigned char n = 0;
+
+  while(x >>= 1) {
+    n++;
+  }
+  return n;
+#endif
+}
+/*---------------------------------------------------------------------------*/
+static void
+mapping(size_t size, unsigned char *fl, unsigned char *sl)
+{
+  unsigned char f;
+
+  if(size < SMALL) {
+    *fl = 0;
+    *sl = size / ALIGN;
+  } else {
+    f = fls_bit(size);
+    *fl = f - FL_SHIFT + 1;
+    *sl = (size >> (f - SL_BITS)) - SL_COUNT;
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+insert_free(struct block *b)
+{
+  unsigned char fl, sl;
+
+  mapping(SIZE(b), &fl, &sl);
+  b->size |= FREE_BIT;
+  b->prev_free = NULL;
+  b->next_free = heads[fl][sl];
+  if(b->next_free != NULL) {
+    b->next_free->prev_free = b;
+  }
+  heads[fl][sl] = b;
+  fl_bitmap |= 1U << fl;
+  sl_bitmap[fl] |= 1U << sl;
+  free_bytes += SIZE(b);
+}
+/*---------------------------------------------------------------------------*/
+static void
+remove_free(struct block *b)
+{
+  unsigned char fl, sl;
+
+  mapping(SIZE(b), &fl, &sl);
+  if(b->prev_free != NULL) {
+    b->prev_free->next_free = b->next_free;
+  } else {
+    heads[fl][sl] = b->next_free;
+    if(b->next_free == NULL) {
+      sl_bitmap[fl] &= ~(1U << sl);
+      if(sl_bitmap[fl] == 0) {
+        fl_bitmap &= ~(1U << fl);
+      }
+    }
+  }
+  if(b->next_free != NULL) {
+    b->next_free->prev_free = b->prev_free;
+  }
+  b->size &= ~FREE_BIT;
+  free_bytes -= SIZE(b);
+}
+/*---------------------------------------------------------------------------*/
+static struct block *
+find_free(size_t size)
+{
+  unsigned char fl, sl;
+  unsigned int map;
+
+  if(size >= SMALL) {
+    size += ((size_t)1 << (fls_bit(size) - SL_BITS)) - 1;
+  }
+  mapping(size, &fl, &sl);
+  if(fl >= FL_COUNT) {
+    return NULL;
+  }
+  map = sl_bitmap[fl] & (~0U << sl);
+  if(map == 0) {
+    /* Nothing in this class: take the smallest larger first level */
+    map = fl + 1 < FL_COUNT ? fl_bitmap & (~0U << (fl + 1)) : 0;
+    if(map == 0) {
+      return NULL;
+    }
+    fl = ffs_bit(map);
+    map = sl_bitmap[fl];
+  }
+  return heads[fl][ffs_bit(map)];
+}
+/*---------------------------------------------------------------------------*/
+void *
+tlsf_alloc(size_t size)
+{
+  struct block *b, *rest;
+
+  if(size == 0) {
+    return NULL;
+  }
+  if(size > AREA) {
+    failures++;
+    return NULL;
+  }
+  size = (size + ALIGN - 1) & ~(ALIGN - 1);
+  if(size < MIN_SIZE) {
+    size = MIN_SIZE;
+  }
+
+  b = find_free(size);
+  if(b == NULL) {
+    failures++;
+    return NULL;
+  }
+  remove_free(b);
+
+  /* Give the tail back if it can hold a block of its own */
+  if(b->size >= size + sizeof(struct block)) {
+    rest = (struct block *)((char *)b + HEADER + size);
+    rest->size = b->size - size - HEADER;
+    rest->prev_phys = b;
+    NEXT(rest)->prev_phys = rest;
+    b->size = size;
+    insert_free(rest);
+  }
+
+  used += b->size;
+  if(used > max_used) {
+    max_used = used;
+  }
+  blocks++;
+  return (char *)b + HEADER;
+}
+/*---------------------------------------------------------------------------*/
+void
+tlsf_free(void *ptr)
+{
+  struct block *b, *n;
+
+  if(ptr == NULL) {
+    return;
+  }
+  b = (struct block *)((char *)ptr - HEADER);
+  if(b->size & FREE_BIT) {
+    /* Freed twice */
+    return;
+  }
+  used -= b->size;
+  blocks--;
+
+  /* Merge with the free neighbours */
+  if(b->prev_phys != NULL && (b->prev_phys->size & FREE_BIT)) {
+    n = b;
+    b = b->prev_phys;
+    remove_free(b);
+    b->size += HEADER + n->size;
+  }
+  n = NEXT(b);
+  if(n->size & FREE_BIT) {
+    remove_free(n);
+    b->size += HEADER + n->size;
+  }
+  NEXT(b)->prev_phys = b;
+  insert_free(b);
+}
+/*---------------------------------------------------------------------------*/
+size_t
+tlsf_block_size(void *ptr)
+{
+  return SIZE((struct block *)((char *)ptr - HEADER));
+}
+/*---------------------------------------------------------------------------*/
+void
+tlsf_stats(struct tlsf_stats *s)
+{
+  struct block *b;
+  unsigned char fl;
+
+  s->used = used;
+  s->max_used = max_used;
+  s->free = free_bytes;
+  s->blocks = blocks;
+  s->failures = failures;
+  s->largest_free = 0;
+  if(fl_bitmap != 0) {
+    /* The largest block is in the highest non-empty class */
+    fl = fls_bit(fl_bitmap);
+    for(b = heads[fl][fls_bit(sl_bitmap[fl])]; b != NULL; b = b->next_free) {
+      if(SIZE(b) > s->largest_free) {
+        s->largest_free = SIZE(b);
+      }
+    }
+  }
+  s->fragmentation = free_bytes == 0 ? 0 :
+    100 - (unsigned long)s->largest_free * 100 / free_bytes;
+}
+/*---------------------------------------------------------------------------*/
+void
+tlsf_init(void)
+{
+  struct block *b, *end;
+
+  memset(heads, 0, sizeof(heads));
+  memset(sl_bitmap, 0, sizeof(sl_bitmap));
+  fl_bitmap = 0;
+  used = max_used = free_bytes = 0;
+  blocks = failures = 0;
+
+  b = &heap.align;
+  b->prev_phys = NULL;
+  b->size = AREA;
+  end = NEXT(b);
+  end->prev_phys = b;
+  end->size = 0;
+  insert_free(b);
+}
+/*---------------------------------------------------------------------------*/
+
+/** @} */
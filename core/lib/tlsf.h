@@ -0,0 +1,100 @@
+/**
+ * \addtogroup mem
+ * @{
+ */
+
+/**
+ * \defgroup tlsf Size-class memory allocator
+ *
+ * The size-class allocator manages a static heap with two-level
+ * segregated free lists (TLSF). Free blocks are kept in lists by
+ * size class, and two bitmaps record which lists are non-empty, so
+ * tlsf_alloc() and tlsf_free() take constant time whatever the
+ * number and size of the blocks. Freed blocks are merged with their
+ * free neighbours at once, and allocated blocks never move: unlike
+ * mmem, tlsf_alloc() returns a plain pointer.
+ *
+ * tlsf_stats() reports the heap use and its external fragmentation,
+ * the share of the free memory that is not in the largest free block.
+ *
+ * The heap size is set with TLSF_CONF_SIZE.
+ * @{
+ */
+
+/**
+ * \file
+ *         Header file for the size-class memory allocator
+ */
+
+#ifndef __TLSF_H__
+#define __TLSF_H__
+
+#include <stddef.h>
+
+/**
+ * Heap statistics, filled in by tlsf_stats().
+ */
+struct tlsf_stats {
+  /** Bytes in allocated blocks, including size class rounding */
+  size_t used;
+  /** Bytes in free blocks */
+  size_t free;
+  /** Size of the largest free block */
+  size_t largest_free;
+  /** Largest value of used so far */
+  size_t max_used;
+  /** Number of allocated blocks */
+  unsigned int blocks;
+  /** Allocations that failed */
+  unsigned int failures;
+  /** External fragmentation in percent: 100 - 100 * largest_free / free */
+  unsigned char fragmentation;
+};
+
+/**
+ * \brief      Allocate a memory block
+ * \param size The size of the requested memory block
+ * \return     A pointer to the block, or NULL if no free block is
+ *             large enough.
+ *
+ *             The block is aligned for any pointer and stays in place
+ *             until it is freed with tlsf_free().
+ */
+void *tlsf_alloc(size_t size);
+
+/**
+ * \brief      Deallocate a memory block
+ * \param ptr  A pointer returned by tlsf_alloc(), or NULL.
+ */
+void tlsf_free(void *ptr);
+
+/**
+ * \brief      Get the usable size of a memory block
+ * \param ptr  A pointer returned by tlsf_alloc().
+ * \return     The size of the block, at least the size requested.
+ */
+size_t tlsf_block_size(void *ptr);
+
+/**
+ * \brief      Get the heap statistics
+ * \param s    The structure to fill in.
+ *
+ *             This function walks one free list to find the largest
+ *             free block; it is meant for monitoring, not for hot
+ *             paths.
+ */
+void tlsf_stats(struct tlsf_stats *s);
+
+/**
+ * \brief      Initialize the size-class allocator
+ *
+ *             This function initializes the heap as one free block
+ *             and must be called before any other function from the
+ *             module. It can be called again to drop every block.
+ */
+void tlsf_init(void);
+
+#endif /* __TLSF_H__ */
+
+/** @} */
+/** @} */
@@ -79,8 +79,8 @@ static rpl_of_t * const objective_functions[] = {&RPL_OF};
 
 /************************************************************************/
 /* Allocate parents from the same static MEMB chunk to reduce memory waste. */
-MEMB(parent_memb, struct rpl_parent,
-     RPL_MAX_PARENTS_PER_DAG * RPL_MAX_INSTANCES * RPL_MAX_DAG_PER_INSTANCE);
+MEMB_FREELIST(parent_memb, struct rpl_parent,
+              RPL_MAX_PARENTS_PER_DAG * RPL_MAX_INSTANCES * RPL_MAX_DAG_PER_INSTANCE);
 /************************************************************************/
 /* Allocate instance table. */
 rpl_instance_t instance_table[RPL_MAX_INSTANCES];
@@ -131,6 +131,32 @@ void clock_wait(clock_time_t t);
  */
 void clock_delay_usec(uint16_t dt);
 
+/**
+ * \name Tickless idle
+ *
+ * Platforms that set CLOCK_CONF_TICKLESS stop the periodic clock tick
+ * while the system is idle, and wake up when the next event timer
+ * expires (see etimer_sleep_ticks()) or when an interrupt posts an
+ * event. Timers with their own interrupt, such as rtimers, wake the
+ * system up by themselves.
+ *
+ * The main loop calls clock_idle_enter() with interrupts disabled and
+ * no events pending, sleeps until process_nevents() is non-zero, and
+ * then calls clock_idle_exit(), again with interrupts disabled.
+ * clock_idle_exit() adds the ticks slept to clock_time() and
+ * clock_seconds().
+ * @{
+ */
+#ifdef CLOCK_CONF_TICKLESS
+#define CLOCK_TICKLESS CLOCK_CONF_TICKLESS
+#else
+#define CLOCK_TICKLESS 0
+#endif
+
+void clock_idle_enter(void);
+void clock_idle_exit(void);
+/** @} */
+
 /**
  * Deprecated platform-specific routines.
  *
@@ -50,11 +50,405 @@
 #include "sys/etimer.h"
 #include "sys/process.h"
 
-static struct etimer *timerlist;
+/* Half the clock range: larger distances are in the past */
+#define CLOCK_HALF ((clock_time_t)~0 >> 1)
+
 static clock_time_t next_expiration;
 
 PROCESS(etimer_process, "Event timer");
 /*---------------------------------------------------------------------------*/
+#if ETIMER_CONF_WHEEL
+/*
+ * Hierarchical timing wheel. Level 0 has one slot per clock tick for
+ * the next WHEEL_SLOTS ticks; a slot of level k covers WHEEL_SLOTS^k
+ * ticks and is cascaded into the levels below when the wheel below it
+ * wraps around. Timers further away than the last level wait in the
+ * far list, which is cascaded every WHEEL_SPAN(ETIMER_WHEEL_LEVELS)
+ * ticks. Timers that are due, or whose event could not be posted yet,
+ * wait in the due list.
+ *
+ * Every timer records the slot it is in, so setting and stopping a
+ * timer only searches the list of that slot. A timer is on the wheel
+ * only if it is found there, so the slot number of a timer that was
+ * never set may hold anything. The poll handler only visits the slots
+ * of the ticks that have elapsed, jumping over empty levels.
+ */
+#define WHEEL_BITS     4
+#define WHEEL_SLOTS    (1 << WHEEL_BITS)
+#define WHEEL_MASK     (WHEEL_SLOTS - 1)
+#define WHEEL_SPAN(k)  ((clock_time_t)1 << (WHEEL_BITS * (k)))
+#define SLOT_FAR       (ETIMER_WHEEL_LEVELS * WHEEL_SLOTS)
+#define SLOT_DUE       (SLOT_FAR + 1)
+#define SLOT_NONE      0xff
+
+
+static struct etimer *wheel[SLOT_DUE + 1];
+/* One bit per non-empty slot, for each level */
+static unsigned short occupied[ETIMER_WHEEL_LEVELS];
+/* The next tick to be processed */
+static clock_time_t cursor;
+static unsigned short ntimers;
+/* next_expiration must be recomputed */
+static unsigned char next_dirty;
+/*---------------------------------------------------------------------------*/
+static void
+wheel_link(struct etimer *t, unsigned char s)
+{
+  t->next = wheel[s];
+  wheel[s] = t;
+  t->slot = s;
+  if(s < SLOT_FAR) {
+    occupied[s >> WHEEL_BITS] |= 1 << (s & WHEEL_MASK);
+  }
+  ntimers++;
+}
+/*---------------------------------------------------------------------------*/
+/* Unlink t, given the pointer that points at it. */
+static void
+wheel_unlink(struct etimer *t, struct etimer **link)
+{
+  unsigned char s = t->slot;
+
+  *link = t->next;
+  /* Was it alone in a slot of the wheel? */
+  if(s < SLOT_FAR && wheel[s] == NULL) {
+    occupied[s >> WHEEL_BITS] &= ~(1 << (s & WHEEL_MASK));
+  }
+  t->next = NULL;
+  t->slot = SLOT_NONE;
+  ntimers--;
+}
+/*---------------------------------------------------------------------------*/
+/* The pointer that points at t on the wheel, or NULL if t is not on it. */
+static struct etimer **
+wheel_find(struct etimer *t)
+{
+  struct etimer **link;
+
+  if(t->p == PROCESS_NONE || t->slot > SLOT_DUE) {
+    return NULL;
+  }
+  for(link = &wheel[t->slot]; *link != NULL; link = &(*link)->next) {
+    if(*link == t) {
+      return link;
+    }
+  }
+  return NULL;
+}
+/*---------------------------------------------------------------------------*/
+static void
+wheel_add(struct etimer *t)
+{
+  clock_time_t e = t->timer.start + t->timer.interval;
+  clock_time_t d = e - cursor;
+  unsigned char k;
+
+  if(d > CLOCK_HALF) {
+    /* Its tick has already been processed. */
+    wheel_link(t, SLOT_DUE);
+  } else {
+    for(k = 0; k < ETIMER_WHEEL_LEVELS; k++) {
+      if(d < WHEEL_SPAN(k + 1)) {
+        wheel_link(t, k * WHEEL_SLOTS +
+                   ((e >> (WHEEL_BITS * k)) & WHEEL_MASK));
+        return;
+      }
+    }
+    wheel_link(t, SLOT_FAR);
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+cascade(unsigned char s)
+{
+  struct etimer *t, *n;
+
+  /* Take the whole slot first: far timers may go back to the far list. */
+  t = wheel[s];
+  wheel[s] = NULL;
+  if(s < SLOT_FAR) {
+    occupied[s >> WHEEL_BITS] &= ~(1 << (s & WHEEL_MASK));
+  }
+  for(; t != NULL; t = n) {
+    n = t->next;
+    ntimers--;
+    wheel_add(t);
+  }
+}
+/*---------------------------------------------------------------------------*/
+/* The tick of the next cascade of level k (the cursor itself for level 0) */
+static clock_time_t
+next_cascade(unsigned char k)
+{
+  return ((cursor - 1) | (WHEEL_SPAN(k) - 1)) + 1;
+}
+/*---------------------------------------------------------------------------*/
+static unsigned char
+earliest(struct etimer *t, clock_time_t *best, unsigned char found)
+{
+  for(; t != NULL; t = t->next) {
+    if(!found || (clock_time_t)(etimer_expiration_time(t) - cursor) <
+       (clock_time_t)(*best - cursor)) {
+      *best = etimer_expiration_time(t);
+      found = 1;
+    }
+  }
+  return found;
+}
+/*---------------------------------------------------------------------------*/
+static void
+update_time(void)
+{
+  struct etimer *t;
+  clock_time_t best = 0, b;
+  unsigned char k, i, j, found = 0;
+
+  next_dirty = 0;
+  if(ntimers == 0) {
+    next_expiration = 0;
+    return;
+  }
+  if(wheel[SLOT_DUE] != NULL) {
+    next_expiration = etimer_expiration_time(wheel[SLOT_DUE]);
+    return;
+  }
+
+  /*
+   * Search the first non-empty slot of each level, in the order the
+   * slots will be reached. All timers of a level expire after its next
+   * cascade, so the search stops once the best so far comes earlier.
+   */
+  for(k = 0; k <= ETIMER_WHEEL_LEVELS; k++) {
+    b = next_cascade(k);
+    if(found && (clock_time_t)(best - cursor) < (clock_time_t)(b - cursor)) {
+      break;
+    }
+    if(k == ETIMER_WHEEL_LEVELS) {
+      found = earliest(wheel[SLOT_FAR], &best, found);
+      break;
+    }
+    i = (b >> (WHEEL_BITS * k)) & WHEEL_MASK;
+    for(j = 0; j < WHEEL_SLOTS; j++) {
+      t = wheel[k * WHEEL_SLOTS + ((i + j) & WHEEL_MASK)];
+      if(t != NULL) {
+        found = earliest(t, &best, found);
+        break;
+      }
+    }
+  }
+  next_expiration = best;
+}
+/*---------------------------------------------------------------------------*/
+static void
+wheel_run(void)
+{
+  clock_time_t now = clock_time();
+  clock_time_t next;
+  struct etimer *t;
+  unsigned char k, i;
+
+  if(ntimers == 0) {
+    cursor = now + 1;
+  }
+
+  /* Every tick from cursor up to now */
+  while((clock_time_t)(now - cursor) <= CLOCK_HALF) {
+    if((cursor & WHEEL_MASK) == 0) {
+      /* Level 0 wrapped: bring down the next slot of level 1, and so
+	 on up for every level that wrapped too. */
+      for(k = 1; k < ETIMER_WHEEL_LEVELS; k++) {
+        i = (cursor >> (WHEEL_BITS * k)) & WHEEL_MASK;
+        cascade(k * WHEEL_SLOTS + i);
+        if(i != 0) {
+          break;
+        }
+      }
+      if(k == ETIMER_WHEEL_LEVELS) {
+        cascade(SLOT_FAR);
+      }
+    }
+
+    i = cursor & WHEEL_MASK;
+    while((t = wheel[i]) != NULL) {
+      wheel_unlink(t, &wheel[i]);
+      wheel_link(t, SLOT_DUE);
+    }
+
+    /* Skip the ticks of empty levels, up to the next cascade that can
+       bring something down. */
+    for(k = 0; k < ETIMER_WHEEL_LEVELS && occupied[k] == 0; k++);
+    if(k == 0) {
+      cursor++;
+      continue;
+    }
+    if(k == ETIMER_WHEEL_LEVELS && wheel[SLOT_FAR] == NULL) {
+      cursor = now + 1;
+      break;
+    }
+    next = (cursor | (WHEEL_SPAN(k) - 1)) + 1;
+    if((clock_time_t)(now - next) > CLOCK_HALF) {
+      cursor = now + 1;
+      break;
+    }
+    cursor = next;
+  }
+
+  while((t = wheel[SLOT_DUE]) != NULL) {
+    if(process_post(t->p, PROCESS_EVENT_TIMER, t) != PROCESS_ERR_OK) {
+      etimer_request_poll();
+      break;
+    }
+    /* Reset the process ID of the event timer, to signal that the
+       etimer has expired. This is later checked in the
+       etimer_expired() function. */
+    wheel_unlink(t, &wheel[SLOT_DUE]);
+    t->p = PROCESS_NONE;
+  }
+  next_dirty = 1;
+}
+/*---------------------------------------------------------------------------*/
+PROCESS_THREAD(etimer_process, ev, data)
+{
+  struct etimer **link;
+  unsigned char s;
+	
+  PROCESS_BEGIN();
+
+  for(s = 0; s <= SLOT_DUE; s++) {
+    wheel[s] = NULL;
+  }
+  for(s = 0; s < ETIMER_WHEEL_LEVELS; s++) {
+    occupied[s] = 0;
+  }
+  ntimers = 0;
+  cursor = clock_time();
+
+  while(1) {
+    PROCESS_YIELD();
+
+    if(ev == PROCESS_EVENT_EXITED) {
+      struct process *p = data;
+
+      for(s = 0; s <= SLOT_DUE; s++) {
+	for(link = &wheel[s]; *link != NULL;) {
+	  if((*link)->p == p) {
+	    wheel_unlink(*link, link);
+	  } else {
+	    link = &(*link)->next;
+	  }
+	}
+      }
+      next_dirty = 1;
+      continue;
+    } else if(ev != PROCESS_EVENT_POLL) {
+      continue;
+    }
+
+    wheel_run();
+  }
+  
+  PROCESS_END();
+}
+/*---------------------------------------------------------------------------*/
+void
+etimer_request_poll(void)
+{
+  process_poll(&etimer_process);
+}
+/*---------------------------------------------------------------------------*/
+static void
+add_timer(struct etimer *timer)
+{
+  struct etimer **link;
+
+  etimer_request_poll();
+
+  link = wheel_find(timer);
+  if(link != NULL) {
+    /* Timer already on the wheel: move it, but keep its process. */
+    if(etimer_expiration_time(timer) == next_expiration) {
+      next_dirty = 1;
+    }
+    wheel_unlink(timer, link);
+  } else {
+    timer->p = PROCESS_CURRENT();
+  }
+
+  if(ntimers == 0) {
+    /* Nothing to cascade: catch up with a clock that ran while the
+       wheel was empty. */
+    cursor = clock_time();
+    next_dirty = 0;
+    next_expiration = etimer_expiration_time(timer);
+  } else if(!next_dirty &&
+	    (clock_time_t)(etimer_expiration_time(timer) - cursor) <
+	    (clock_time_t)(next_expiration - cursor)) {
+    next_expiration = etimer_expiration_time(timer);
+  }
+  wheel_add(timer);
+  if(wheel[SLOT_DUE] == timer) {
+    next_expiration = etimer_expiration_time(timer);
+  }
+}
+/*---------------------------------------------------------------------------*/
+/* Take et off the wheel. Returns 0 if it was not on it. */
+static int
+remove_timer(struct etimer *et)
+{
+  struct etimer **link;
+
+  link = wheel_find(et);
+  if(link == NULL) {
+    return 0;
+  }
+  if(etimer_expiration_time(et) == next_expiration) {
+    next_dirty = 1;
+  }
+  wheel_unlink(et, link);
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
+int
+etimer_pending(void)
+{
+  return ntimers != 0;
+}
+/*---------------------------------------------------------------------------*/
+clock_time_t
+etimer_next_expiration_time(void)
+{
+  if(next_dirty) {
+    update_time();
+  }
+  return etimer_pending() ? next_expiration : 0;
+}
+/*---------------------------------------------------------------------------*/
+void
+etimer_adjust(struct etimer *et, int timediff)
+{
+  if(remove_timer(et)) {
+    et->timer.start += timediff;
+    wheel_add(et);
+    next_dirty = 1;
+  } else {
+    et->timer.start += timediff;
+  }
+}
+/*---------------------------------------------------------------------------*/
+void
+etimer_stop(struct etimer *et)
+{
+  remove_timer(et);
+
+  /* Remove the next pointer from the item to be removed. */
+  et->next = NULL;
+  /* Set the timer as expired */
+  et->p = PROCESS_NONE;
+}
+/*---------------------------------------------------------------------------*/
+#else /* ETIMER_CONF_WHEEL */
+static struct etimer *timerlist;
+/*---------------------------------------------------------------------------*/
 static void
 update_time(void)
 {
@@ -175,27 +569,6 @@ add_timer(struct etimer *timer)
 }
 /*---------------------------------------------------------------------------*/
 void
-etimer_set(struct etimer *et, clock_time_t interval)
-{
-  timer_set(&et->timer, interval);
-  add_timer(et);
-}
-/*---------------------------------------------------------------------------*/
-void
-etimer_reset(struct etimer *et)
-{
-  timer_reset(&et->timer);
-  add_timer(et);
-}
-/*---------------------------------------------------------------------------*/
-void
-etimer_restart(struct etimer *et)
-{
-  timer_restart(&et->timer);
-  add_timer(et);
-}
-/*---------------------------------------------------------------------------*/
-void
 etimer_adjust(struct etimer *et, int timediff)
 {
   et->timer.start += timediff;
@@ -203,24 +576,6 @@ etimer_adjust(struct etimer *et, int timediff)
 }
 /*---------------------------------------------------------------------------*/
 int
-etimer_expired(struct etimer *et)
-{
-  return et->p == PROCESS_NONE;
-}
-/*---------------------------------------------------------------------------*/
-clock_time_t
-etimer_expiration_time(struct etimer *et)
-{
-  return et->timer.start + et->timer.interval;
-}
-/*---------------------------------------------------------------------------*/
-clock_time_t
-etimer_start_time(struct etimer *et)
-{
-  return et->timer.start;
-}
-/*---------------------------------------------------------------------------*/
-int
 etimer_pending(void)
 {
   return timerlist != NULL;
@@ -262,4 +617,61 @@ etimer_stop(struct etimer *et)
   et->p = PROCESS_NONE;
 }
 /*---------------------------------------------------------------------------*/
+#endif /* ETIMER_CONF_WHEEL */
+/*---------------------------------------------------------------------------*/
+void
+etimer_set(struct etimer *et, clock_time_t interval)
+{
+  timer_set(&et->timer, interval);
+  add_timer(et);
+}
+/*---------------------------------------------------------------------------*/
+void
+etimer_reset(struct etimer *et)
+{
+  timer_reset(&et->timer);
+  add_timer(et);
+}
+/*---------------------------------------------------------------------------*/
+void
+etimer_restart(struct etimer *et)
+{
+  timer_restart(&et->timer);
+  add_timer(et);
+}
+/*---------------------------------------------------------------------------*/
+int
+etimer_expired(struct etimer *et)
+{
+  return et->p == PROCESS_NONE;
+}
+/*---------------------------------------------------------------------------*/
+clock_time_t
+etimer_expiration_time(struct etimer *et)
+{
+  return et->timer.start + et->timer.interval;
+}
+/*---------------------------------------------------------------------------*/
+clock_time_t
+etimer_start_time(struct etimer *et)
+{
+  return et->timer.start;
+}
+/*---------------------------------------------------------------------------*/
+clock_time_t
+etimer_sleep_ticks(clock_time_t max)
+{
+  clock_time_t left;
+
+  if(!etimer_pending()) {
+    return max;
+  }
+  left = etimer_next_expiration_time() - clock_time();
+  if(left > CLOCK_HALF) {
+    /* Expired, the poll is on its way */
+    return 0;
+  }
+  return left < max ? left : max;
+}
+/*---------------------------------------------------------------------------*/
 /** @} */
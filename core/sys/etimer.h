@@ -66,6 +66,28 @@
 #include "sys/timer.h"
 #include "sys/process.h"
 
+/*
+ * Pending timers are kept in a hierarchical timing wheel (set and stop
+ * only search the slot of the timer, expiry cost independent of the
+ * number of timers) unless ETIMER_CONF_WHEEL is 0, which selects the
+ * original unsorted list.
+ */
+#ifndef ETIMER_CONF_WHEEL
+#define ETIMER_CONF_WHEEL 1
+#endif /* ETIMER_CONF_WHEEL */
+
+/*
+ * Number of 16-slot levels of the wheel. Timers more than
+ * 16^ETIMER_WHEEL_LEVELS ticks away wait in a list that is looked at
+ * once per 16^ETIMER_WHEEL_LEVELS ticks. 16^ETIMER_WHEEL_LEVELS must
+ * fit in half the range of clock_time_t.
+ */
+#ifdef ETIMER_CONF_WHEEL_LEVELS
+#define ETIMER_WHEEL_LEVELS ETIMER_CONF_WHEEL_LEVELS
+#else
+#define ETIMER_WHEEL_LEVELS 3
+#endif /* ETIMER_CONF_WHEEL_LEVELS */
+
 /**
  * A timer.
  *
@@ -78,6 +100,9 @@ struct etimer {
   struct timer timer;
   struct etimer *next;
   struct process *p;
+#if ETIMER_CONF_WHEEL
+  unsigned char slot;
+#endif /* ETIMER_CONF_WHEEL */
 };
 
 /**
@@ -233,6 +258,19 @@ int etimer_pending(void);
  */
 clock_time_t etimer_next_expiration_time(void);
 
+/**
+ * \brief      Get the number of ticks the system may sleep.
+ * \param max  The longest sleep the caller can handle.
+ * \return     Ticks until the next event timer expires, at most max.
+ *             max if no event timer is pending, 0 if one has expired.
+ *
+ *             Tickless idle code uses this function to program the
+ *             next clock wakeup (see clock_idle_enter()). It must be
+ *             called when no events are pending, so that the etimer
+ *             process has seen every timer that was set.
+ */
+clock_time_t etimer_sleep_ticks(clock_time_t max);
+
 
 /** @} */
 
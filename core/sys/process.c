@@ -66,15 +66,61 @@ struct event_data {
   struct process *p;
 };
 
-static process_num_events_t nevents, fevent;
+/*
+ * One circular queue per lane. The high priority lane is always
+ * emptied first; nevents counts the events of both lanes.
+ */
+struct event_lane {
+  struct event_data *events;
+  process_num_events_t size, nevents, fevent;
+#if PROCESS_CONF_STATS
+  process_num_events_t maxevents;
+  unsigned short overflows;
+#endif
+};
+
+static process_num_events_t nevents;
 static struct event_data events[PROCESS_CONF_NUMEVENTS];
+#if PROCESS_CONF_HIGH_NUMEVENTS
+static struct event_data high_events[PROCESS_CONF_HIGH_NUMEVENTS];
+#endif
+
+static struct event_lane lanes[PROCESS_LANES] = {
+#if PROCESS_CONF_HIGH_NUMEVENTS
+  { high_events, PROCESS_CONF_HIGH_NUMEVENTS },
+#else
+  { NULL, 0 },
+#endif
+  { events, PROCESS_CONF_NUMEVENTS },
+};
 
 #if PROCESS_CONF_STATS
 process_num_events_t process_maxevents;
+
+/* Overflows per event type; the last slot counts all other types */
+static struct {
+  process_event_t ev;
+  unsigned short count;
+} overflows[PROCESS_CONF_OVERFLOW_TYPES + 1];
+static unsigned char noverflows;
 #endif
 
 static volatile unsigned char poll_requested;
 
+#if PROCESS_EXCLUSIVE_EVENTS > 0
+/*
+ * Broadcast subscriptions, hashed by event number so that a broadcast
+ * only looks at the subscriptions of its bucket.
+ */
+static struct process_subscription *subscriptions[PROCESS_SUBSCRIBE_BUCKETS];
+
+#define SUBSCRIBE_BUCKET(ev) ((ev) & (PROCESS_SUBSCRIBE_BUCKETS - 1))
+
+/* Events whose broadcasts go only to their subscribers. */
+static process_event_t exclusive_events[PROCESS_EXCLUSIVE_EVENTS];
+static unsigned char nexclusive;
+#endif /* PROCESS_EXCLUSIVE_EVENTS > 0 */
+
 #define PROCESS_STATE_NONE        0
 #define PROCESS_STATE_RUNNING     1
 #define PROCESS_STATE_CALLED      2
@@ -97,6 +143,65 @@ process_alloc_event(void)
 }
 /*---------------------------------------------------------------------------*/
 void
+process_unsubscribe(struct process_subscription *s)
+{
+#if PROCESS_EXCLUSIVE_EVENTS > 0
+  struct process_subscription **sp;
+
+  for(sp = &subscriptions[SUBSCRIBE_BUCKET(s->ev)]; *sp != NULL;
+      sp = &(*sp)->next) {
+    if(*sp == s) {
+      *sp = s->next;
+      break;
+    }
+  }
+#endif /* PROCESS_EXCLUSIVE_EVENTS > 0 */
+}
+/*---------------------------------------------------------------------------*/
+void
+process_subscribe(struct process_subscription *s, struct process *p,
+                  process_event_t ev)
+{
+#if PROCESS_EXCLUSIVE_EVENTS > 0
+  struct process_subscription **sp;
+
+  process_unsubscribe(s);
+  s->p = p;
+  s->ev = ev;
+  s->next = NULL;
+  /* Append, so that subscribers are called in subscription order. */
+  for(sp = &subscriptions[SUBSCRIBE_BUCKET(ev)]; *sp != NULL;
+      sp = &(*sp)->next);
+  *sp = s;
+#endif /* PROCESS_EXCLUSIVE_EVENTS > 0 */
+}
+/*---------------------------------------------------------------------------*/
+int
+process_set_exclusive(process_event_t ev, int exclusive)
+{
+#if PROCESS_EXCLUSIVE_EVENTS > 0
+  unsigned char i;
+
+  for(i = 0; i < nexclusive && exclusive_events[i] != ev; i++);
+  if(!exclusive) {
+    if(i < nexclusive) {
+      exclusive_events[i] = exclusive_events[--nexclusive];
+    }
+    return 0;
+  }
+  if(i == nexclusive) {
+    if(nexclusive == PROCESS_EXCLUSIVE_EVENTS) {
+      return -1;
+    }
+    exclusive_events[nexclusive++] = ev;
+  }
+  return 0;
+#else /* PROCESS_EXCLUSIVE_EVENTS > 0 */
+  return exclusive ? -1 : 0;
+#endif /* PROCESS_EXCLUSIVE_EVENTS > 0 */
+}
+/*---------------------------------------------------------------------------*/
+void
 process_start(struct process *p, const char *arg)
 {
   struct process *q;
@@ -126,6 +231,10 @@ exit_process(struct process *p, struct process *fromprocess)
 {
   register struct process *q;
   struct process *old_current = process_current;
+#if PROCESS_EXCLUSIVE_EVENTS > 0
+  struct process_subscription **sp;
+  unsigned char i;
+#endif /* PROCESS_EXCLUSIVE_EVENTS > 0 */
 
   PRINTF("process: exit_process '%s'\n", PROCESS_NAME_STRING(p));
 
@@ -140,6 +249,19 @@ exit_process(struct process *p, struct process *fromprocess)
     /* Process was running */
     p->state = PROCESS_STATE_NONE;
 
+#if PROCESS_EXCLUSIVE_EVENTS > 0
+    /* Drop its broadcast subscriptions. */
+    for(i = 0; i < PROCESS_SUBSCRIBE_BUCKETS; i++) {
+      for(sp = &subscriptions[i]; *sp != NULL;) {
+	if((*sp)->p == p) {
+	  *sp = (*sp)->next;
+	} else {
+	  sp = &(*sp)->next;
+	}
+      }
+    }
+#endif /* PROCESS_EXCLUSIVE_EVENTS > 0 */
+
     /*
      * Post a synchronous event to all processes to inform them that
      * this process is about to exit. This will allow services to
@@ -208,11 +330,22 @@ process_exit(struct process *p)
 void
 process_init(void)
 {
+  unsigned char i;
+
   lastevent = PROCESS_EVENT_MAX;
 
-  nevents = fevent = 0;
+  nevents = 0;
+  for(i = 0; i < PROCESS_LANES; i++) {
+    lanes[i].nevents = lanes[i].fevent = 0;
+  }
+#if PROCESS_EXCLUSIVE_EVENTS > 0
+  for(i = 0; i < PROCESS_SUBSCRIBE_BUCKETS; i++) {
+    subscriptions[i] = NULL;
+  }
+  nexclusive = 0;
+#endif /* PROCESS_EXCLUSIVE_EVENTS > 0 */
 #if PROCESS_CONF_STATS
-  process_maxevents = 0;
+  process_stats_reset();
 #endif /* PROCESS_CONF_STATS */
 
   process_current = process_list = NULL;
@@ -250,6 +383,11 @@ do_event(void)
   static process_data_t data;
   static struct process *receiver;
   static struct process *p;
+  static struct event_lane *l;
+#if PROCESS_EXCLUSIVE_EVENTS > 0
+  static struct process_subscription *s, *next;
+  static unsigned char i;
+#endif /* PROCESS_EXCLUSIVE_EVENTS > 0 */
   
   /*
    * If there are any events in the queue, take the first one and walk
@@ -260,20 +398,51 @@ do_event(void)
    */
 
   if(nevents > 0) {
+
+    /* Take from the high priority lane first. */
+    l = &lanes[PROCESS_LANE_HIGH];
+    if(l->nevents == 0) {
+      l = &lanes[PROCESS_LANE_NORMAL];
+    }
     
     /* There are events that we should deliver. */
-    ev = events[fevent].ev;
+    ev = l->events[l->fevent].ev;
     
-    data = events[fevent].data;
-    receiver = events[fevent].p;
+    data = l->events[l->fevent].data;
+    receiver = l->events[l->fevent].p;
 
     /* Since we have seen the new event, we move pointer upwards
        and decrese the number of events. */
-    fevent = (fevent + 1) % PROCESS_CONF_NUMEVENTS;
+    l->fevent = (l->fevent + 1) % l->size;
+    --l->nevents;
     --nevents;
 
     /* If this is a broadcast event, we deliver it to all events, in
        order of their priority. */
+#if PROCESS_EXCLUSIVE_EVENTS > 0
+    s = NULL;
+    if(receiver == PROCESS_BROADCAST) {
+      for(i = 0; i < nexclusive && exclusive_events[i] != ev; i++);
+      if(i < nexclusive) {
+	for(s = subscriptions[SUBSCRIBE_BUCKET(ev)];
+	    s != NULL && s->ev != ev; s = s->next);
+      }
+    }
+    if(receiver == PROCESS_BROADCAST && s != NULL) {
+      /* The event is exclusive and has subscribers: deliver it only to
+	 them, without walking the process list. */
+      for(; s != NULL; s = next) {
+	next = s->next;
+	if(s->ev != ev) {
+	  continue;
+	}
+	if(poll_requested) {
+	  do_poll();
+	}
+	call_process(s->p, ev, data);
+      }
+    } else
+#endif /* PROCESS_EXCLUSIVE_EVENTS > 0 */
     if(receiver == PROCESS_BROADCAST) {
       for(p = process_list; p != NULL; p = p->next) {
 
@@ -319,8 +488,32 @@ process_nevents(void)
   return nevents + poll_requested;
 }
 /*---------------------------------------------------------------------------*/
-int
-process_post(struct process *p, process_event_t ev, process_data_t data)
+#if PROCESS_CONF_STATS
+static void
+count_overflow(struct event_lane *l, process_event_t ev)
+{
+  unsigned char i;
+
+  if(l->overflows < 0xffff) {
+    l->overflows++;
+  }
+  for(i = 0; i < noverflows && overflows[i].ev != ev; i++);
+  if(i == noverflows) {
+    if(noverflows < PROCESS_CONF_OVERFLOW_TYPES) {
+      overflows[noverflows++].ev = ev;
+    } else {
+      i = PROCESS_CONF_OVERFLOW_TYPES;
+    }
+  }
+  if(overflows[i].count < 0xffff) {
+    overflows[i].count++;
+  }
+}
+#endif /* PROCESS_CONF_STATS */
+/*---------------------------------------------------------------------------*/
+static int
+post(struct event_lane *l, struct process *p, process_event_t ev,
+     process_data_t data)
 {
   static process_num_events_t snum;
 
@@ -333,7 +526,7 @@ process_post(struct process *p, process_event_t ev, process_data_t data)
 	   p == PROCESS_BROADCAST? "<broadcast>": PROCESS_NAME_STRING(p), nevents);
   }
   
-  if(nevents == PROCESS_CONF_NUMEVENTS) {
+  if(l->nevents == l->size) {
 #if DEBUG
     if(p == PROCESS_BROADCAST) {
       printf("soft panic: event queue is full when broadcast event %d was posted from %s\n", ev, PROCESS_NAME_STRING(process_current));
@@ -341,16 +534,23 @@ process_post(struct process *p, process_event_t ev, process_data_t data)
       printf("soft panic: event queue is full when event %d was posted to %s frpm %s\n", ev, PROCESS_NAME_STRING(p), PROCESS_NAME_STRING(process_current));
     }
 #endif /* DEBUG */
+#if PROCESS_CONF_STATS
+    count_overflow(l, ev);
+#endif /* PROCESS_CONF_STATS */
     return PROCESS_ERR_FULL;
   }
   
-  snum = (process_num_events_t)(fevent + nevents) % PROCESS_CONF_NUMEVENTS;
-  events[snum].ev = ev;
-  events[snum].data = data;
-  events[snum].p = p;
+  snum = (process_num_events_t)(l->fevent + l->nevents) % l->size;
+  l->events[snum].ev = ev;
+  l->events[snum].data = data;
+  l->events[snum].p = p;
+  ++l->nevents;
   ++nevents;
 
 #if PROCESS_CONF_STATS
+  if(l->nevents > l->maxevents) {
+    l->maxevents = l->nevents;
+  }
   if(nevents > process_maxevents) {
     process_maxevents = nevents;
   }
@@ -359,6 +559,22 @@ process_post(struct process *p, process_event_t ev, process_data_t data)
   return PROCESS_ERR_OK;
 }
 /*---------------------------------------------------------------------------*/
+int
+process_post(struct process *p, process_event_t ev, process_data_t data)
+{
+  return post(&lanes[PROCESS_LANE_NORMAL], p, ev, data);
+}
+/*---------------------------------------------------------------------------*/
+int
+process_post_high(struct process *p, process_event_t ev, process_data_t data)
+{
+#if PROCESS_CONF_HIGH_NUMEVENTS
+  return post(&lanes[PROCESS_LANE_HIGH], p, ev, data);
+#else
+  return post(&lanes[PROCESS_LANE_NORMAL], p, ev, data);
+#endif
+}
+/*---------------------------------------------------------------------------*/
 void
 process_post_synch(struct process *p, process_event_t ev, process_data_t data)
 {
@@ -386,4 +602,47 @@ process_is_running(struct process *p)
   return p->state != PROCESS_STATE_NONE;
 }
 /*---------------------------------------------------------------------------*/
+#if PROCESS_CONF_STATS
+void
+process_lane_stats(unsigned char lane, struct process_lane_stats *s)
+{
+  struct event_lane *l = &lanes[lane];
+
+  s->size = l->size;
+  s->nevents = l->nevents;
+  s->maxevents = l->maxevents;
+  s->overflows = l->overflows;
+}
+/*---------------------------------------------------------------------------*/
+unsigned short
+process_overflows(process_event_t ev)
+{
+  unsigned char i;
+
+  for(i = 0; i < noverflows; i++) {
+    if(overflows[i].ev == ev) {
+      return overflows[i].count;
+    }
+  }
+  return ev == PROCESS_EVENT_NONE ?
+    overflows[PROCESS_CONF_OVERFLOW_TYPES].count : 0;
+}
+/*---------------------------------------------------------------------------*/
+void
+process_stats_reset(void)
+{
+  unsigned char i;
+
+  process_maxevents = nevents;
+  for(i = 0; i < PROCESS_LANES; i++) {
+    lanes[i].maxevents = lanes[i].nevents;
+    lanes[i].overflows = 0;
+  }
+  for(i = 0; i <= PROCESS_CONF_OVERFLOW_TYPES; i++) {
+    overflows[i].count = 0;
+  }
+  noverflows = 0;
+}
+#endif /* PROCESS_CONF_STATS */
+/*---------------------------------------------------------------------------*/
 /** @} */
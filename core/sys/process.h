@@ -89,6 +89,54 @@ typedef unsigned char process_num_events_t;
 #define PROCESS_CONF_NUMEVENTS 32
 #endif /* PROCESS_CONF_NUMEVENTS */
 
+/*
+ * Size of the high priority event queue used by process_post_high().
+ * Zero (the default) disables it: process_post_high() then posts to
+ * the normal queue.
+ */
+#ifndef PROCESS_CONF_HIGH_NUMEVENTS
+#define PROCESS_CONF_HIGH_NUMEVENTS 0
+#endif /* PROCESS_CONF_HIGH_NUMEVENTS */
+
+/*
+ * Number of event types whose queue overflows are counted separately
+ * when PROCESS_CONF_STATS is set, see process_overflows().
+ */
+#ifndef PROCESS_CONF_OVERFLOW_TYPES
+#define PROCESS_CONF_OVERFLOW_TYPES 4
+#endif /* PROCESS_CONF_OVERFLOW_TYPES */
+
+/*
+ * Number of hash buckets for broadcast subscriptions (power of 2), see
+ * process_subscribe(). Unused when PROCESS_EXCLUSIVE_EVENTS is 0.
+ */
+#ifdef PROCESS_CONF_SUBSCRIBE_BUCKETS
+#define PROCESS_SUBSCRIBE_BUCKETS PROCESS_CONF_SUBSCRIBE_BUCKETS
+#else
+#define PROCESS_SUBSCRIBE_BUCKETS 4
+#endif /* PROCESS_CONF_SUBSCRIBE_BUCKETS */
+
+/*
+ * Number of events that can be made exclusive to their subscribers, see
+ * process_set_exclusive(). 0 (the default) leaves out the subscription
+ * table: process_subscribe() does nothing and every broadcast goes to
+ * all processes.
+ */
+#ifdef PROCESS_CONF_EXCLUSIVE_EVENTS
+#define PROCESS_EXCLUSIVE_EVENTS PROCESS_CONF_EXCLUSIVE_EVENTS
+#else
+#define PROCESS_EXCLUSIVE_EVENTS 0
+#endif /* PROCESS_CONF_EXCLUSIVE_EVENTS */
+
+/**
+ * \name Event queues (lanes)
+ * @{
+ */
+#define PROCESS_LANE_HIGH     0 /**< Driver events, see process_post_high() */
+#define PROCESS_LANE_NORMAL   1 /**< Everything posted with process_post() */
+#define PROCESS_LANES         2
+/* @} */
+
 #define PROCESS_EVENT_NONE            0x80
 #define PROCESS_EVENT_INIT            0x81
 #define PROCESS_EVENT_POLL            0x82
@@ -365,6 +413,24 @@ CCIF void process_start(struct process *p, const char *arg);
  */
 CCIF int process_post(struct process *p, process_event_t ev, void* data);
 
+/**
+ * Post an asynchronous event ahead of the normal queue.
+ *
+ * Same as process_post(), but the event goes to a separate, high
+ * priority queue that the scheduler always empties before taking an
+ * event from the normal queue. Meant for drivers handing over input
+ * (e.g. a received line) whose latency should not depend on how many
+ * application events are pending.
+ *
+ * Events keep their order within a queue, but a high priority event
+ * can be delivered before normal events posted earlier. There is no
+ * fallback to the normal queue: a full high priority queue returns
+ * PROCESS_ERR_FULL.
+ *
+ * Without PROCESS_CONF_HIGH_NUMEVENTS this is process_post().
+ */
+CCIF int process_post_high(struct process *p, process_event_t ev, void* data);
+
 /**
  * Post a synchronous event to a process.
  *
@@ -453,6 +519,56 @@ process_current = p
  */
 CCIF process_event_t process_alloc_event(void);
 
+/**
+ * A process' interest in a broadcast event, see process_subscribe().
+ * Owned by the caller, typically a static variable of the subscriber.
+ */
+struct process_subscription {
+  struct process_subscription *next;
+  struct process *p;
+  process_event_t ev;
+};
+
+/**
+ * \brief      Subscribe a process to a broadcast event
+ * \param s    Subscription placeholder, must stay valid until it is
+ *             removed
+ * \param p    The process that will receive the event
+ * \param ev   The event number
+ *
+ *             Subscriptions only matter for events made exclusive with
+ *             process_set_exclusive(). A broadcast of such an event
+ *             that has at least one subscriber is delivered only to its
+ *             subscribers, in the order they subscribed, instead of to
+ *             every process in the process list. Broadcasts of other
+ *             events are delivered to all processes as before.
+ *
+ *             Subscriptions are removed with process_unsubscribe() or
+ *             when the process exits. Subscribing s again moves it.
+ *             Without PROCESS_CONF_EXCLUSIVE_EVENTS this does nothing.
+ */
+CCIF void process_subscribe(struct process_subscription *s,
+                            struct process *p, process_event_t ev);
+
+/**
+ * \brief      Remove a subscription made with process_subscribe()
+ * \param s    The subscription
+ */
+CCIF void process_unsubscribe(struct process_subscription *s);
+
+/**
+ * \brief      Deliver the broadcasts of an event only to its subscribers
+ * \param ev   The event number
+ * \param exclusive Non-zero to make the event exclusive, zero to undo it
+ * \return     0, or -1 if PROCESS_CONF_EXCLUSIVE_EVENTS events are
+ *             exclusive already (always, when it is 0)
+ *
+ *             No event is exclusive by default. Make an event exclusive
+ *             only when every process that waits for it subscribes to
+ *             it: the others no longer get its broadcasts.
+ */
+CCIF int process_set_exclusive(process_event_t ev, int exclusive);
+
 /** @} */
 
 /**
@@ -520,6 +636,43 @@ CCIF int process_is_running(struct process *p);
  */
 int process_nevents(void);
 
+#if PROCESS_CONF_STATS
+/**
+ * Statistics of one event queue.
+ */
+struct process_lane_stats {
+  process_num_events_t size;      /**< Queue size */
+  process_num_events_t nevents;   /**< Events waiting now */
+  process_num_events_t maxevents; /**< High-water mark */
+  unsigned short overflows;       /**< Posts that failed, queue full */
+};
+
+/**
+ * Get the statistics of an event queue.
+ *
+ * \param lane PROCESS_LANE_HIGH or PROCESS_LANE_NORMAL.
+ * \param s Filled in with the statistics of the queue.
+ */
+void process_lane_stats(unsigned char lane, struct process_lane_stats *s);
+
+/**
+ * Number of posts of an event type that failed with PROCESS_ERR_FULL.
+ *
+ * The first PROCESS_CONF_OVERFLOW_TYPES event types that overflow are
+ * counted separately; later ones are added up under
+ * PROCESS_EVENT_NONE.
+ *
+ * \param ev The event type, or PROCESS_EVENT_NONE for the others.
+ * \return The number of overflows, saturating at 0xffff.
+ */
+unsigned short process_overflows(process_event_t ev);
+
+/**
+ * Clear the high-water marks and overflow counters.
+ */
+void process_stats_reset(void);
+#endif /* PROCESS_CONF_STATS */
+
 /** @} */
 
 CCIF extern struct process *process_list;
@@ -222,6 +222,18 @@
 
 #define AVR_OUTPUT_COMPARE_INT TIMER0_COMPA_vect
 
+/*
+ * Tickless idle: with prescale 1024 a tick takes a quarter of the counts,
+ * so one compare period can span 256/AVR_TICKLESS_COUNTS ticks. Only
+ * available when a tick is a whole number of counts at both prescales.
+ */
+#if (F_CPU/256UL/CLOCK_CONF_SECOND) % 4 == 0
+#define AVR_TICKLESS_COUNTS (F_CPU/256UL/CLOCK_CONF_SECOND/4)
+#define AVR_TICKLESS_SCALE  4
+#define AVR_CLOCK_TCCR0B    _BV(CS02)
+#define AVR_TICKLESS_TCCR0B (_BV(CS02) | _BV(CS00))
+#endif
+
 #elif defined (__AVR_ATmega8515__) || defined (__AVR_ATmega16__) || defined (__AVR_ATmega32__)
 
 #define AVR_OUTPUT_COMPARE_INT TIMER0_COMP_vect
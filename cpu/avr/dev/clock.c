@@ -72,7 +72,7 @@
 #include <avr/interrupt.h>
 
 /* Two tick counters avoid a software divide when CLOCK_SECOND is not a power of two. */
-#if CLOCK_SECOND && (CLOCK_SECOND - 1)
+#if CLOCK_SECOND & (CLOCK_SECOND - 1)
 #define TWO_COUNTERS 1
 #endif
 
@@ -108,6 +108,24 @@ extern volatile uint8_t rf230_calibrate;
 static uint8_t calibrate_interval;
 #endif
 
+/* Tickless idle (CLOCK_CONF_TICKLESS): while the system sleeps, the timer
+ * runs at a slower prescale and its compare period spans several ticks,
+ * up to the next etimer. clock-avr.h says whether the MCU supports it.
+ */
+#if CLOCK_TICKLESS && defined(AVR_TICKLESS_COUNTS)
+#define TICKLESS 1
+/* Longest compare period, in ticks */
+#define TICKLESS_MAX (256 / AVR_TICKLESS_COUNTS)
+/* Ticks per compare period while idle, 0 while ticking */
+static volatile uint8_t idle_step;
+/* Ticks left to the next etimer */
+static volatile clock_time_t idle_left;
+/* Counts of the faster prescale that the slower one can not hold */
+static uint8_t idle_phase;
+#elif CLOCK_TICKLESS
+#warning "Tickless idle is not supported with this MCU and clock rate"
+#endif
+
 /*---------------------------------------------------------------------------*/
 /**
  * Start the clock by enabling the timer comparison interrupts. 
@@ -289,9 +307,13 @@ void
 clock_adjust_ticks(clock_time_t howmany)
 {
   uint8_t sreg = SREG;cli();
-  count  += howmany;
 #if TWO_COUNTERS
+  count  += howmany;
   howmany+= scount;
+#else
+  /* Count the ticks already in the current second too */
+  howmany+= count % CLOCK_SECOND;
+  count  += howmany - count % CLOCK_SECOND;
 #endif
   while(howmany >= CLOCK_SECOND) {
     howmany -= CLOCK_SECOND;
@@ -307,6 +329,84 @@ clock_adjust_ticks(clock_time_t howmany)
   SREG=sreg;
 }
 /*---------------------------------------------------------------------------*/
+#if TICKLESS
+/**
+ * Stop the periodic tick until the next etimer expires.
+ *
+ * Called by the main loop with interrupts disabled and no events pending.
+ * The clock keeps running at the slower prescale; the compare interrupt
+ * advances it by a whole period and only polls the etimer process when
+ * the next etimer is due.
+ */
+void
+clock_idle_enter(void)
+{
+  clock_time_t ticks;
+  uint8_t tcnt;
+
+  ticks = etimer_sleep_ticks(~(clock_time_t)0 >> 1);
+  if(ticks < 2) {
+    /* Due now or at the next tick anyway */
+    return;
+  }
+  TCCR0B = 0;
+  if(TIFR0 & _BV(OCF0A)) {
+    /* Let the pending tick in first */
+    TCCR0B = AVR_CLOCK_TCCR0B;
+    return;
+  }
+  tcnt = TCNT0;
+  idle_phase = tcnt % AVR_TICKLESS_SCALE;
+  idle_left = ticks;
+  idle_step = ticks < TICKLESS_MAX ? ticks : TICKLESS_MAX;
+  /* The tick in progress goes on at the slower prescale */
+  TCNT0 = tcnt / AVR_TICKLESS_SCALE;
+  OCR0A = idle_step * AVR_TICKLESS_COUNTS - 1;
+  TCCR0B = AVR_TICKLESS_TCCR0B;
+}
+/*---------------------------------------------------------------------------*/
+/**
+ * Go back to the periodic tick after a tickless sleep.
+ *
+ * Called by the main loop with interrupts disabled. Adds the whole ticks
+ * of the period in progress to the clock and keeps the rest as the phase
+ * of the next tick.
+ */
+void
+clock_idle_exit(void)
+{
+  uint8_t tcnt;
+
+  if(idle_step == 0) {
+    return;
+  }
+  TCCR0B = 0;
+  tcnt = TCNT0;
+  if(TIFR0 & _BV(OCF0A)) {
+    /* The period ended with interrupts disabled */
+    TIFR0 = _BV(OCF0A);
+    clock_adjust_ticks(idle_step);
+  }
+  clock_adjust_ticks(tcnt / AVR_TICKLESS_COUNTS);
+  OCR0A = AVR_TICKLESS_COUNTS * AVR_TICKLESS_SCALE - 1;
+  tcnt = (tcnt % AVR_TICKLESS_COUNTS) * AVR_TICKLESS_SCALE + idle_phase;
+  /* Writing TCNT0 blocks a compare match on the next count */
+  TCNT0 = tcnt < OCR0A ? tcnt : OCR0A - 1;
+  idle_step = 0;
+  TCCR0B = AVR_CLOCK_TCCR0B;
+}
+#else /* TICKLESS */
+void
+clock_idle_enter(void)
+{
+}
+/*---------------------------------------------------------------------------*/
+void
+clock_idle_exit(void)
+{
+}
+#endif /* TICKLESS */
+/*---------------------------------------------------------------------------*/
 /* This it the timer comparison match interrupt.
  * It maintains the tick counter, clock_seconds, and etimer updates.
  *
@@ -325,6 +425,23 @@ void AVR_OUTPUT_COMPARE_INT(void);
 #else
 ISR(AVR_OUTPUT_COMPARE_INT)
 {
+#if TICKLESS
+  if(idle_step) {
+    /* A tickless period: no per tick work while the system sleeps */
+    clock_adjust_ticks(idle_step);
+    if(idle_left > idle_step) {
+      idle_left -= idle_step;
+      if(idle_left < idle_step) {
+        idle_step = idle_left;
+        OCR0A = idle_step * AVR_TICKLESS_COUNTS - 1;
+      }
+    } else {
+      idle_left = 0;
+      etimer_request_poll();
+    }
+    return;
+  }
+#endif /* TICKLESS */
     count++;
 #if TWO_COUNTERS
   if(++scount >= CLOCK_SECOND) {
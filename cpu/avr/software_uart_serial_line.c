@@ -5,24 +5,224 @@
 #include <avr/io.h>
 #include <util/delay.h>
 #include <avr/interrupt.h>
-#include "serial-line.h"
+#include <avr/pgmspace.h>
+#include <string.h>
 #include "software_uart_serial_line.h"
 
+#if (SOFT_UART_TX_BUFFER_SIZE & (SOFT_UART_TX_BUFFER_SIZE - 1)) != 0
+#error SOFT_UART_TX_BUFFER_SIZE deve ser potencia de dois.
+#endif
+
+// Motor full-duplex: TIMER1 roda livre (modo normal, sem prescaler) e é a
+// única base de tempo. Cada direção tem seu slot de bit: RX no compare A e
+// TX no compare B. Cada canal agenda o próximo slot somando um período ao
+// seu OCR1x, então uma ISR atrasada pela outra não acumula erro de fase.
+
 // Estado de recepção
 typedef enum {
     RX_IDLE, RX_START_BIT, RX_DATA_BITS, RX_STOP_BIT_WAIT
 } rx_state_t;
 
-static volatile rx_state_t rx_current_state = RX_IDLE;
-static volatile uint8_t rx_data_buffer;
-static volatile uint8_t rx_bit_index;
+// Variáveis tocadas só dentro das ISRs de bit não são volatile: a 38400
+// baud cada load/store extra pesa no orçamento do slot.
+static volatile uint8_t rx_current_state = RX_IDLE;
+static uint8_t rx_data_buffer;
+static uint8_t rx_bit_index;
+
+// Pool de linhas: a ISR monta cada linha direto em um slot e o processo
+// entrega o ponteiro do slot em soft_uart_line_event. Não há anel de bytes
+// nem cópia para o buffer do serial-line.
+#define SLOT_FREE   0
+#define SLOT_READY  1
+
+#define LINE_START  0  // próximo byte abre uma linha
+#define LINE_FILL   1  // gravando em lines[fill_idx]
+#define LINE_DROP   2  // sem slot livre: descarta até o LF
 
-// Buffer circular de recepção
-static volatile uint8_t rx_buffer[SOFT_UART_RX_BUFFER_SIZE];
-static volatile uint8_t rx_head = 0;
-static volatile uint8_t rx_tail = 0;
+static struct soft_uart_line lines[SOFT_UART_LINE_SLOTS];
+static volatile uint8_t line_state[SOFT_UART_LINE_SLOTS];
+static uint8_t fill_idx;      // só na ISR
+static uint16_t fill_len;     // só na ISR
+static uint8_t fill_mode = LINE_START;
+static uint8_t deliver_idx;   // só no processo
 volatile uint8_t soft_uart_rx_overflow = 0;
 
+#if SOFT_UART_CONF_HEX_LINES
+// Decodificador das linhas "<porta>:<hex>", só na ISR
+#define HEX_OFF     0  // linha de texto
+#define HEX_PORT    1  // ainda nos dígitos da porta
+#define HEX_HIGH    2  // depois do ':': o próximo dígito é o nibble alto
+#define HEX_LOW     3  // nibble alto guardado em fill_nibble
+static uint8_t fill_hex;
+static uint8_t fill_nibble;
+#endif
+
+// Buffer circular de transmissão: head escrito pelo processo, tail pela ISR
+static volatile uint8_t tx_buffer[SOFT_UART_TX_BUFFER_SIZE];
+static volatile uint8_t tx_head = 0;
+static volatile uint8_t tx_tail = 0;
+
+// Estado de transmissão: tx_bit 0 = start, 1..8 = dados, 9 = stop
+static volatile uint8_t tx_active = 0;
+static uint8_t tx_shift;
+static uint8_t tx_bit;
+static struct process *volatile tx_notify = NULL;
+
+// Fluxo hex sem cópia: a ISR lê direto do buffer do chamador
+static const uint8_t *tx_hex;
+static volatile uint16_t tx_hex_left;     // nibbles restantes
+static const char *volatile tx_suffix;
+// Posição do anel em que o fluxo entra: os bytes escritos no anel depois
+// de soft_uart_write_hex() esperam o fluxo e o sufixo terminarem
+static uint8_t tx_hex_at;
+
+static const char hex_digits[16] PROGMEM = "0123456789ABCDEF";
+
+process_event_t soft_uart_tx_done_event;
+process_event_t soft_uart_line_event;
+
+PROCESS(soft_uart_tx_process, "Soft UART TX");
+PROCESS(soft_uart_autobaud_process, "Soft UART autobaud");
+PROCESS(soft_uart_line_process, "Soft UART line");
+
+// Tabela de recargas do TIMER1 (ciclos por bit), calculada em tempo de
+// compilação. Só entram taxas que cabem no orçamento full-duplex.
+struct baud_entry {
+    uint32_t baud;
+    uint16_t cycles;
+};
+
+#define BAUD_ENTRY(b) { (b), (uint16_t)((F_CPU + (b) / 2) / (b)) }
+
+static const struct baud_entry baud_table[] PROGMEM = {
+#if F_CPU / 1200 <= 0xffff
+    BAUD_ENTRY(1200UL),
+#endif
+    BAUD_ENTRY(2400UL),
+    BAUD_ENTRY(4800UL),
+    BAUD_ENTRY(9600UL),
+#if F_CPU / 19200 >= SOFT_UART_MIN_CYCLES_PER_BIT
+    BAUD_ENTRY(19200UL),
+#endif
+#if F_CPU / 38400 >= SOFT_UART_MIN_CYCLES_PER_BIT
+    BAUD_ENTRY(38400UL),
+#endif
+};
+
+#define BAUD_TABLE_LEN (sizeof(baud_table) / sizeof(baud_table[0]))
+#define BAUD_AT(i) pgm_read_dword(&baud_table[i].baud)
+#define CYCLES_AT(i) pgm_read_word(&baud_table[i].cycles)
+
+// Recargas em uso pelas ISRs; só mudam com RX e TX parados
+static uint16_t cycles_per_bit = SOFT_UART_CYCLES_PER_BIT;
+static uint16_t cycles_half_bit = SOFT_UART_CYCLES_HALF_BIT;
+static uint32_t current_baud = SOFTWARE_UART_BAUD_RATE;
+
+// Autobaud: a ISR de PCINT só mede a menor distância entre bordas
+#define AUTOBAUD_EDGES 24
+static volatile uint8_t autobaud_edges;
+static volatile uint16_t autobaud_min;
+static uint16_t autobaud_last;
+static struct process *autobaud_client;
+static uint32_t autobaud_result;
+
+process_event_t soft_uart_autobaud_event;
+
+#if SOFT_UART_CONF_STATS
+static struct soft_uart_stats stats;
+#define STATS_ADD(x) (stats.x++)
+// Duração de cada ISR de bit medida pelo próprio TIMER1
+#define STATS_ISR_BEGIN() uint16_t isr_t0 = TCNT1
+#define STATS_ISR_END() do {                             \
+        uint16_t isr_dt = TCNT1 - isr_t0;                \
+        if(isr_dt > stats.isr_cycles_max) {              \
+            stats.isr_cycles_max = isr_dt;               \
+        }                                                \
+    } while(0)
+#else
+#define STATS_ADD(x)
+#define STATS_ISR_BEGIN()
+#define STATS_ISR_END()
+#endif
+
+#define TX_MASK (SOFT_UART_TX_BUFFER_SIZE - 1)
+
+/*---------------------------------------------------------------------------*/
+// Repassa a notificação de fim de transmissão para fora do contexto da ISR
+PROCESS_THREAD(soft_uart_tx_process, ev, data)
+{
+    struct process *p;
+
+    PROCESS_BEGIN();
+
+    while(1) {
+        PROCESS_YIELD_UNTIL(ev == PROCESS_EVENT_POLL);
+        p = tx_notify;
+        if(p != NULL && !tx_active) {
+            tx_notify = NULL;
+            process_post_high(p, soft_uart_tx_done_event, NULL);
+        }
+    }
+
+    PROCESS_END();
+}
+/*---------------------------------------------------------------------------*/
+// Próximo caractere a transmitir, na ordem em que foram escritos: o anel
+// até tx_hex_at, o fluxo hex de soft_uart_write_hex() (codificado aqui,
+// nibble a nibble), seu sufixo e então o resto do anel.
+// Chamado com interrupções desabilitadas.
+static uint8_t tx_fetch(void) {
+    uint8_t b;
+
+    if(tx_head != tx_tail &&
+       (tx_tail != tx_hex_at || (!tx_hex_left && tx_suffix == NULL))) {
+        tx_shift = tx_buffer[tx_tail];
+        tx_tail = (tx_tail + 1) & TX_MASK;
+        return 1;
+    }
+    if(tx_hex_left) {
+        b = *tx_hex;
+        if(tx_hex_left & 1) {
+            b &= 0x0f;
+            tx_hex++;
+        } else {
+            b >>= 4;
+        }
+        tx_hex_left--;
+        tx_shift = pgm_read_byte(&hex_digits[b]);
+        return 1;
+    }
+    if(tx_suffix != NULL) {
+        tx_shift = *tx_suffix++;
+        if(*tx_suffix == '\0') {
+            tx_suffix = NULL;
+        }
+        return 1;
+    }
+    return 0;
+}
+
+// Carrega o próximo caractere e coloca o start bit na linha.
+// Chamado com interrupções desabilitadas.
+static uint8_t tx_start_next(void) {
+    if(!tx_fetch()) {
+        return 0;
+    }
+    tx_bit = 0;
+    SOFT_UART_TX_LOW();
+    return 1;
+}
+
+// Inicia o slot de TX se ele estiver parado. Interrupções desabilitadas.
+static void tx_kick(void) {
+    if(!tx_active && tx_start_next()) {
+        tx_active = 1;
+        OCR1B = TCNT1 + cycles_per_bit;
+        TIFR1 = (1 << OCF1B);
+        TIMSK1 |= (1 << OCIE1B);
+    }
+}
+/*---------------------------------------------------------------------------*/
 void soft_uart_init(void) {
     DDRB &= ~(1 << SOFT_UART_RX_PIN_BIT);
     DDRB |= (1 << SOFT_UART_TX_PIN_BIT);
@@ -31,26 +231,96 @@ void soft_uart_init(void) {
     PCICR |= (1 << PCIE0);
     PCMSK0 |= (1 << PCINT3);
 
-    TCCR1B |= (1 << WGM12);
-    TCCR1B |= (1 << CS10);
-    TIMSK1 &= ~(1 << OCIE1A);
+    // Modo normal (contador livre), sem prescaler
+    TCCR1A = 0;
+    TCCR1B = (1 << CS10);
+    TIMSK1 &= ~((1 << OCIE1A) | (1 << OCIE1B));
+
+    if(soft_uart_tx_done_event == 0) {
+        soft_uart_tx_done_event = process_alloc_event();
+        soft_uart_autobaud_event = process_alloc_event();
+        soft_uart_line_event = process_alloc_event();
+        process_start(&soft_uart_tx_process, NULL);
+        process_start(&soft_uart_line_process, NULL);
+    }
 }
+/*---------------------------------------------------------------------------*/
+uint8_t soft_uart_write_async(const uint8_t *data, uint8_t len,
+                              struct process *p) {
+    uint8_t n = 0;
+    uint8_t next_head;
+    uint8_t sreg;
 
-void soft_uart_write_byte(uint8_t data) {
+    while(n < len) {
+        next_head = (tx_head + 1) & TX_MASK;
+        if(next_head == tx_tail) {
+            break;
+        }
+        tx_buffer[tx_head] = data[n++];
+        tx_head = next_head;
+    }
+
+    sreg = SREG;
     cli();
-    SOFT_UART_TX_LOW();
-    _delay_us(SOFT_UART_BIT_PERIOD_US);
+    if(p != NULL) {
+        tx_notify = p;
+    }
+    tx_kick();
+    SREG = sreg;
 
-    for(uint8_t i = 0; i < 8; i++) {
-        if(data & 0x01) SOFT_UART_TX_HIGH();
-        else SOFT_UART_TX_LOW();
-        _delay_us(SOFT_UART_BIT_PERIOD_US);
-        data >>= 1;
+    return n;
+}
+/*---------------------------------------------------------------------------*/
+int soft_uart_write_hex(const uint8_t *data, uint8_t len,
+                        const char *suffix, struct process *p) {
+    uint8_t sreg = SREG;
+
+    cli();
+    if(tx_hex_left || tx_suffix != NULL) {
+        SREG = sreg;
+        return -1;
+    }
+    tx_hex = data;
+    tx_hex_at = tx_head;
+    tx_hex_left = (uint16_t)len * 2;
+    tx_suffix = (suffix != NULL && *suffix != '\0') ? suffix : NULL;
+    if(p != NULL) {
+        tx_notify = p;
     }
+    tx_kick();
+    SREG = sreg;
 
-    SOFT_UART_TX_HIGH();
-    _delay_us(SOFT_UART_BIT_PERIOD_US);
-    sei();
+    return 0;
+}
+/*---------------------------------------------------------------------------*/
+uint8_t soft_uart_tx_busy(void) {
+    return tx_active || tx_head != tx_tail || tx_hex_left || tx_suffix != NULL;
+}
+/*---------------------------------------------------------------------------*/
+void soft_uart_get_stats(struct soft_uart_stats *s) {
+    uint8_t sreg = SREG;
+    cli();
+#if SOFT_UART_CONF_STATS
+    *s = stats;
+#else
+    memset(s, 0, sizeof(*s));
+#endif
+    SREG = sreg;
+    s->isr_cycles_budget = cycles_per_bit;
+}
+
+void soft_uart_reset_stats(void) {
+#if SOFT_UART_CONF_STATS
+    uint8_t sreg = SREG;
+    cli();
+    memset(&stats, 0, sizeof(stats));
+    SREG = sreg;
+#endif
+}
+/*---------------------------------------------------------------------------*/
+void soft_uart_write_byte(uint8_t data) {
+    // Só bloqueia enquanto o anel estiver cheio; a ISR continua esvaziando
+    while(soft_uart_write_async(&data, 1, NULL) == 0);
 }
 
 int soft_uart_write_string(const char *str) {
@@ -59,65 +329,374 @@ int soft_uart_write_string(const char *str) {
     return 0;
 }
 
-uint8_t soft_uart_read_buffer(void) {
-    if (rx_head == rx_tail) return 0;
-    uint8_t c = rx_buffer[rx_tail];
-    rx_tail = (rx_tail + 1) % SOFT_UART_RX_BUFFER_SIZE;
-    return c;
+/*---------------------------------------------------------------------------*/
+// Entrega as linhas prontas em ordem, uma por vez, como o serial-line faz
+// com as do console
+PROCESS_THREAD(soft_uart_line_process, ev, data)
+{
+    PROCESS_BEGIN();
+
+    while(1) {
+        PROCESS_YIELD_UNTIL(ev == PROCESS_EVENT_POLL);
+
+        while(line_state[deliver_idx] == SLOT_READY) {
+            process_post_high(PROCESS_BROADCAST, soft_uart_line_event,
+                              &lines[deliver_idx]);
+
+            // Espera todos tratarem a linha antes de devolver o slot à ISR
+            if(PROCESS_ERR_OK ==
+               process_post_high(PROCESS_CURRENT(), PROCESS_EVENT_CONTINUE, NULL)) {
+                PROCESS_WAIT_EVENT_UNTIL(ev == PROCESS_EVENT_CONTINUE);
+            }
+            line_state[deliver_idx] = SLOT_FREE;
+            deliver_idx = (deliver_idx + 1) % SOFT_UART_LINE_SLOTS;
+        }
+    }
+
+    PROCESS_END();
+}
+/*---------------------------------------------------------------------------*/
+#if SOFT_UART_CONF_HEX_LINES
+// Valor de um dígito hex, ou 0xff
+static inline uint8_t hex_value(uint8_t c) {
+    if(c >= '0' && c <= '9') {
+        return c - '0';
+    }
+    c |= 0x20;
+    if(c >= 'a' && c <= 'f') {
+        return c - 'a' + 10;
+    }
+    return 0xff;
+}
+#endif
+
+// Montagem da linha no contexto da ISR: CR é ignorado, LF fecha a linha e
+// linhas vazias (o "\r\n" antes de cada resposta AT) não geram evento.
+static inline void rx_line_byte(uint8_t c) {
+    struct soft_uart_line *l;
+#if SOFT_UART_CONF_HEX_LINES
+    uint8_t v;
+#endif
+
+    if(c == '\r') {
+        return;
+    }
+    if(fill_mode == LINE_START) {
+        if(c == '\n') {
+            return;
+        }
+        if(line_state[fill_idx] != SLOT_FREE) {
+            soft_uart_rx_overflow = 1;
+            STATS_ADD(overruns);
+            fill_mode = LINE_DROP;
+        } else {
+            fill_mode = LINE_FILL;
+            fill_len = 0;
+            lines[fill_idx].flags = 0;
+#if SOFT_UART_CONF_HEX_LINES
+            fill_hex = HEX_PORT;
+#endif
+        }
+    }
+
+    if(c == '\n') {
+        if(fill_mode == LINE_FILL) {
+            l = &lines[fill_idx];
+#if SOFT_UART_CONF_HEX_LINES
+            if(fill_hex == HEX_LOW) {
+                l->flags |= SOFT_UART_LINE_F_BAD_HEX;
+            }
+#endif
+            l->data[fill_len] = '\0';
+            l->len = fill_len;
+            line_state[fill_idx] = SLOT_READY;
+            fill_idx = (fill_idx + 1) % SOFT_UART_LINE_SLOTS;
+            process_poll(&soft_uart_line_process);
+        }
+        fill_mode = LINE_START;
+        return;
+    }
+
+    if(fill_mode != LINE_FILL) {
+        return;
+    }
+
+#if SOFT_UART_CONF_HEX_LINES
+    // Um nibble por caractere: o byte só é gravado no segundo dígito
+    switch(fill_hex) {
+        case HEX_PORT:
+            if(c == ':' && fill_len > 0) {
+                fill_hex = HEX_HIGH;
+                lines[fill_idx].flags |= SOFT_UART_LINE_F_HEX;
+            } else if(c < '0' || c > '9' || fill_len == 3) {
+                fill_hex = HEX_OFF;
+            }
+            break;
+
+        case HEX_HIGH:
+        case HEX_LOW:
+            if(c == ' ') {
+                return;
+            }
+            v = hex_value(c);
+            if(v == 0xff) {
+                // Não era hex: o resto da linha segue como texto
+                lines[fill_idx].flags |= SOFT_UART_LINE_F_BAD_HEX;
+                fill_hex = HEX_OFF;
+                break;
+            }
+            if(fill_hex == HEX_HIGH) {
+                fill_nibble = v << 4;
+                fill_hex = HEX_LOW;
+                return;
+            }
+            c = fill_nibble | v;
+            fill_hex = HEX_HIGH;
+            break;
+    }
+#endif
+
+    // Linha maior que o slot: trunca, marca e espera o LF
+    if(fill_len < SOFT_UART_LINE_SIZE - 1) {
+        lines[fill_idx].data[fill_len++] = c;
+    } else {
+        lines[fill_idx].flags |= SOFT_UART_LINE_F_TRUNCATED;
+    }
 }
+/*---------------------------------------------------------------------------*/
 
 ISR(PCINT0_vect) {
+    uint16_t now = TCNT1;
+
+    if(autobaud_edges) {
+        // Captura por software (o RX está em PB3, não no pino ICP1)
+        uint16_t width = now - autobaud_last;
+        if(autobaud_edges < AUTOBAUD_EDGES && width < autobaud_min &&
+           !((TIFR1 & (1 << TOV1)) && now >= autobaud_last)) {
+            autobaud_min = width;
+        }
+        TIFR1 = (1 << TOV1);
+        autobaud_last = now;
+        if(--autobaud_edges == 0) {
+            process_poll(&soft_uart_autobaud_process);
+        }
+        return;
+    }
+
     if (!SOFT_UART_RX_READ() && rx_current_state == RX_IDLE) {
         rx_current_state = RX_START_BIT;
         PCICR &= ~(1 << PCIE0);
-        OCR1A = SOFT_UART_CYCLES_PER_BIT + SOFT_UART_CYCLES_HALF_BIT;
-        TCNT1 = 0;
+        // Primeira amostra no meio do start bit, descontando a latência
+        OCR1A = now + cycles_half_bit - SOFT_UART_RX_LATENCY_CYCLES;
+        TIFR1 = (1 << OCF1A);
         TIMSK1 |= (1 << OCIE1A);
     }
 }
 
+// Volta a escutar bordas. O flag de PCINT é limpo antes de reabilitar para
+// descartar as bordas dos bits de dados já consumidos.
+static inline void rx_rearm(void) {
+    rx_current_state = RX_IDLE;
+    TIMSK1 &= ~(1 << OCIE1A);
+    PCIFR = (1 << PCIF0);
+    PCICR |= (1 << PCIE0);
+}
+
+/*---------------------------------------------------------------------------*/
+int soft_uart_set_baud(uint32_t baud) {
+    uint8_t i;
+    uint8_t sreg;
+
+    for(i = 0; i < BAUD_TABLE_LEN; i++) {
+        if(BAUD_AT(i) == baud) {
+            break;
+        }
+    }
+    if(i == BAUD_TABLE_LEN) {
+        return -1;
+    }
+
+    // Termina o que já está no anel na taxa antiga
+    while(soft_uart_tx_busy());
+
+    sreg = SREG;
+    cli();
+    cycles_per_bit = CYCLES_AT(i);
+    cycles_half_bit = cycles_per_bit / 2;
+    current_baud = baud;
+    if(rx_current_state != RX_IDLE) {
+        // Byte pela metade na taxa antiga: descarta
+        rx_rearm();
+    }
+    // Linha pela metade também (o slot continua livre)
+    fill_mode = LINE_START;
+    SREG = sreg;
+    return 0;
+}
+
+uint32_t soft_uart_get_baud(void) {
+    return current_baud;
+}
+/*---------------------------------------------------------------------------*/
+static void autobaud_arm(void) {
+    uint8_t sreg = SREG;
+    cli();
+    rx_rearm();
+    autobaud_min = 0xffff;
+    autobaud_last = TCNT1;
+    TIFR1 = (1 << TOV1);
+    // A primeira borda só inicia a medição
+    autobaud_edges = AUTOBAUD_EDGES + 1;
+    SREG = sreg;
+}
+
+static void autobaud_disarm(void) {
+    uint8_t sreg = SREG;
+    cli();
+    autobaud_edges = 0;
+    rx_rearm();
+    SREG = sreg;
+}
+
+// Taxa da tabela cujo período está mais próximo da menor largura medida
+static uint32_t autobaud_nearest(uint16_t width) {
+    uint8_t i, best = 0;
+    uint16_t c, d, best_d = 0xffff;
+
+    for(i = 0; i < BAUD_TABLE_LEN; i++) {
+        c = CYCLES_AT(i);
+        d = c > width ? c - width : width - c;
+        if(d < best_d) {
+            best_d = d;
+            best = i;
+        }
+    }
+    // Mais de 1/4 de bit fora: provavelmente ruído
+    if(best_d > CYCLES_AT(best) / 4) {
+        return 0;
+    }
+    return BAUD_AT(best);
+}
+/*---------------------------------------------------------------------------*/
+// Envia ATZ em cada taxa da tabela até o módulo responder algo (o banner
+// do reset ou um erro, sempre na taxa real dele) e mede os bits recebidos.
+PROCESS_THREAD(soft_uart_autobaud_process, ev, data)
+{
+    static struct etimer et;
+    static uint8_t i;
+    static const char atz[] = "ATZ\r\n";
+
+    PROCESS_BEGIN();
+
+    autobaud_result = 0;
+    for(i = 0; i < BAUD_TABLE_LEN && autobaud_result == 0; i++) {
+        soft_uart_set_baud(BAUD_AT(i));
+        autobaud_arm();
+        soft_uart_write_async((const uint8_t *)atz, sizeof(atz) - 1, NULL);
+        etimer_set(&et, SOFT_UART_AUTOBAUD_TIMEOUT);
+        PROCESS_WAIT_EVENT_UNTIL(ev == PROCESS_EVENT_POLL || etimer_expired(&et));
+        if(autobaud_edges == 0) {
+            autobaud_result = autobaud_nearest(autobaud_min);
+        }
+        autobaud_disarm();
+        etimer_stop(&et);
+    }
+
+    if(autobaud_result != 0) {
+        soft_uart_set_baud(autobaud_result);
+    } else {
+        soft_uart_set_baud(SOFTWARE_UART_BAUD_RATE);
+    }
+    // Sem cliente não há a quem avisar: process_post com NULL seria broadcast
+    if(autobaud_client != NULL) {
+        process_post(autobaud_client, soft_uart_autobaud_event,
+                     autobaud_result != 0 ? &autobaud_result : NULL);
+    }
+
+    PROCESS_END();
+}
+
+int soft_uart_autobaud(struct process *p) {
+    if(process_is_running(&soft_uart_autobaud_process)) {
+        return -1;
+    }
+    autobaud_client = p;
+    process_start(&soft_uart_autobaud_process, NULL);
+    return 0;
+}
+/*---------------------------------------------------------------------------*/
+// Slot de RX (compare A): uma amostra no meio de cada bit
 ISR(TIMER1_COMPA_vect) {
-    OCR1A = SOFT_UART_CYCLES_PER_BIT;
+    STATS_ISR_BEGIN();
+    uint8_t level = SOFT_UART_RX_READ();
+
+    OCR1A += cycles_per_bit;
 
     switch(rx_current_state) {
         case RX_START_BIT:
+            if(level) {
+                // Ruído: a linha voltou para HIGH antes do meio do start bit
+                STATS_ADD(false_starts);
+                rx_rearm();
+                break;
+            }
             rx_data_buffer = 0;
             rx_bit_index = 0;
             rx_current_state = RX_DATA_BITS;
             break;
 
         case RX_DATA_BITS:
-            if(rx_bit_index < 8) {
-                if(SOFT_UART_RX_READ()) {
-                    rx_data_buffer |= (1 << rx_bit_index);
-                }
-                rx_bit_index++;
+            // LSB primeiro: desloca para a direita em vez de (1 << i)
+            rx_data_buffer >>= 1;
+            if(level) {
+                rx_data_buffer |= 0x80;
             }
-            if(rx_bit_index >= 8) {
+            if(++rx_bit_index >= 8) {
                 rx_current_state = RX_STOP_BIT_WAIT;
             }
             break;
 
         case RX_STOP_BIT_WAIT:
-            if(SOFT_UART_RX_READ()) {
-                uint8_t next_head = (rx_head + 1) % SOFT_UART_RX_BUFFER_SIZE;
-                if (next_head != rx_tail) {
-                    rx_buffer[rx_head] = rx_data_buffer;
-                    rx_head = next_head;
-                    serial_line_input_byte(rx_data_buffer);
-                } else {
-                    soft_uart_rx_overflow = 1;
-                }
+            // Rearma primeiro: o próximo start bit pode chegar meio bit
+            // depois desta amostra, antes do trabalho abaixo terminar.
+            rx_rearm();
+            if(!level) {
+                STATS_ADD(framing_errors);
+                break;
             }
-            rx_current_state = RX_IDLE;
-            TIMSK1 &= ~(1 << OCIE1A);
-            PCICR |= (1 << PCIE0);
+            STATS_ADD(rx_bytes);
+            rx_line_byte(rx_data_buffer);
             break;
 
         default:
-            rx_current_state = RX_IDLE;
-            TIMSK1 &= ~(1 << OCIE1A);
-            PCICR |= (1 << PCIE0);
+            rx_rearm();
             break;
     }
+    STATS_ISR_END();
+}
+
+// Slot de TX (compare B): um bit por período
+ISR(TIMER1_COMPB_vect) {
+    STATS_ISR_BEGIN();
+
+    OCR1B += cycles_per_bit;
+
+    tx_bit++;
+    if(tx_bit <= 8) {
+        if(tx_shift & 0x01) SOFT_UART_TX_HIGH();
+        else SOFT_UART_TX_LOW();
+        tx_shift >>= 1;
+    } else if(tx_bit == 9) {
+        SOFT_UART_TX_HIGH();
+        STATS_ADD(tx_bytes);
+    } else if(tx_start_next()) {
+        // Fim do stop bit: emendou o próximo caractere sem tempo morto
+    } else {
+        tx_active = 0;
+        TIMSK1 &= ~(1 << OCIE1B);
+        if(tx_notify != NULL) {
+            process_poll(&soft_uart_tx_process);
+        }
+    }
+    STATS_ISR_END();
 }
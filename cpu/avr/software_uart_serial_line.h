@@ -7,6 +7,8 @@
 #include <stdio.h>
 #include <util/delay_basic.h>
 
+#include "contiki.h"
+
 // Configuração de pinos
 #define SOFT_UART_TX_PIN_BIT  PB2  // Arduino D10
 #define SOFT_UART_RX_PIN_BIT  PB3  // Arduino D11
@@ -21,21 +23,160 @@
 #define SOFT_UART_CYCLES_PER_BIT (F_CPU / SOFTWARE_UART_BAUD_RATE)
 #define SOFT_UART_CYCLES_HALF_BIT (SOFT_UART_CYCLES_PER_BIT / 2)
 
+// Ciclos entre a borda do start bit e a leitura de TCNT1 na ISR de PCINT
+// (resposta à interrupção + prólogo), descontados da primeira amostra.
+#ifndef SOFT_UART_RX_LATENCY_CYCLES
+#define SOFT_UART_RX_LATENCY_CYCLES 40
+#endif
+
+// RX e TX dividem o TIMER1; abaixo disso as duas ISRs de bit não cabem
+// em um período quando os slots coincidem (ex.: 416 ciclos a 38400/16MHz).
+#define SOFT_UART_MIN_CYCLES_PER_BIT 300
+#if SOFT_UART_CYCLES_PER_BIT < SOFT_UART_MIN_CYCLES_PER_BIT
+#error SOFTWARE_UART_BAUD_RATE alto demais para F_CPU (RX+TX full-duplex).
+#endif
+
+// Estatísticas em tempo de execução (contagem nas ISRs)
+#ifndef SOFT_UART_CONF_STATS
+#define SOFT_UART_CONF_STATS 1
+#endif
+
 // Macros de controle de pino
 #define SOFT_UART_TX_HIGH() (PORTB |= (1 << SOFT_UART_TX_PIN_BIT))
 #define SOFT_UART_TX_LOW()  (PORTB &= ~(1 << SOFT_UART_TX_PIN_BIT))
 #define SOFT_UART_RX_READ() (PINB & (1 << SOFT_UART_RX_PIN_BIT))
 
-// Tamanho do buffer de recepção
-#define SOFT_UART_RX_BUFFER_SIZE 64
+// Pool de linhas de recepção. A ISR grava cada byte direto no slot da
+// linha corrente; com todos os slots ocupados a linha inteira é descartada.
+// O padrão ocupa o mesmo que o anel e o buffer do serial-line que o pool
+// substituiu. Linhas maiores que o slot são truncadas e marcadas
+// (SOFT_UART_LINE_F_TRUNCATED); aumente o slot no contiki-conf.h ou no
+// Makefile do projeto se precisar.
+#ifndef SOFT_UART_LINE_SLOTS
+#define SOFT_UART_LINE_SLOTS 2
+#endif
+#ifndef SOFT_UART_LINE_SIZE
+#define SOFT_UART_LINE_SIZE 128
+#endif
+
+// Linhas "<porta>:<hex>" (payload de downlink do LA66, 1 a 3 dígitos e
+// ':') chegam com o hex já convertido em bytes pela ISR: a linha guarda
+// "<porta>:" e metade dos caracteres, então um slot de 128 cabe 123 bytes
+// de payload em vez de 61. Espaços entre os dígitos são ignorados.
+#ifndef SOFT_UART_CONF_HEX_LINES
+#define SOFT_UART_CONF_HEX_LINES 1
+#endif
+
+// Flags de struct soft_uart_line
+#define SOFT_UART_LINE_F_TRUNCATED 0x01  // não coube no slot e perdeu o final
+#define SOFT_UART_LINE_F_HEX       0x02  // bytes binários depois do ':'
+#define SOFT_UART_LINE_F_BAD_HEX   0x04  // hex inválido ou dígito sem par
+
+// Linha recebida, entregue em soft_uart_line_event (data aponta para o
+// slot). data termina em '\0', mas com SOFT_UART_LINE_F_HEX pode conter
+// zeros: use len. O slot só é reutilizado depois que todos os processos
+// trataram o evento.
+struct soft_uart_line {
+  char data[SOFT_UART_LINE_SIZE];
+  uint16_t len;
+  uint8_t flags;
+};
+
+// Descritor a partir do data de soft_uart_line_event, ou do data que o
+// at-master repassa aos handlers (o at-master só lê linhas da Soft UART).
+// Não vale para serial_line_event_message do console.
+#define SOFT_UART_LINE(data) ((const struct soft_uart_line *)(data))
+
+// Postado em broadcast a cada linha recebida; data é o slot da linha.
+extern process_event_t soft_uart_line_event;
+
+// Tamanho do buffer de transmissão (potência de 2, esvaziado pela ISR)
+#ifndef SOFT_UART_TX_BUFFER_SIZE
+#define SOFT_UART_TX_BUFFER_SIZE 64
+#endif
+
+// Evento postado ao processo indicado em soft_uart_write_async() quando o
+// último stop bit do anel de transmissão foi enviado.
+extern process_event_t soft_uart_tx_done_event;
 
 // Protótipos
 void soft_uart_init(void);
 void soft_uart_write_byte(uint8_t data);
 int soft_uart_write_string(const char *str);
-uint8_t soft_uart_read_buffer(void);
 int putcharec(int c);  // redireciona printf()
 
+/**
+ * Enfileira até len bytes no anel de transmissão e retorna imediatamente.
+ * Os bits são emitidos pela ISR de TIMER1 (compare B). Se p não for NULL,
+ * soft_uart_tx_done_event é postado a p quando o anel esvaziar (somente o
+ * último processo registrado é notificado).
+ * @return Número de bytes aceitos (menor que len se o anel encher).
+ */
+uint8_t soft_uart_write_async(const uint8_t *data, uint8_t len,
+                              struct process *p);
+
+/**
+ * Transmite data em hexadecimal (2 caracteres ASCII por byte, nibble alto
+ * primeiro) seguido de suffix, sem copiar nem formatar: a ISR de TX
+ * codifica cada nibble direto do buffer do chamador. O fluxo sai depois do
+ * que já estiver no anel; bytes escritos no anel durante o fluxo (printf,
+ * soft_uart_write_byte()) ficam na fila e saem depois do sufixo, sem
+ * quebrar o quadro. data e suffix devem valer até soft_uart_tx_busy()
+ * retornar 0 (ou soft_uart_tx_done_event chegar a p).
+ * @return 0, ou -1 se já houver um fluxo hex em andamento.
+ */
+int soft_uart_write_hex(const uint8_t *data, uint8_t len,
+                        const char *suffix, struct process *p);
+
+/**
+ * @return 1 enquanto houver bytes no anel ou um byte em transmissão.
+ */
+uint8_t soft_uart_tx_busy(void);
+
 extern volatile uint8_t soft_uart_rx_overflow;
 
+// Tempo de espera por resposta em cada taxa testada pelo autobaud
+#ifndef SOFT_UART_AUTOBAUD_TIMEOUT
+#define SOFT_UART_AUTOBAUD_TIMEOUT (CLOCK_SECOND / 2)
+#endif
+
+// Postado ao processo de soft_uart_autobaud(); data aponta para o baud
+// escolhido (uint32_t) ou é NULL se o módulo não respondeu.
+extern process_event_t soft_uart_autobaud_event;
+
+/**
+ * Troca o baud rate em tempo de execução. Espera o anel de TX esvaziar e
+ * descarta um byte de RX pela metade.
+ * @param baud Uma das taxas da tabela (1200 a 38400, conforme F_CPU).
+ * @return 0, ou -1 se a taxa não estiver na tabela.
+ */
+int soft_uart_set_baud(uint32_t baud);
+uint32_t soft_uart_get_baud(void);
+
+/**
+ * Detecta o baud rate do módulo: envia ATZ em cada taxa da tabela e mede
+ * a menor largura de bit da resposta. Ao final aplica a taxa encontrada
+ * (ou volta a SOFTWARE_UART_BAUD_RATE) e posta soft_uart_autobaud_event.
+ * @param p Processo que recebe o evento, ou NULL para não ser avisado.
+ * @return 0, ou -1 se já houver um autobaud em andamento.
+ */
+int soft_uart_autobaud(struct process *p);
+
+struct soft_uart_stats {
+  uint16_t rx_bytes;
+  uint16_t tx_bytes;
+  uint16_t framing_errors;    // stop bit lido em LOW
+  uint16_t overruns;          // linha descartada sem slot livre
+  uint16_t false_starts;      // borda de start que não durou meio bit
+  uint16_t isr_cycles_max;    // pior ISR de bit medida (TCNT1, sem prólogo)
+  uint16_t isr_cycles_budget; // ciclos disponíveis por slot de bit
+};
+
+/**
+ * Copia as estatísticas do motor RX/TX. Com SOFT_UART_CONF_STATS = 0 só
+ * isr_cycles_budget é preenchido.
+ */
+void soft_uart_get_stats(struct soft_uart_stats *stats);
+void soft_uart_reset_stats(void);
+
 #endif
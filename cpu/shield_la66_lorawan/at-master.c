@@ -31,87 +31,469 @@
 #include "contiki.h"
 #include "contiki-lib.h"
 #include "at-master.h"
-#include "la66.h"
-
-
-#include "software_uart_serial_line.h" //Minha Alteracao
-#include "serial-line.h" // Minha Alteracao
+#include "software_uart_serial_line.h"
 
 #include <ctype.h>
 #include <string.h>
 #include <stdio.h>
 #include <stdint.h>
+/*---------------------------------------------------------------------------*/
+#define DEBUG 0
+#if DEBUG
+#define PRINTF(...) printf(__VA_ARGS__)
+#else
+#define PRINTF(...)
+#endif
+/*---------------------------------------------------------------------------*/
+#if (AT_DISPATCH_BUCKETS & (AT_DISPATCH_BUCKETS - 1)) != 0
+#error AT_CONF_DISPATCH_BUCKETS must be a power of two
+#endif
+/*---------------------------------------------------------------------------*/
+LIST(at_cmd_list);
+process_event_t at_cmd_received_event;
+/*---------------------------------------------------------------------------*/
+struct at_txn {
+  struct at_txn *next;
+  const char *cmd;
+  at_txn_writer_t writer;
+  const char *expect;
+  clock_time_t timeout;
+  uint8_t retries;
+  uint8_t progmem;      /* cmd and expect are in program memory */
+  at_txn_callback_t callback;
+  void *ptr;
+};
+
+MEMB(at_txn_memb, struct at_txn, AT_QUEUE_SIZE);
+LIST(at_txn_list);
+static struct ctimer at_txn_timer;
+static struct at_txn *at_inflight;
+/*---------------------------------------------------------------------------*/
+/*
+ * Jump table indexed by the first byte of the header. Each bucket chains the
+ * commands sharing that hash, longest header first, so the first complete
+ * match is also the longest one and a line costs O(header length) instead of
+ * a strncmp against every registered command.
+ */
+static struct at_cmd *at_bucket[AT_DISPATCH_BUCKETS];
+static struct at_cmd *at_default;
 
-process_event_t at_cmd_received_event; // <--- Adicione esta linha se não tiver
-// Declaração da lista de comandos AT
+#if AT_EXCLUSIVE_LINES
+static struct process_subscription at_line_subscription;
+#endif
 
-static uint8_t at_uart; // <-- ADICIONE ESTA LINHA AQUI!
+/*
+ * Response table in program memory (at_register_table()), indexed in the
+ * same buckets: each bucket chains entry indices, longest header first.
+ */
+#define AT_TABLE_END 0xff
+static const struct at_entry *at_table;
+static uint8_t at_table_bucket[AT_DISPATCH_BUCKETS];
+static uint8_t at_table_next[AT_TABLE_SIZE];
+static uint8_t at_table_default = AT_TABLE_END;
 
-process_event_t at_cmd_received_event; // Definição global do evento
-// ...
-PROCESS(at_process, "AT Master Process"); // Declaração do processo
-// ...
+#define AT_BUCKET(c) ((((uint8_t)(c)) ^ (((uint8_t)(c)) >> 3)) & \
+                      (AT_DISPATCH_BUCKETS - 1))
 /*---------------------------------------------------------------------------*/
-// Este bloco DEVE ESTAR em at-master.c e completo
-PROCESS_THREAD(at_process, ev, data)
+PROCESS(at_process, "AT process");
+/*---------------------------------------------------------------------------*/
+static struct at_cmd *
+at_match(const char *buf, uint16_t plen)
 {
-  PROCESS_BEGIN();
+  struct at_cmd *a;
 
-  // ... (código do thread, incluindo tratamento de serial_line_event_message) ...
+  for(a = at_bucket[AT_BUCKET(buf[0])]; a != NULL; a = a->bucket_next) {
+    if(a->cmd_hdr_len > plen || plen > a->cmd_max_len) {
+      continue;
+    }
+    /* Cheap reject on the first byte before comparing the whole header */
+    if(a->cmd_header[0] == buf[0] &&
+       strncmp(a->cmd_header, buf, a->cmd_hdr_len) == 0) {
+      return a;
+    }
+  }
 
-  PROCESS_END();
+  if(at_default != NULL && plen <= at_default->cmd_max_len) {
+    return at_default;
+  }
+  return NULL;
 }
 /*---------------------------------------------------------------------------*/
-// ... (o resto do seu at-master.c, incluindo at_init e at_register)
-
-
+/*
+ * Longest header of the program memory table matching buf, walking the
+ * bucket of its first byte like at_match(). Only the length fields and the
+ * header are read from flash; the entry is copied to e once it matches.
+ * Returns the header length, or -1 if nothing matched (the empty header
+ * entry returns 0).
+ */
+static int
+at_table_match(const char *buf, uint16_t plen, struct at_entry *e)
+{
+  const struct at_entry *t;
+  uint8_t i, hlen;
+  PGM_P hdr;
 
-LIST_STRUCT(at_cmd_list); // <--- ADICIONE ESTA LINHA!
+  if(at_table == NULL) {
+    return -1;
+  }
+  for(i = at_table_bucket[AT_BUCKET(buf[0])]; i != AT_TABLE_END;
+      i = at_table_next[i]) {
+    t = &at_table[i];
+    hlen = pgm_read_byte(&t->cmd_hdr_len);
+    if(hlen > plen || plen > pgm_read_word(&t->cmd_max_len)) {
+      continue;
+    }
+    memcpy_P(&hdr, &t->cmd_header, sizeof(hdr));
+    if(pgm_read_byte(hdr) == (uint8_t)buf[0] &&
+       strncmp_P(buf, hdr, hlen) == 0) {
+      memcpy_P(e, t, sizeof(*e));
+      return hlen;
+    }
+  }
 
+  if(at_table_default != AT_TABLE_END &&
+     plen <= pgm_read_word(&at_table[at_table_default].cmd_max_len)) {
+    memcpy_P(e, &at_table[at_table_default], sizeof(*e));
+    return 0;
+  }
+  return -1;
+}
+/*---------------------------------------------------------------------------*/
+static void at_txn_timeout(void *ptr);
+/*---------------------------------------------------------------------------*/
+static void
+at_txn_send(void)
+{
+  struct at_txn *t = list_head(at_txn_list);
 
+  if(at_inflight != NULL || t == NULL) {
+    return;
+  }
+  at_inflight = t;
+  if(t->writer != NULL) {
+    t->writer(t->ptr);
+  } else if(t->progmem) {
+    at_send_P(t->cmd);
+  } else {
+    PRINTF("AT: tx %s", t->cmd);
+    at_send((char *)t->cmd, strlen(t->cmd));
+  }
+  ctimer_set(&at_txn_timer, t->timeout, at_txn_timeout, NULL);
+}
+/*---------------------------------------------------------------------------*/
+static void
+at_txn_finish(at_txn_status_t status, char *line)
+{
+  struct at_txn *t = at_inflight;
 
-// ... (restante dos includes) ...
+  ctimer_stop(&at_txn_timer);
+  list_remove(at_txn_list, t);
+  at_inflight = NULL;
+  if(t->callback != NULL) {
+    t->callback(status, line, t->ptr);
+  }
+  memb_free(&at_txn_memb, t);
 
-// ... (LIST e process_event_t at_cmd_received_event) ...
+  /* Pipeline: the next command goes out in the same scheduling round */
+  at_txn_send();
+}
+/*---------------------------------------------------------------------------*/
+static void
+at_txn_timeout(void *ptr)
+{
+  if(at_inflight == NULL) {
+    return;
+  }
+  if(at_inflight->retries > 0) {
+    at_inflight->retries--;
+    PRINTF("AT: timeout, retrying\n");
+    at_inflight = NULL;
+    at_txn_send();
+  } else {
+    at_txn_finish(AT_TXN_TIMEOUT, NULL);
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+at_txn_input(char *buf, uint16_t plen)
+{
+  struct at_txn *t = at_inflight;
 
-// Remover esta variável estática at_uart se você só vai usar a Soft UART
-// static uint8_t at_uart = 0; // Se remover, adapte at_init e at_send
+  if(t == NULL) {
+    return;
+  }
+  if(plen == 2 && buf[0] == 'O' && buf[1] == 'K') {
+    at_txn_finish(AT_TXN_OK, buf);
+  } else if(plen >= 5 && strcmp(&buf[plen - 5], "ERROR") == 0) {
+    at_txn_finish(AT_TXN_ERROR, buf);
+  } else if(t->expect != NULL && t->callback != NULL &&
+            (t->progmem ?
+             strncmp_P(buf, t->expect, strlen_P(t->expect)) :
+             strncmp(buf, t->expect, strlen(t->expect))) == 0) {
+    t->callback(AT_TXN_RESPONSE, buf, t->ptr);
+  }
+}
+/*---------------------------------------------------------------------------*/
+PROCESS_THREAD(at_process, ev, data)
+{
+  uint16_t plen;
+  char *buf;
+  struct at_cmd *a;
+  struct at_entry e;
+  int tlen;
+  PROCESS_BEGIN();
 
-//PROCESS(at_process, "AT process");
+  while(1) {
+    PROCESS_WAIT_EVENT_UNTIL(ev == soft_uart_line_event && data != NULL);
+    /* The length comes with the line: a decoded hex line may hold zeros */
+    buf = ((struct soft_uart_line *)data)->data;
+    plen = ((struct soft_uart_line *)data)->len;
+    if(plen == 0) {
+      continue;
+    }
+    PRINTF("AT: rx %s\n", buf);
 
-// ... (PROCESS_THREAD at_process) ...
+    at_txn_input(buf, plen);
 
+    a = at_match(buf, plen);
+    tlen = at_table_match(buf, plen, &e);
+    /* The table wins unless a registered command has a longer header; its
+       empty header entry only if at_register() gave no default */
+    if(tlen >= 0 && (a == NULL ||
+                     (a == at_default ? tlen > 0 : a->cmd_hdr_len <= tlen))) {
+      e.event_callback(NULL, plen, buf);
+      continue;
+    }
+    if(a != NULL) {
+      a->event_callback(a, plen, buf);
+      if(a->app_process != NULL) {
+        process_post(a->app_process, at_cmd_received_event, NULL);
+      }
+    }
+  }
+  PROCESS_END();
+}
+/*---------------------------------------------------------------------------*/
+struct at_cmd *
+at_list(void)
+{
+  return list_head(at_cmd_list);
+}
+/*---------------------------------------------------------------------------*/
 uint8_t
 at_send(char *s, uint8_t len)
 {
-  uint8_t i = 0;
-  while(s && *s != 0) {
-    if(i >= len) {
-      break;
-    }
-    // MODIFICAÇÃO AQUI: Chamar sua Soft UART
-    soft_uart_write_byte(*s++);
-    i++;
+  uint8_t n = 0;
+  uint8_t i;
+
+  while(s && n < len && s[n] != 0) {
+    n++;
+  }
+  /* A ISR da Soft UART emite os bits; so bloqueia se o anel de TX encher */
+  i = soft_uart_write_async((const uint8_t *)s, n, NULL);
+  while(i < n) {
+    soft_uart_write_byte(s[i++]);
   }
   return i;
 }
+/*---------------------------------------------------------------------------*/
+uint8_t
+at_send_P(PGM_P s)
+{
+  char chunk[16];
+  uint8_t n, total = 0;
 
-void at_init(uint8_t uart_sel)
+  do {
+    for(n = 0; n < sizeof(chunk) && (chunk[n] = pgm_read_byte(s)) != 0;
+        n++, s++);
+    total += at_send(chunk, n);
+  } while(n == sizeof(chunk));
+  return total;
+}
+/*---------------------------------------------------------------------------*/
+void
+at_init(uint8_t uart_sel)
 {
   static uint8_t inited = 0;
   if(!inited) {
     list_init(at_cmd_list);
-    at_cmd_received_event = process_alloc_event(); // Aloca o evento aqui
+    list_init(at_txn_list);
+    memb_init(&at_txn_memb);
+    at_cmd_received_event = process_alloc_event();
     inited = 1;
 
-    //at_uart = uart_sel;
-    //uart_init(at_uart);
-    //uart_set_input(at_uart, serial_line_input_byte);
-    serial_line_init();
+    /* RX vem da Soft UART (linhas entregues via soft_uart_line_event);
+       as linhas do console (serial_line_event_message) não passam aqui */
+#if AT_EXCLUSIVE_LINES
+    /* Only the AT process gets the line broadcast, not every process */
+    process_subscribe(&at_line_subscription, &at_process,
+                      soft_uart_line_event);
+    process_set_exclusive(soft_uart_line_event, 1);
+#endif
+
+    process_start(&at_process, NULL);
+    PRINTF("AT: Started (%u)\n", uart_sel);
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+at_unlink(struct at_cmd *cmd)
+{
+  struct at_cmd **pp;
+
+  if(at_default == cmd) {
+    at_default = NULL;
+  }
+  for(pp = &at_bucket[AT_BUCKET(cmd->cmd_header[0])]; *pp != NULL;
+      pp = &(*pp)->bucket_next) {
+    if(*pp == cmd) {
+      *pp = cmd->bucket_next;
+      break;
+    }
+  }
+}
+/*---------------------------------------------------------------------------*/
+at_status_t
+at_register(struct at_cmd *cmd, struct process *app_process,
+            const char *cmd_hdr, const uint8_t hdr_len,
+            const uint16_t cmd_max_len, at_event_callback_t event_callback)
+{
+  struct at_cmd **pp;
+
+  if((cmd == NULL) || (cmd_hdr == NULL) || (cmd_max_len < hdr_len) ||
+     (event_callback == NULL)) {
+    PRINTF("AT: Invalid argument\n");
+    return AT_STATUS_INVALID_ARGS_ERROR;
+  }
+
+  /* Re-registering the same placeholder replaces the old entry */
+  if(cmd->cmd_header != NULL) {
+    at_unlink(cmd);
+  }
+  list_remove(at_cmd_list, cmd);
+
+  memset(cmd, 0, sizeof(struct at_cmd));
+  cmd->event_callback = event_callback;
+  cmd->cmd_header = cmd_hdr;
+  cmd->cmd_hdr_len = hdr_len;
+  cmd->cmd_max_len = cmd_max_len;
+  cmd->app_process = app_process;
+  list_add(at_cmd_list, cmd);
+
+  if(hdr_len == 0) {
+    at_default = cmd;
+  } else {
+    pp = &at_bucket[AT_BUCKET(cmd_hdr[0])];
+    while(*pp != NULL && (*pp)->cmd_hdr_len >= hdr_len) {
+      pp = &(*pp)->bucket_next;
+    }
+    cmd->bucket_next = *pp;
+    *pp = cmd;
+  }
+
+  PRINTF("AT: registered HDR %s LEN %u MAX %u\n", cmd->cmd_header,
+                                                  cmd->cmd_hdr_len,
+                                                  cmd->cmd_max_len);
+  return AT_STATUS_OK;
+}
+/*---------------------------------------------------------------------------*/
+at_status_t
+at_register_table(const struct at_entry *table, uint8_t count)
+{
+  uint8_t i, b, hlen;
+  uint8_t *pp;
+  PGM_P hdr;
+
+  if((table == NULL && count > 0) || count > AT_TABLE_SIZE) {
+    return AT_STATUS_INVALID_ARGS_ERROR;
+  }
+  at_table = table;
+  memset(at_table_bucket, AT_TABLE_END, sizeof(at_table_bucket));
+  at_table_default = AT_TABLE_END;
 
-    process_start(&at_process, NULL); // Inicia o processo
-    printf("AT: Started (%u)\n", at_uart); // Use printf
+  for(i = 0; i < count; i++) {
+    hlen = pgm_read_byte(&table[i].cmd_hdr_len);
+    if(hlen == 0) {
+      if(at_table_default == AT_TABLE_END) {
+        at_table_default = i;
+      }
+      continue;
+    }
+    memcpy_P(&hdr, &table[i].cmd_header, sizeof(hdr));
+    b = AT_BUCKET(pgm_read_byte(hdr));
+    /* After the entries with as long a header: the first one wins a tie */
+    for(pp = &at_table_bucket[b];
+        *pp != AT_TABLE_END &&
+        pgm_read_byte(&table[*pp].cmd_hdr_len) >= hlen;
+        pp = &at_table_next[*pp]);
+    at_table_next[i] = *pp;
+    *pp = i;
   }
+
+  PRINTF("AT: registered table of %u entries\n", count);
+  return AT_STATUS_OK;
 }
+/*---------------------------------------------------------------------------*/
+static at_status_t
+at_txn_add(const char *cmd, at_txn_writer_t writer, const char *expect,
+           uint8_t progmem, clock_time_t timeout, uint8_t retries,
+           at_txn_callback_t callback, void *ptr)
+{
+  struct at_txn *t;
+
+  t = memb_alloc(&at_txn_memb);
+  if(t == NULL) {
+    PRINTF("AT: queue full\n");
+    return AT_STATUS_ERROR;
+  }
+  t->cmd = cmd;
+  t->writer = writer;
+  t->expect = expect;
+  t->progmem = progmem;
+  t->timeout = timeout;
+  t->retries = retries;
+  t->callback = callback;
+  t->ptr = ptr;
+  list_add(at_txn_list, t);
 
-// ... (at_register) ...
\ No newline at end of file
+  at_txn_send();
+  return AT_STATUS_OK;
+}
+/*---------------------------------------------------------------------------*/
+at_status_t
+at_enqueue(const char *cmd, const char *expect, clock_time_t timeout,
+           uint8_t retries, at_txn_callback_t callback, void *ptr)
+{
+  if(cmd == NULL) {
+    return AT_STATUS_INVALID_ARGS_ERROR;
+  }
+  return at_txn_add(cmd, NULL, expect, 0, timeout, retries, callback, ptr);
+}
+/*---------------------------------------------------------------------------*/
+at_status_t
+at_enqueue_P(PGM_P cmd, PGM_P expect, clock_time_t timeout,
+             uint8_t retries, at_txn_callback_t callback, void *ptr)
+{
+  if(cmd == NULL) {
+    return AT_STATUS_INVALID_ARGS_ERROR;
+  }
+  return at_txn_add(cmd, NULL, expect, 1, timeout, retries, callback, ptr);
+}
+/*---------------------------------------------------------------------------*/
+at_status_t
+at_enqueue_writer(at_txn_writer_t writer, const char *expect,
+                  clock_time_t timeout, uint8_t retries,
+                  at_txn_callback_t callback, void *ptr)
+{
+  if(writer == NULL) {
+    return AT_STATUS_INVALID_ARGS_ERROR;
+  }
+  return at_txn_add(NULL, writer, expect, 0, timeout, retries, callback, ptr);
+}
+/*---------------------------------------------------------------------------*/
+uint8_t
+at_queue_len(void)
+{
+  return list_length(at_txn_list);
+}
+/*---------------------------------------------------------------------------*/
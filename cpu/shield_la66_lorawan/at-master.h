@@ -31,11 +31,67 @@
 #define AT_MASTER_H_
 #include "contiki.h"
 /*---------------------------------------------------------------------------*/
+/*
+ * Command strings and response tables can live in program memory (see
+ * at_register_table() and at_enqueue_P()). On other targets, e.g. native
+ * builds of the AT link benchmark, program memory is plain memory.
+ */
+#ifdef __AVR__
+#include <avr/pgmspace.h>
+#else
+#include <string.h>
+#ifndef PROGMEM
+#define PROGMEM
+#endif
+#ifndef PGM_P
+#define PGM_P const char *
+#endif
+#ifndef PSTR
+#define PSTR(s) (s)
+#endif
+#define pgm_read_byte(p) (*(const uint8_t *)(p))
+#define pgm_read_word(p) (*(const uint16_t *)(p))
+#define memcpy_P  memcpy
+#define strlen_P  strlen
+#define strncmp_P strncmp
+#define snprintf_P snprintf
+#endif
+/*---------------------------------------------------------------------------*/
 #define AT_DEFAULT_RESPONSE_OK    "\r\nOK\r\n"
 #define AT_DEFAULT_RESPONSE_ERROR "\r\nERROR\r\n"
 /*---------------------------------------------------------------------------*/
 #define AT_RESPONSE(x) at_send((x), (strlen(x)))
 /*---------------------------------------------------------------------------*/
+/* Number of first-byte buckets used to dispatch incoming lines (power of 2) */
+#ifdef AT_CONF_DISPATCH_BUCKETS
+#define AT_DISPATCH_BUCKETS AT_CONF_DISPATCH_BUCKETS
+#else
+#define AT_DISPATCH_BUCKETS 8
+#endif
+/*
+ * Take soft UART lines exclusively: only the AT process gets
+ * soft_uart_line_event, not every process. On by default when the
+ * build enables exclusive events (PROCESS_CONF_EXCLUSIVE_EVENTS); turn
+ * it off when anything else reads the soft UART lines.
+ */
+#ifdef AT_CONF_EXCLUSIVE_LINES
+#define AT_EXCLUSIVE_LINES AT_CONF_EXCLUSIVE_LINES
+#else
+#define AT_EXCLUSIVE_LINES (PROCESS_EXCLUSIVE_EVENTS > 0)
+#endif
+/* Maximum number of entries in a program memory table (at_register_table()) */
+#ifdef AT_CONF_TABLE_SIZE
+#define AT_TABLE_SIZE AT_CONF_TABLE_SIZE
+#else
+#define AT_TABLE_SIZE 16
+#endif
+/* Maximum number of queued AT transactions (see at_enqueue()) */
+#ifdef AT_CONF_QUEUE_SIZE
+#define AT_QUEUE_SIZE AT_CONF_QUEUE_SIZE
+#else
+#define AT_QUEUE_SIZE 4
+#endif
+/*---------------------------------------------------------------------------*/
 extern process_event_t at_cmd_received_event;
 struct at_cmd;
 /*---------------------------------------------------------------------------*/
@@ -50,16 +106,18 @@ typedef enum {
  * \param uart  selects which UART to use
  *
  * The AT driver invokes this function upon registering a command, this will
- * wait for the serial_line_event_message event
+ * wait for the soft_uart_line_event event (soft_uart_init() allocates it)
  */
 void at_init(uint8_t uart);
 /*---------------------------------------------------------------------------*/
 /**
- * \brief AT    initialization
- * \param uart  selects which UART to use
+ * \brief      Sends a string to the AT device
+ * \param s    String to send
+ * \param len  Maximum number of bytes to send (stops at a NULL byte)
+ * \return     Number of bytes queued for transmission
  *
- * The AT driver invokes this function upon registering a command, this will
- * wait for the serial_line_event_message event
+ * Returns as soon as the bytes are in the soft UART TX ring, it only blocks
+ * while the ring is full
  */
 uint8_t at_send(char *s, uint8_t len);
 /*---------------------------------------------------------------------------*/
@@ -73,34 +131,31 @@ uint8_t at_send(char *s, uint8_t len);
  * event on an incoming AT command
  */
 typedef void (*at_event_callback_t)(struct at_cmd *cmd,
-                                    uint8_t len,
+                                    uint16_t len,
                                     char *data);
 /*---------------------------------------------------------------------------*/
 struct at_cmd {
   struct at_cmd *next;
+  struct at_cmd *bucket_next;
   const char *cmd_header;
   uint8_t cmd_hdr_len;
-  uint8_t cmd_max_len;
+  uint16_t cmd_max_len;
   at_event_callback_t event_callback;
   struct process *app_process;
 };
 /*---------------------------------------------------------------------------*/
 /**
- * \brief                 Registers the callback to return an AT command
- * \param cmd             A pointer to the CMD placeholder
- * \param cmd_hdr         String to compare when an AT command is received
- * \param cmd_len         Lenght of cmd_hdr
- * \param event_callback  Callback function to handle the AT command
- * \return                AT_STATUS_OK or AT_STATUS_INVALID_ARGS_ERROR
+ * \brief Entry of a response table kept in program memory
  *
- * Register the commands to search for when a valid AT frame has been received
+ * Same fields as struct at_cmd, without the list links: a table built at
+ * compile time needs no RAM. The callback is called with cmd == NULL.
  */
-at_status_t at_register(struct at_cmd *cmd,
-                        struct process *app_process,
-                        const char *cmd_hdr,
-                        const uint8_t cmd_hdr_len,
-                        const uint8_t cmd_max_len,
-                        at_event_callback_t event_callback);
+struct at_entry {
+  PGM_P cmd_header;
+  uint8_t cmd_hdr_len;
+  uint16_t cmd_max_len;
+  at_event_callback_t event_callback;
+};
 /*---------------------------------------------------------------------------*/
 struct at_cmd *at_list(void);
 /*---------------------------------------------------------------------------*/
@@ -112,12 +167,111 @@ struct at_cmd *at_list(void);
  * \param event_callback  Callback function to handle the AT command
  * \return                AT_STATUS_OK or AT_STATUS_INVALID_ARGS_ERROR
  *
- * Register the commands to search for when a valid AT frame has been received
+ * Register the commands to search for when a valid AT frame has been received.
+ * A line matches when it starts with cmd_hdr; when several headers match, the
+ * longest one wins. A header of length 0 registers a default handler for lines
+ * that match nothing else.
  */
 at_status_t at_register(struct at_cmd *cmd,
                         struct process *app_process,
                         const char *cmd_hdr,
                         const uint8_t cmd_hdr_len,
-                        const uint8_t cmd_max_len,
+                        const uint16_t cmd_max_len,
                         at_event_callback_t event_callback);
+/*---------------------------------------------------------------------------*/
+/**
+ * \brief          Registers a response table stored in program memory
+ * \param table    Array of entries, e.g. declared const ... PROGMEM
+ * \param count    Number of entries
+ * \return         AT_STATUS_OK or AT_STATUS_INVALID_ARGS_ERROR
+ *
+ * The entries stay in program memory. Registration indexes them by the
+ * first byte of the header, in the same buckets as at_register(), using one
+ * byte of RAM per entry; a line then only compares the headers of its
+ * bucket. A line goes to the longest matching header among the table and
+ * the commands given to at_register(); on equal lengths the table wins, and
+ * among table entries the first one. An entry with an empty header is used
+ * when nothing else matches and no default was given to at_register(). A
+ * new call replaces the table. At most AT_TABLE_SIZE entries.
+ */
+at_status_t at_register_table(const struct at_entry *table, uint8_t count);
+/*---------------------------------------------------------------------------*/
+typedef enum {
+  AT_TXN_RESPONSE,    /* Expected response line seen, command still running */
+  AT_TXN_OK,          /* Terminal OK received */
+  AT_TXN_ERROR,       /* Terminal line ending in ERROR received */
+  AT_TXN_TIMEOUT,     /* No terminal line after all retries */
+} at_txn_status_t;
+/*---------------------------------------------------------------------------*/
+/**
+ * \brief          AT transaction callback
+ * \param status   Transaction progress, see at_txn_status_t
+ * \param line     The line that caused the callback (NULL on timeout). Only
+ *                 valid during the callback
+ * \param ptr      The pointer given to at_enqueue()
+ */
+typedef void (*at_txn_callback_t)(at_txn_status_t status, char *line,
+                                  void *ptr);
+/*---------------------------------------------------------------------------*/
+/**
+ * \brief          Queues an AT command
+ * \param cmd      Command to send, including "\r\n". Must stay valid until
+ *                 the transaction completes
+ * \param expect   Prefix of the response line the caller wants to see, or
+ *                 NULL. Reported as AT_TXN_RESPONSE before the terminal line
+ * \param timeout  Time to wait for the terminal OK/ERROR after each send
+ * \param retries  Number of times the command is resent on timeout
+ * \param callback Called on AT_TXN_RESPONSE and on completion, may be NULL
+ * \param ptr      User pointer passed to the callback
+ * \return         AT_STATUS_OK, or AT_STATUS_ERROR if the queue is full
+ *
+ * Exactly one command is on the wire at a time. The next queued command is
+ * sent as soon as the current one sees its terminal OK/ERROR line (or times
+ * out), so callers do not need to sleep between commands. Lines are still
+ * passed to the handlers registered with at_register().
+ */
+at_status_t at_enqueue(const char *cmd, const char *expect,
+                       clock_time_t timeout, uint8_t retries,
+                       at_txn_callback_t callback, void *ptr);
+/*---------------------------------------------------------------------------*/
+/**
+ * \brief          Queues an AT command stored in program memory
+ *
+ * Same as at_enqueue(), but cmd and expect (if not NULL) are in program
+ * memory and are streamed from there each time the command is sent
+ */
+at_status_t at_enqueue_P(PGM_P cmd, PGM_P expect, clock_time_t timeout,
+                         uint8_t retries, at_txn_callback_t callback,
+                         void *ptr);
+/*---------------------------------------------------------------------------*/
+/**
+ * \brief      Sends a string stored in program memory to the AT device
+ * \return     Number of bytes queued for transmission
+ */
+uint8_t at_send_P(PGM_P s);
+/*---------------------------------------------------------------------------*/
+/**
+ * \brief          Writes a queued command to the UART
+ * \param ptr      The pointer given to at_enqueue_writer()
+ *
+ * Called each time the transaction is (re)sent. Streams the whole command,
+ * including "\r\n", e.g. with at_send() and soft_uart_write_hex()
+ */
+typedef void (*at_txn_writer_t)(void *ptr);
+/*---------------------------------------------------------------------------*/
+/**
+ * \brief          Queues an AT command produced by a writer function
+ *
+ * Same as at_enqueue(), but instead of a string the command is generated by
+ * writer when it goes on the wire, so large payloads never need a formatted
+ * copy in RAM. ptr is passed to both writer and callback
+ */
+at_status_t at_enqueue_writer(at_txn_writer_t writer, const char *expect,
+                              clock_time_t timeout, uint8_t retries,
+                              at_txn_callback_t callback, void *ptr);
+/*---------------------------------------------------------------------------*/
+/**
+ * \brief Number of queued transactions, including the one in flight
+ */
+uint8_t at_queue_len(void);
 #endif /* AT_MASTER_H_ */
@@ -0,0 +1,501 @@
+/*
+ * Benchmark de alocadores: repete o mesmo traço de alocações com o
+ * alocador por classes de tamanho (lib/tlsf), com o mmem e com o malloc
+ * da libc.
+ *
+ * Uso: ./alloc_bench.native [consultas] [consultas abertas]
+ *
+ * O traço imita as consultas do Antelope (apps/antelope) com os tamanhos
+ * das suas estruturas: cada consulta carrega uma relação (relation_t e
+ * um attribute_t por coluna), às vezes um índice (index_t e o heap do
+ * maxheap ou a tabela do memhash), monta o resultado (relation_t,
+ * atributos projetados, linha de resultado e bytecode da LVM) e lê as
+ * linhas com um buffer por linha. Várias consultas ficam abertas ao
+ * mesmo tempo e a relação carregada só é liberada algumas consultas
+ * depois, como num cache de relações, para misturar os tempos de vida.
+ *
+ * Para cada alocador: ns por alloc e por free (média e percentil 99),
+ * falhas e, para o tlsf, o pico de bytes em uso e a maior fragmentação
+ * externa vista. Cada bloco é marcado na alocação e conferido no free,
+ * o que pega blocos sobrepostos.
+ */
+
+#include "contiki.h"
+#include "lib/mmem.h"
+#include "lib/random.h"
+#include "lib/tlsf.h"
+#include "index.h"
+#include "relation.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/*---------------------------------------------------------------------------*/
+#define BENCH_DEFAULT_QUERIES  5000
+#define BENCH_DEFAULT_SESSIONS 4
+#define BENCH_MAX_SESSIONS     16
+/* Relações carregadas que ficam na memória depois da consulta */
+#define BENCH_RELATION_CACHE   3
+#define BENCH_MAX_ROWS         16
+#define BENCH_SLOTS            1024
+
+/* Tipos privados de index-maxheap.c e index-memhash.c, com o mesmo layout */
+struct bench_heap {
+  db_storage_id_t heap_storage;
+  db_storage_id_t bucket_storage;
+  uint8_t next_free_slot[511];
+};
+struct bench_hash_item {
+  tuple_id_t tuple_id;
+  attribute_value_t value;
+};
+#define BENCH_HASH_MAP_SIZE \
+  (DB_MEMHASH_TABLE_SIZE * sizeof(struct bench_hash_item))
+
+extern int contiki_argc;
+extern char **contiki_argv;
+
+PROCESS(alloc_bench_process, "allocator benchmark");
+AUTOSTART_PROCESSES(&alloc_bench_process);
+/*---------------------------------------------------------------------------*/
+/* Traço */
+struct op {
+  uint8_t is_free;
+  uint16_t slot;
+  uint16_t size;
+};
+
+static struct op *ops;
+static unsigned long nops, ops_max;
+
+static uint16_t free_slots[BENCH_SLOTS];
+static unsigned nfree_slots;
+static uint16_t slot_size[BENCH_SLOTS];
+static unsigned long live, peak_live;
+
+static uint16_t
+trace_alloc(size_t size)
+{
+  uint16_t slot;
+
+  if(nfree_slots == 0) {
+    printf("alloc_bench: out of trace slots\n");
+    exit(1);
+  }
+  if(nops == ops_max) {
+    ops_max = ops_max ? 2 * ops_max : 4096;
+    ops = realloc(ops, ops_max * sizeof(struct op));
+    if(ops == NULL) {
+      exit(1);
+    }
+  }
+  slot = free_slots[--nfree_slots];
+  ops[nops].is_free = 0;
+  ops[nops].slot = slot;
+  ops[nops].size = size;
+  nops++;
+  slot_size[slot] = size;
+  live += size;
+  if(live > peak_live) {
+    peak_live = live;
+  }
+  return slot;
+}
+
+static void
+trace_free(uint16_t slot)
+{
+  if(nops == ops_max) {
+    ops_max = 2 * ops_max;
+    ops = realloc(ops, ops_max * sizeof(struct op));
+    if(ops == NULL) {
+      exit(1);
+    }
+  }
+  ops[nops].is_free = 1;
+  ops[nops].slot = slot;
+  ops[nops].size = slot_size[slot];
+  nops++;
+  live -= slot_size[slot];
+  free_slots[nfree_slots++] = slot;
+}
+/*---------------------------------------------------------------------------*/
+/* Consultas do Antelope */
+struct loaded {
+  uint16_t rel;
+  uint16_t attr[DB_MAX_ATTRIBUTES_PER_RELATION];
+  uint8_t element_size[DB_MAX_ATTRIBUTES_PER_RELATION];
+  uint8_t nattr;
+  uint16_t row_length;
+};
+
+enum { S_LOAD, S_INDEX, S_SELECT, S_ROWS, S_DONE };
+
+struct session {
+  uint8_t state;
+  struct loaded src;
+  uint8_t has_index;
+  uint16_t index, index_data;
+  uint16_t result, result_attr[DB_MAX_ATTRIBUTES_PER_RELATION];
+  uint8_t nresult;
+  uint16_t result_row, bytecode;
+  uint8_t rows_left;
+};
+
+static struct session sessions[BENCH_MAX_SESSIONS];
+static struct loaded cache[BENCH_RELATION_CACHE];
+static unsigned ncached;
+
+static void
+release(struct loaded *l)
+{
+  uint8_t i;
+
+  for(i = 0; i < l->nattr; i++) {
+    trace_free(l->attr[i]);
+  }
+  trace_free(l->rel);
+}
+
+static void
+load(struct loaded *l)
+{
+  static const uint8_t sizes[] = { 1, 2, 4, 4, 8, DB_MAX_ELEMENT_SIZE };
+  uint8_t i;
+
+  l->rel = trace_alloc(sizeof(relation_t));
+  l->nattr = 2 + random_rand() % (DB_MAX_ATTRIBUTES_PER_RELATION - 1);
+  l->row_length = 0;
+  for(i = 0; i < l->nattr; i++) {
+    l->attr[i] = trace_alloc(sizeof(attribute_t));
+    l->element_size[i] = sizes[random_rand() % sizeof(sizes)];
+    l->row_length += l->element_size[i];
+  }
+}
+
+/* Avança uma consulta um passo; devolve 1 quando ela termina */
+static int
+step(struct session *s)
+{
+  uint16_t row_length;
+  uint8_t i;
+
+  switch(s->state) {
+  case S_LOAD:
+    load(&s->src);
+    s->state = S_INDEX;
+    break;
+  case S_INDEX:
+    s->has_index = random_rand() & 1;
+    if(s->has_index) {
+      s->index = trace_alloc(sizeof(index_t));
+      s->index_data = trace_alloc(random_rand() & 1 ?
+                                  sizeof(struct bench_heap) :
+                                  BENCH_HASH_MAP_SIZE);
+    }
+    s->state = S_SELECT;
+    break;
+  case S_SELECT:
+    s->result = trace_alloc(sizeof(relation_t));
+    s->nresult = 1 + random_rand() % s->src.nattr;
+    row_length = 0;
+    for(i = 0; i < s->nresult; i++) {
+      s->result_attr[i] = trace_alloc(sizeof(attribute_t));
+      row_length += s->src.element_size[i];
+    }
+    s->result_row = trace_alloc(row_length);
+    s->bytecode = trace_alloc(DB_VM_BYTECODE_SIZE);
+    s->rows_left = 1 + random_rand() % BENCH_MAX_ROWS;
+    s->state = S_ROWS;
+    break;
+  case S_ROWS:
+    trace_free(trace_alloc(s->src.row_length));
+    if(--s->rows_left == 0) {
+      s->state = S_DONE;
+    }
+    break;
+  case S_DONE:
+    trace_free(s->bytecode);
+    trace_free(s->result_row);
+    for(i = 0; i < s->nresult; i++) {
+      trace_free(s->result_attr[i]);
+    }
+    trace_free(s->result);
+    if(s->has_index) {
+      trace_free(s->index_data);
+      trace_free(s->index);
+    }
+    /* A relação fica no cache; sai a mais antiga */
+    if(ncached == BENCH_RELATION_CACHE) {
+      release(&cache[0]);
+      memmove(&cache[0], &cache[1], (ncached - 1) * sizeof(cache[0]));
+      ncached--;
+    }
+    cache[ncached++] = s->src;
+    s->state = S_LOAD;
+    return 1;
+  }
+  return 0;
+}
+
+static void
+make_trace(unsigned long queries, unsigned nsessions)
+{
+  unsigned i;
+
+  for(i = 0; i < BENCH_SLOTS; i++) {
+    free_slots[i] = BENCH_SLOTS - 1 - i;
+  }
+  nfree_slots = BENCH_SLOTS;
+  while(queries > 0) {
+    if(step(&sessions[random_rand() % nsessions])) {
+      queries--;
+    }
+  }
+  /* Termina as consultas abertas e esvazia o cache: o heap acaba vazio */
+  for(i = 0; i < nsessions; i++) {
+    if(sessions[i].state != S_LOAD) {
+      while(!step(&sessions[i]));
+    }
+  }
+  while(ncached > 0) {
+    release(&cache[--ncached]);
+  }
+}
+/*---------------------------------------------------------------------------*/
+/* Alocadores */
+struct allocator {
+  const char *name;
+  void (*init)(void);
+  void *(*alloc)(uint16_t slot, size_t size);
+  void (*free)(uint16_t slot);
+  void *(*ptr)(uint16_t slot);
+};
+
+static void *ptrs[BENCH_SLOTS];
+static struct mmem handles[BENCH_SLOTS];
+
+static void *
+slot_ptr(uint16_t slot)
+{
+  return ptrs[slot];
+}
+
+static void
+tlsf_bench_init(void)
+{
+  tlsf_init();
+}
+static void *
+tlsf_bench_alloc(uint16_t slot, size_t size)
+{
+  return ptrs[slot] = tlsf_alloc(size);
+}
+static void
+tlsf_bench_free(uint16_t slot)
+{
+  tlsf_free(ptrs[slot]);
+}
+
+static void *
+mmem_bench_alloc(uint16_t slot, size_t size)
+{
+  return mmem_alloc(&handles[slot], size) ? MMEM_PTR(&handles[slot]) : NULL;
+}
+static void
+mmem_bench_free(uint16_t slot)
+{
+  mmem_free(&handles[slot]);
+}
+static void *
+mmem_bench_ptr(uint16_t slot)
+{
+  return MMEM_PTR(&handles[slot]);
+}
+
+static void
+malloc_bench_init(void)
+{
+}
+static void *
+malloc_bench_alloc(uint16_t slot, size_t size)
+{
+  return ptrs[slot] = malloc(size);
+}
+static void
+malloc_bench_free(uint16_t slot)
+{
+  free(ptrs[slot]);
+}
+
+static const struct allocator allocators[] = {
+  { "tlsf", tlsf_bench_init, tlsf_bench_alloc, tlsf_bench_free, slot_ptr },
+  { "mmem", mmem_init, mmem_bench_alloc, mmem_bench_free, mmem_bench_ptr },
+  { "malloc", malloc_bench_init, malloc_bench_alloc, malloc_bench_free,
+    slot_ptr },
+};
+/*---------------------------------------------------------------------------*/
+static double
+now_ns(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+/* Custo de duas leituras do relógio, descontado de cada medida */
+static double
+timer_overhead(void)
+{
+  double t0, best = 1e9;
+  int i;
+
+  for(i = 0; i < 1000; i++) {
+    t0 = now_ns();
+    t0 = now_ns() - t0;
+    if(t0 < best) {
+      best = t0;
+    }
+  }
+  return best;
+}
+
+/* Primeiro e último byte do bloco (o mesmo byte se size == 1) */
+static void
+mark(unsigned char *p, const struct op *o)
+{
+  p[o->size - 1] = o->slot >> 8;
+  p[0] = o->slot;
+}
+
+static int
+marked(unsigned char *p, const struct op *o)
+{
+  return p[0] == (o->slot & 0xff) &&
+    (o->size == 1 || p[o->size - 1] == o->slot >> 8);
+}
+
+/* Histograma em ns para o percentil 99; o máximo no host é ruído do SO */
+#define HIST_NS 4096
+struct timing {
+  double sum;
+  unsigned long n;
+  unsigned long hist[HIST_NS];
+};
+
+static void
+timing_add(struct timing *tm, double ns)
+{
+  tm->sum += ns;
+  tm->n++;
+  tm->hist[ns < 0 ? 0 : ns >= HIST_NS - 1 ? HIST_NS - 1 : (unsigned)ns]++;
+}
+
+static unsigned
+timing_p99(const struct timing *tm)
+{
+  unsigned long seen = 0;
+  unsigned i;
+
+  for(i = 0; i < HIST_NS - 1; i++) {
+    seen += tm->hist[i];
+    if(seen * 100 >= tm->n * 99) {
+      break;
+    }
+  }
+  return i;
+}
+
+static void
+replay(const struct allocator *a, double overhead)
+{
+  static uint8_t live_slot[BENCH_SLOTS];
+  static struct timing talloc, tfree;
+  unsigned long i, failures = 0, corrupt = 0;
+  double t;
+  unsigned char frag_max = 0;
+  struct tlsf_stats st;
+  const struct op *o;
+  void *p;
+
+  a->init();
+  memset(live_slot, 0, sizeof(live_slot));
+  memset(&talloc, 0, sizeof(talloc));
+  memset(&tfree, 0, sizeof(tfree));
+  for(i = 0; i < nops; i++) {
+    o = &ops[i];
+    if(!o->is_free) {
+      t = now_ns();
+      p = a->alloc(o->slot, o->size);
+      timing_add(&talloc, now_ns() - t - overhead);
+      if(p == NULL) {
+        failures++;
+        continue;
+      }
+      live_slot[o->slot] = 1;
+      mark(p, o);
+    } else if(live_slot[o->slot]) {
+      if(!marked(a->ptr(o->slot), o)) {
+        corrupt++;
+      }
+      t = now_ns();
+      a->free(o->slot);
+      timing_add(&tfree, now_ns() - t - overhead);
+      live_slot[o->slot] = 0;
+    }
+    if(a->init == tlsf_bench_init) {
+      tlsf_stats(&st);
+      if(st.fragmentation > frag_max) {
+        frag_max = st.fragmentation;
+      }
+    }
+  }
+
+  printf("%-7s alloc %.1f ns (p99 %u), free %.1f ns (p99 %u), "
+         "failures %lu, corrupt %lu\n", a->name,
+         talloc.n ? talloc.sum / talloc.n : 0.0, timing_p99(&talloc),
+         tfree.n ? tfree.sum / tfree.n : 0.0, timing_p99(&tfree),
+         failures, corrupt);
+  if(a->init == tlsf_bench_init) {
+    tlsf_stats(&st);
+    printf("%-7s peak used %lu bytes, fragmentation max %u%%, "
+           "at the end %u blocks, %lu bytes free in one block: %s\n", "",
+           (unsigned long)st.max_used, frag_max, st.blocks,
+           (unsigned long)st.free,
+           st.largest_free == st.free ? "yes" : "no (error)");
+  }
+}
+/*---------------------------------------------------------------------------*/
+PROCESS_THREAD(alloc_bench_process, ev, data)
+{
+  unsigned long queries;
+  unsigned nsessions, i;
+  double overhead;
+
+  PROCESS_BEGIN();
+
+  queries = contiki_argc > 1 ? strtoul(contiki_argv[1], NULL, 0) :
+    BENCH_DEFAULT_QUERIES;
+  nsessions = contiki_argc > 2 ? strtoul(contiki_argv[2], NULL, 0) :
+    BENCH_DEFAULT_SESSIONS;
+  if(queries == 0 || nsessions == 0 || nsessions > BENCH_MAX_SESSIONS) {
+    printf("alloc_bench: nothing to do\n");
+    exit(1);
+  }
+
+  random_init(1);
+  make_trace(queries, nsessions);
+  printf("alloc_bench: %lu queries, %u open, %lu operations, "
+         "peak %lu bytes live\n", queries, nsessions, nops, peak_live);
+
+  overhead = timer_overhead();
+  for(i = 0; i < sizeof(allocators) / sizeof(allocators[0]); i++) {
+    replay(&allocators[i], overhead);
+  }
+  exit(0);
+
+  PROCESS_END();
+}
+/*---------------------------------------------------------------------------*/
@@ -0,0 +1,675 @@
+/*
+ * Benchmark do Coffee (core/cfs/cfs-coffee.c) no native.
+ *
+ * Uso: ./coffee_bench.native [arquivos] [aberturas]
+ *
+ * O benchmark troca o xmem do native por uma flash emulada do mesmo
+ * tamanho que conta as leituras, as escritas e os apagamentos de setor
+ * feitos pelo Coffee: no hardware é a quantidade de acessos à flash,
+ * e não o tempo no host, que decide o custo. Como numa flash de
+ * verdade, uma escrita só liga bits (o Coffee vê a flash apagada como
+ * zeros); a flash emulada conta os bytes em que a escrita precisaria
+ * desligar bits já gravados (o isolamento de páginas do coletor de
+ * lixo grava cabeçalhos sobre dados obsoletos e aparece aí).
+ *
+ * Fases:
+ *   create: cria os arquivos pequenos com cfs_coffee_reserve() e os
+ *           preenche, como o Antelope e o store-and-forward fazem;
+ *   open:   depois de um "reboot" (estado do Coffee na RAM zerado),
+ *           abre arquivos existentes ao acaso, confere o começo e fecha;
+ *   miss:   abre para leitura nomes que não existem;
+ *   remove: remove os arquivos de número par;
+ *   check:  abre todos os arquivos: os removidos não podem abrir e os
+ *           outros têm de manter o conteúdo, também depois de outro
+ *           "reboot";
+ *   churn:  troca o arquivo mais antigo por outro de 400, 1000 ou 4000
+ *           bytes, como num store-and-forward, até a flash encher
+ *           várias vezes, o que faz o coletor de lixo rodar; entre as
+ *           operações o processo cede a vez, e o coletor incremental
+ *           (COFFEE_GC_PROCESS) roda aí; depois todos os arquivos são
+ *           conferidos;
+ *   burst:  pede espaço com cfs_coffee_reclaim() (com o coletor
+ *           incremental), espera o coletor e grava de uma vez um
+ *           arquivo de 128 KB, como antes de uma rajada prevista;
+ *   append: numa flash formatada de novo, reserva três logs grandes e
+ *           os enche até 6%, 50% e 94% com registros pequenos;
+ *   reopen: depois de um "reboot", abre cada log com CFS_APPEND, o que
+ *           obriga o Coffee a achar o fim dos dados, e confere o fim;
+ *   update: com micro logs (MICRO_LOGS=1), reescreve linhas de 32 bytes
+ *           de uma tabela em sequências de 8 linhas a partir de uma
+ *           linha ao acaso, com uma escrita de 8 bytes por atributo,
+ *           como o storage_put_row() do Antelope; depois de um "reboot"
+ *           a tabela inteira é conferida. Com buffers de escrita
+ *           (WRITE_BUFFERS=1) a fase roda de novo como "buffered", com
+ *           CFS_COFFEE_IO_BUFFERED no descritor.
+ *
+ * Para cada fase: leituras, bytes lidos, escritas e bytes gravados por
+ * operação, o
+ * máximo de leituras e de apagamentos numa só operação (os picos de
+ * latência no hardware), os apagamentos feitos fora das operações
+ * pelo coletor incremental, tempo no host e erros (conteúdo errado ou
+ * resultado inesperado).
+ */
+
+#include "contiki.h"
+#include "cfs/cfs.h"
+#include "cfs/cfs-coffee.h"
+#include "dev/xmem.h"
+#include "lib/random.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/*---------------------------------------------------------------------------*/
+#define BENCH_DEFAULT_FILES 200
+#define BENCH_DEFAULT_OPENS 2000
+#define BENCH_FILE_SIZE     400
+#define BENCH_MAX_FILES     1000
+#define BENCH_LOGS          3
+#define BENCH_LOG_SIZE      (256 * 1024UL)
+#define BENCH_RECORD_SIZE   64
+#define BENCH_BURST_SIZE    (128 * 1024UL)
+#define BENCH_ROW_SIZE      32
+#define BENCH_ROWS          512
+#define BENCH_ROW_RUN       8
+#define BENCH_ATTR_SIZE     8
+
+/* Mesmo tamanho do xmem do native (platform/native/dev/xmem.c) */
+#define FLASH_SIZE (1024UL * 1024UL)
+
+extern int contiki_argc;
+extern char **contiki_argv;
+
+PROCESS(coffee_bench_process, "coffee benchmark");
+AUTOSTART_PROCESSES(&coffee_bench_process);
+/*---------------------------------------------------------------------------*/
+/* Flash emulada: apagada é zero, como no xmem do native */
+static unsigned char flash[FLASH_SIZE];
+
+struct flash_stats {
+  unsigned long reads;
+  unsigned long read_bytes;
+  unsigned long writes;
+  unsigned long write_bytes;
+  unsigned long erases;
+  unsigned long overwrites;
+};
+
+static struct flash_stats fs;
+
+int
+xmem_pread(void *buf, int size, unsigned long offset)
+{
+  fs.reads++;
+  fs.read_bytes += size;
+  memcpy(buf, &flash[offset], size);
+  return size;
+}
+
+int
+xmem_pwrite(const void *buf, int size, unsigned long offset)
+{
+  const unsigned char *p = buf;
+  int i;
+
+  fs.writes++;
+  fs.write_bytes += size;
+  for(i = 0; i < size; i++) {
+    if(flash[offset + i] & ~p[i]) {
+      fs.overwrites++;
+    }
+    flash[offset + i] |= p[i];
+  }
+  return size;
+}
+
+int
+xmem_erase(long size, unsigned long offset)
+{
+  fs.erases++;
+  memset(&flash[offset], 0, size);
+  return size;
+}
+
+void
+xmem_init(void)
+{
+}
+/*---------------------------------------------------------------------------*/
+static double
+now_us(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+/* Zera o estado do Coffee na RAM, como depois de reiniciar o nó */
+static void
+reboot(void)
+{
+  unsigned size;
+  void *mem;
+
+  mem = cfs_coffee_get_protected_mem(&size);
+  memset(mem, 0, size);
+}
+
+static void
+file_name(char *name, const char *prefix, unsigned i)
+{
+  snprintf(name, 16, "%s%u", prefix, i);
+}
+
+/* Conteúdo do arquivo i: o primeiro byte nunca é zero */
+static unsigned char
+file_byte(unsigned i, unsigned pos)
+{
+  return (unsigned char)(i * 7 + pos) | 1;
+}
+
+/* Tamanho de cada arquivo; zero se não existe */
+static unsigned file_size[BENCH_MAX_FILES];
+
+static struct flash_stats start_stats, op_stats;
+static unsigned long max_reads, max_erases, op_erases;
+static double start_time;
+
+static void
+phase_begin(void)
+{
+  start_stats = fs;
+  max_reads = max_erases = op_erases = 0;
+  start_time = now_us();
+}
+
+static void
+op_begin(void)
+{
+  op_stats = fs;
+}
+
+static void
+op_end(void)
+{
+  if(fs.reads - op_stats.reads > max_reads) {
+    max_reads = fs.reads - op_stats.reads;
+  }
+  if(fs.erases - op_stats.erases > max_erases) {
+    max_erases = fs.erases - op_stats.erases;
+  }
+  op_erases += fs.erases - op_stats.erases;
+}
+
+static void
+phase_end(const char *name, unsigned long ops, unsigned long errors)
+{
+  double us = now_us() - start_time;
+
+  printf("%-8s %6lu ops %8.1f reads/op %9.1f bytes read/op "
+         "%6.2f writes/op %8.1f bytes written/op %8.2f us/op, errors %lu\n",
+         name, ops,
+         (double)(fs.reads - start_stats.reads) / ops,
+         (double)(fs.read_bytes - start_stats.read_bytes) / ops,
+         (double)(fs.writes - start_stats.writes) / ops,
+         (double)(fs.write_bytes - start_stats.write_bytes) / ops,
+         us / ops, errors);
+  printf("%-8s max %lu reads, %lu erases in one op; %lu erases in total, "
+         "%lu between ops\n", "", max_reads, max_erases,
+         fs.erases - start_stats.erases,
+         fs.erases - start_stats.erases - op_erases);
+}
+/*---------------------------------------------------------------------------*/
+/* Cria e preenche o arquivo i; devolve 1 se falhou */
+static int
+create_file(unsigned i, unsigned size)
+{
+  static unsigned char buf[4000];
+  char name[16];
+  unsigned j;
+  int fd, n;
+
+  file_name(name, "f", i);
+  for(j = 0; j < size; j++) {
+    buf[j] = file_byte(i, j);
+  }
+  if(cfs_coffee_reserve(name, size) < 0) {
+    return 1;
+  }
+  fd = cfs_open(name, CFS_WRITE);
+  if(fd < 0) {
+    return 1;
+  }
+  n = cfs_write(fd, buf, size);
+  cfs_close(fd);
+  if(n != (int)size) {
+    return 1;
+  }
+  file_size[i] = size;
+  return 0;
+}
+
+static unsigned long
+create_files(unsigned nfiles)
+{
+  unsigned long errors = 0;
+  unsigned i;
+
+  for(i = 0; i < nfiles; i++) {
+    op_begin();
+    errors += create_file(i, BENCH_FILE_SIZE);
+    op_end();
+  }
+  return errors;
+}
+
+static unsigned long
+open_files(unsigned nfiles, unsigned long nopens)
+{
+  unsigned char buf[4];
+  char name[16];
+  unsigned long errors = 0, n;
+  unsigned i, j;
+  int fd;
+
+  for(n = 0; n < nopens; n++) {
+    i = random_rand() % nfiles;
+    file_name(name, "f", i);
+    op_begin();
+    fd = cfs_open(name, CFS_READ);
+    op_end();
+    if(fd < 0) {
+      errors++;
+      continue;
+    }
+    if(cfs_read(fd, buf, sizeof(buf)) != sizeof(buf)) {
+      errors++;
+    } else {
+      for(j = 0; j < sizeof(buf); j++) {
+        if(buf[j] != file_byte(i, j)) {
+          errors++;
+          break;
+        }
+      }
+    }
+    cfs_close(fd);
+  }
+  return errors;
+}
+
+static unsigned long
+open_missing(unsigned long nopens)
+{
+  char name[16];
+  unsigned long errors = 0, n;
+  int fd;
+
+  for(n = 0; n < nopens; n++) {
+    file_name(name, "x", n);
+    op_begin();
+    fd = cfs_open(name, CFS_READ);
+    op_end();
+    if(fd >= 0) {
+      errors++;
+      cfs_close(fd);
+    }
+  }
+  return errors;
+}
+
+static unsigned long
+remove_files(unsigned nfiles)
+{
+  char name[16];
+  unsigned long errors = 0;
+  unsigned i;
+
+  for(i = 0; i < nfiles; i += 2) {
+    file_name(name, "f", i);
+    op_begin();
+    if(cfs_remove(name) < 0) {
+      errors++;
+    }
+    op_end();
+    file_size[i] = 0;
+  }
+  return errors;
+}
+
+static unsigned long
+check_files(unsigned nfiles)
+{
+  unsigned char c;
+  char name[16];
+  unsigned long errors = 0;
+  unsigned i;
+  int fd;
+
+  for(i = 0; i < nfiles; i++) {
+    file_name(name, "f", i);
+    op_begin();
+    fd = cfs_open(name, CFS_READ);
+    op_end();
+    if(file_size[i] == 0) {
+      if(fd >= 0) {
+        errors++;
+        cfs_close(fd);
+      }
+      continue;
+    }
+    if(fd < 0) {
+      errors++;
+      continue;
+    }
+    if(cfs_seek(fd, file_size[i] - 1, CFS_SEEK_SET) < 0 ||
+       cfs_read(fd, &c, 1) != 1 || c != file_byte(i, file_size[i] - 1)) {
+      errors++;
+    }
+    cfs_close(fd);
+  }
+  return errors;
+}
+
+/* Operação n do churn; devolve os erros */
+static unsigned long
+churn_file(unsigned nfiles, unsigned long n)
+{
+  static const unsigned sizes[] = { 400, 1000, 4000 };
+  char name[16];
+  unsigned long errors = 0;
+  unsigned i;
+
+  i = n % nfiles;
+  op_begin();
+  if(file_size[i] != 0) {
+    file_name(name, "f", i);
+    if(cfs_remove(name) < 0) {
+      errors++;
+    }
+    file_size[i] = 0;
+  }
+  errors += create_file(i, sizes[random_rand() % 3]);
+  op_end();
+  return errors;
+}
+
+/* Grava o arquivo da rajada de uma vez; devolve os erros */
+static unsigned long
+write_burst(void)
+{
+  static unsigned char buf[4096];
+  unsigned long errors = 0, written;
+  unsigned j;
+  int fd;
+
+  op_begin();
+  if(cfs_coffee_reserve("burst", BENCH_BURST_SIZE) < 0) {
+    op_end();
+    return 1;
+  }
+  fd = cfs_open("burst", CFS_WRITE);
+  for(written = 0; fd >= 0 && written < BENCH_BURST_SIZE;
+      written += sizeof(buf)) {
+    for(j = 0; j < sizeof(buf); j++) {
+      buf[j] = file_byte(BENCH_MAX_FILES, written + j);
+    }
+    if(cfs_write(fd, buf, sizeof(buf)) != sizeof(buf)) {
+      errors++;
+      break;
+    }
+  }
+  if(fd < 0) {
+    errors++;
+  }
+  cfs_close(fd);
+  op_end();
+  return errors;
+}
+
+/* Dados em cada log: 6%, 50% e 94% do espaço reservado */
+static const unsigned long log_fill[BENCH_LOGS] = {
+  BENCH_LOG_SIZE / 16, BENCH_LOG_SIZE / 2, BENCH_LOG_SIZE / 16 * 15
+};
+
+static unsigned long
+append_logs(unsigned long *nrecords)
+{
+  unsigned char record[BENCH_RECORD_SIZE];
+  char name[16];
+  unsigned long errors = 0, written;
+  unsigned i, j;
+  int fd;
+
+  *nrecords = 0;
+  for(i = 0; i < BENCH_LOGS; i++) {
+    file_name(name, "log", i);
+    if(cfs_coffee_reserve(name, BENCH_LOG_SIZE) < 0) {
+      errors++;
+      continue;
+    }
+    for(written = 0; written < log_fill[i]; written += sizeof(record)) {
+      for(j = 0; j < sizeof(record); j++) {
+        record[j] = file_byte(i, written + j);
+      }
+      op_begin();
+      fd = cfs_open(name, CFS_WRITE | CFS_APPEND);
+      if(fd < 0 || cfs_write(fd, record, sizeof(record)) != sizeof(record)) {
+        errors++;
+      }
+      cfs_close(fd);
+      op_end();
+      (*nrecords)++;
+    }
+  }
+  return errors;
+}
+
+static unsigned long
+reopen_logs(void)
+{
+  char name[16];
+  unsigned long errors = 0;
+  unsigned i;
+  int fd;
+
+  for(i = 0; i < BENCH_LOGS; i++) {
+    file_name(name, "log", i);
+    reboot();
+    op_begin();
+    fd = cfs_open(name, CFS_WRITE | CFS_APPEND);
+    op_end();
+    if(fd < 0) {
+      errors++;
+      continue;
+    }
+    if(cfs_seek(fd, 0, CFS_SEEK_CUR) != log_fill[i]) {
+      errors++;
+    }
+    cfs_close(fd);
+  }
+  return errors;
+}
+#if COFFEE_CONF_MICRO_LOGS
+/* Cópia na RAM da tabela do update */
+static unsigned char table[BENCH_ROWS * BENCH_ROW_SIZE];
+
+/* Cria a tabela, já preenchida: as reescritas vão para o micro log */
+static unsigned long
+create_table(void)
+{
+  unsigned i;
+  int fd, n;
+
+  for(i = 0; i < sizeof(table); i++) {
+    table[i] = file_byte(0, i);
+  }
+  cfs_remove("table");
+  if(cfs_coffee_reserve("table", sizeof(table)) < 0) {
+    return 1;
+  }
+  fd = cfs_open("table", CFS_WRITE);
+  n = fd < 0 ? -1 : cfs_write(fd, table, sizeof(table));
+  cfs_close(fd);
+  return n != (int)sizeof(table);
+}
+
+/* Reescreve nrows linhas; devolve os erros */
+static unsigned long
+update_rows(unsigned long nrows, unsigned io_flags)
+{
+  unsigned char attr[BENCH_ATTR_SIZE];
+  unsigned long errors = 0, n;
+  unsigned row = 0, a, j, pos;
+  int fd;
+
+  fd = cfs_open("table", CFS_READ | CFS_WRITE);
+  if(fd < 0) {
+    return 1;
+  }
+  if(io_flags != 0 && cfs_coffee_set_io_semantics(fd, io_flags) < 0) {
+    cfs_close(fd);
+    return 1;
+  }
+  for(n = 0; n < nrows; n++) {
+    if(n % BENCH_ROW_RUN == 0) {
+      row = random_rand() % (BENCH_ROWS - BENCH_ROW_RUN + 1);
+    } else {
+      row++;
+    }
+    op_begin();
+    if(cfs_seek(fd, row * BENCH_ROW_SIZE, CFS_SEEK_SET) < 0) {
+      errors++;
+    }
+    for(a = 0; a < BENCH_ROW_SIZE / BENCH_ATTR_SIZE; a++) {
+      pos = row * BENCH_ROW_SIZE + a * BENCH_ATTR_SIZE;
+      for(j = 0; j < sizeof(attr); j++) {
+        attr[j] = table[pos + j] = file_byte(n, pos + j);
+      }
+      if(cfs_write(fd, attr, sizeof(attr)) != sizeof(attr)) {
+        errors++;
+      }
+    }
+    op_end();
+  }
+  op_begin();
+  cfs_close(fd);
+  op_end();
+  return errors;
+}
+
+/* Confere a tabela inteira depois de um "reboot" */
+static unsigned long
+check_table(void)
+{
+  static unsigned char buf[sizeof(table)];
+  int fd, n;
+
+  reboot();
+  fd = cfs_open("table", CFS_READ);
+  n = fd < 0 ? -1 : cfs_read(fd, buf, sizeof(buf));
+  cfs_close(fd);
+  return n != (int)sizeof(buf) || memcmp(buf, table, sizeof(buf)) != 0;
+}
+#endif /* COFFEE_CONF_MICRO_LOGS */
+/*---------------------------------------------------------------------------*/
+PROCESS_THREAD(coffee_bench_process, ev, data)
+{
+  /* Estáticas: o processo cede a vez no churn e na rajada */
+  static unsigned nfiles;
+  static unsigned long nopens, nrecords, errors, n;
+
+  PROCESS_BEGIN();
+
+  nfiles = contiki_argc > 1 ? strtoul(contiki_argv[1], NULL, 0) :
+    BENCH_DEFAULT_FILES;
+  nopens = contiki_argc > 2 ? strtoul(contiki_argv[2], NULL, 0) :
+    BENCH_DEFAULT_OPENS;
+  if(nfiles == 0 || nfiles > BENCH_MAX_FILES || nopens == 0) {
+    printf("coffee_bench: nothing to do\n");
+    exit(1);
+  }
+
+  printf("coffee_bench: %u files of %u bytes, %lu opens, "
+         "name index %u entries, free map %u, gc process %u\n", nfiles,
+         BENCH_FILE_SIZE, nopens, COFFEE_NAME_INDEX_SIZE, COFFEE_FREE_MAP,
+         COFFEE_GC_PROCESS);
+
+  random_init(1);
+  cfs_coffee_format();
+  memset(&fs, 0, sizeof(fs));
+
+  phase_begin();
+  phase_end("create", nfiles, create_files(nfiles));
+
+  reboot();
+  phase_begin();
+  phase_end("open", nopens, open_files(nfiles, nopens));
+
+  phase_begin();
+  phase_end("miss", nopens, open_missing(nopens));
+
+  phase_begin();
+  phase_end("remove", (nfiles + 1) / 2, remove_files(nfiles));
+
+  phase_begin();
+  phase_end("check", nfiles, check_files(nfiles));
+
+  reboot();
+  phase_begin();
+  phase_end("check", nfiles, check_files(nfiles));
+
+  phase_begin();
+  errors = 0;
+  for(n = 0; n < nopens; n++) {
+    errors += churn_file(nfiles, n);
+    /* Tempo ocioso entre as operações */
+    PROCESS_PAUSE();
+  }
+  phase_end("churn", nopens, errors);
+
+  phase_begin();
+#if COFFEE_GC_PROCESS
+  while(cfs_coffee_reclaim(BENCH_BURST_SIZE) > 0) {
+    PROCESS_PAUSE();
+  }
+#endif
+  phase_end("burst", 1, write_burst());
+
+  reboot();
+  phase_begin();
+  phase_end("check", nfiles, check_files(nfiles));
+
+  cfs_coffee_format();
+  reboot();
+  phase_begin();
+  errors = append_logs(&nrecords);
+  phase_end("append", nrecords, errors);
+
+  phase_begin();
+  phase_end("reopen", BENCH_LOGS, reopen_logs());
+
+#if COFFEE_CONF_MICRO_LOGS
+  errors = create_table();
+  phase_begin();
+  errors += update_rows(nopens, 0);
+  errors += check_table();
+  phase_end("update", nopens, errors);
+
+#if COFFEE_WRITE_BUFFERS > 0
+  errors = create_table();
+  phase_begin();
+  errors += update_rows(nopens, CFS_COFFEE_IO_BUFFERED);
+  errors += check_table();
+  phase_end("buffered", nopens, errors);
+#endif
+#endif /* COFFEE_CONF_MICRO_LOGS */
+
+  printf("flash: %lu erases, %lu overwritten bytes\n",
+         fs.erases, fs.overwrites);
+  exit(0);
+
+  PROCESS_END();
+}
+/*---------------------------------------------------------------------------*/
@@ -0,0 +1,199 @@
+/*
+ * Benchmark dos etimers: roda a mesma carga com a roda de timers
+ * (ETIMER_CONF_WHEEL=1) e com a lista original (=0); "make bench" compila e
+ * roda as duas versões.
+ *
+ * Uso: ./etimer_bench.native [timers] [segundos por fase]
+ *
+ * Fases:
+ *   set/stop  arma e para todos os timers várias vezes (ns por operação)
+ *   idle      timers longos parados na fila e um timer de 1 tick que
+ *             expira sem parar: custo por expiração com a fila cheia
+ *   periodic  todos os timers periódicos (1 a 100 ms): expirações por
+ *             segundo, custo por expiração e atraso de entrega
+ *
+ * O custo das fases idle e periodic é o tempo gasto dentro do
+ * etimer_process (a thread dele é trocada por uma que mede cada chamada),
+ * sem o laço principal da plataforma native.
+ *
+ * O atraso é clock_time() na entrega menos etimer_expiration_time(): serve
+ * de verificação da roda, nenhum timer pode chegar antes da hora.
+ */
+
+#include "contiki.h"
+#include "lib/random.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/*---------------------------------------------------------------------------*/
+#define BENCH_DEFAULT_TIMERS  200
+#define BENCH_DEFAULT_SECONDS 2
+#define BENCH_ROUNDS          200
+
+extern int contiki_argc;
+extern char **contiki_argv;
+
+static struct etimer *timers;
+static unsigned ntimers;
+static unsigned long seconds;
+
+struct phase {
+  unsigned long polls;       /* chamadas ao etimer_process */
+  double ns;                 /* tempo dentro delas */
+  unsigned long expiries;
+  unsigned long early;       /* entregues antes da hora: erro */
+  unsigned long late_sum;    /* ticks */
+  clock_time_t late_max;
+};
+
+static struct phase ph;
+static PT_THREAD((* etimer_thread)(struct pt *, process_event_t,
+                                   process_data_t));
+
+PROCESS(etimer_bench_process, "etimer benchmark");
+AUTOSTART_PROCESSES(&etimer_bench_process);
+/*---------------------------------------------------------------------------*/
+static double
+now_ns(clockid_t id)
+{
+  struct timespec ts;
+
+  clock_gettime(id, &ts);
+  return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+/*---------------------------------------------------------------------------*/
+/* Thread do etimer_process com medição de tempo */
+static
+PT_THREAD(timed_etimer_thread(struct pt *pt, process_event_t ev,
+                              process_data_t data))
+{
+  double t0 = now_ns(CLOCK_MONOTONIC);
+  char r = etimer_thread(pt, ev, data);
+
+  ph.ns += now_ns(CLOCK_MONOTONIC) - t0;
+  ph.polls++;
+  return r;
+}
+/*---------------------------------------------------------------------------*/
+static void
+account(struct etimer *t)
+{
+  clock_time_t now = clock_time();
+  clock_time_t due = etimer_expiration_time(t);
+
+  ph.expiries++;
+  if((long)(now - due) < 0) {
+    ph.early++;
+    return;
+  }
+  ph.late_sum += now - due;
+  if(now - due > ph.late_max) {
+    ph.late_max = now - due;
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+report(const char *name)
+{
+  printf("%-9s %lu expiries (%lu/s), %lu polls, %.1f ns/expiry, "
+         "%.1f ns/poll\n", name, ph.expiries, ph.expiries / seconds,
+         ph.polls, ph.expiries ? ph.ns / ph.expiries : 0.0,
+         ph.polls ? ph.ns / ph.polls : 0.0);
+  printf("%-9s late avg %.2f max %lu ticks, early %lu\n", "",
+         ph.expiries ? (double)ph.late_sum / ph.expiries : 0.0,
+         (unsigned long)ph.late_max, ph.early);
+}
+/*---------------------------------------------------------------------------*/
+PROCESS_THREAD(etimer_bench_process, ev, data)
+{
+  static struct etimer phase_timer, fast;
+  static double t0, set_ns, stop_ns;
+  static unsigned i, r;
+
+  PROCESS_BEGIN();
+
+  ntimers = contiki_argc > 1 ? strtoul(contiki_argv[1], NULL, 0) :
+    BENCH_DEFAULT_TIMERS;
+  seconds = contiki_argc > 2 ? strtoul(contiki_argv[2], NULL, 0) :
+    BENCH_DEFAULT_SECONDS;
+  timers = calloc(ntimers ? ntimers : 1, sizeof(struct etimer));
+  if(timers == NULL || ntimers == 0 || seconds == 0) {
+    printf("etimer_bench: nothing to do\n");
+    exit(1);
+  }
+  random_init(1);
+  etimer_thread = etimer_process.thread;
+  etimer_process.thread = timed_etimer_thread;
+
+  printf("etimer_bench: %s, %u timers, %lu s per phase\n",
+         ETIMER_CONF_WHEEL ? "wheel" : "list", ntimers, seconds);
+
+  /* set/stop: intervalos de 1 a 60 s, nenhum expira durante a fase */
+  set_ns = stop_ns = 0;
+  for(r = 0; r < BENCH_ROUNDS; r++) {
+    t0 = now_ns(CLOCK_MONOTONIC);
+    for(i = 0; i < ntimers; i++) {
+      etimer_set(&timers[i], CLOCK_SECOND + random_rand() % (59 * CLOCK_SECOND));
+    }
+    set_ns += now_ns(CLOCK_MONOTONIC) - t0;
+    t0 = now_ns(CLOCK_MONOTONIC);
+    for(i = 0; i < ntimers; i++) {
+      etimer_stop(&timers[ntimers - 1 - i]);
+    }
+    stop_ns += now_ns(CLOCK_MONOTONIC) - t0;
+  }
+  printf("set/stop  set %.1f ns, stop %.1f ns\n",
+         set_ns / BENCH_ROUNDS / ntimers, stop_ns / BENCH_ROUNDS / ntimers);
+
+  /* idle: os timers longos ficam na fila; só o rápido expira */
+  for(i = 0; i < ntimers; i++) {
+    etimer_set(&timers[i], 120 * CLOCK_SECOND + random_rand() % CLOCK_SECOND);
+  }
+  memset(&ph, 0, sizeof(ph));
+  etimer_set(&phase_timer, seconds * CLOCK_SECOND);
+  etimer_set(&fast, 1);
+  while(1) {
+    PROCESS_WAIT_EVENT_UNTIL(ev == PROCESS_EVENT_TIMER);
+    if(data == &phase_timer) {
+      break;
+    }
+    if(data == &fast) {
+      account(&fast);
+      etimer_reset(&fast);
+    }
+  }
+  report("idle");
+  etimer_stop(&fast);
+
+  /* periodic: todos expiram e são rearmados com etimer_reset() */
+  for(i = 0; i < ntimers; i++) {
+    etimer_set(&timers[i], 1 + random_rand() % (CLOCK_SECOND / 10));
+  }
+  memset(&ph, 0, sizeof(ph));
+  etimer_set(&phase_timer, seconds * CLOCK_SECOND);
+  while(1) {
+    PROCESS_WAIT_EVENT_UNTIL(ev == PROCESS_EVENT_TIMER);
+    if(data == &phase_timer) {
+      break;
+    }
+    /* Evento do timer rápido já na fila quando a fase anterior acabou */
+    if((struct etimer *)data < timers ||
+       (struct etimer *)data >= timers + ntimers) {
+      continue;
+    }
+    account(data);
+    etimer_reset(data);
+  }
+  report("periodic");
+
+  for(i = 0; i < ntimers; i++) {
+    etimer_stop(&timers[i]);
+  }
+  printf("pending   %s\n", etimer_pending() ? "yes (error)" : "no");
+  exit(0);
+
+  PROCESS_END();
+}
+/*---------------------------------------------------------------------------*/
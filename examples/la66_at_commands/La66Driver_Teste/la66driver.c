@@ -113,26 +113,26 @@ const struct la_driver LA_DRIVER = {
 
 /*---------------------------------------------------------------------------*/
 /* Funções de callback (implementações básicas) */
-void handle_ok_response(struct at_cmd *cmd, uint8_t len, char *data) {
+void handle_ok_response(struct at_cmd *cmd, uint16_t len, char *data) {
   printf("APP: LA66 respondeu OK.\n");
 }
 
-void handle_error_response(struct at_cmd *cmd, uint8_t len, char *data) {
+void handle_error_response(struct at_cmd *cmd, uint16_t len, char *data) {
   printf("APP: LA66 respondeu ERROR: %.*s\n", len, data);
 }
 
-void handle_njs_response(struct at_cmd *cmd, uint8_t len, char *data) {
+void handle_njs_response(struct at_cmd *cmd, uint16_t len, char *data) {
   printf("APP: LA66 Status de Join: %.*s\n", len, data);
   if (strstr(data, "+NJS:1")) {
     state = LA_JOINED;
   }
 }
 
-void handle_version_response(struct at_cmd *cmd, uint8_t len, char *data) {
+void handle_version_response(struct at_cmd *cmd, uint16_t len, char *data) {
   printf("APP: LA66 Versão: %.*s\n", len, data);
 }
 
-void handle_join_accepted_response(struct at_cmd *cmd, uint8_t len, char *data) {
+void handle_join_accepted_response(struct at_cmd *cmd, uint16_t len, char *data) {
   printf("APP: LA66 Join Aceito: %.*s\n", len, data);
   state = LA_JOINED;
 }
\ No newline at end of file
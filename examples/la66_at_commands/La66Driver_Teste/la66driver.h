@@ -50,10 +50,10 @@ struct la_driver {
 extern const struct la_driver LA_DRIVER;
 
 // Protótipos das funções de callback (adicionados)
-void handle_ok_response(struct at_cmd *cmd, uint8_t len, char *data);
-void handle_error_response(struct at_cmd *cmd, uint8_t len, char *data);
-void handle_njs_response(struct at_cmd *cmd, uint8_t len, char *data);
-void handle_version_response(struct at_cmd *cmd, uint8_t len, char *data);
-void handle_join_accepted_response(struct at_cmd *cmd, uint8_t len, char *data);
+void handle_ok_response(struct at_cmd *cmd, uint16_t len, char *data);
+void handle_error_response(struct at_cmd *cmd, uint16_t len, char *data);
+void handle_njs_response(struct at_cmd *cmd, uint16_t len, char *data);
+void handle_version_response(struct at_cmd *cmd, uint16_t len, char *data);
+void handle_join_accepted_response(struct at_cmd *cmd, uint16_t len, char *data);
 
 #endif /* LA66_DRIVER_H */
\ No newline at end of file
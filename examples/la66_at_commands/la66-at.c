@@ -0,0 +1,55 @@
+/*
+ * Tabela de comandos e respostas AT do LA66 em PROGMEM
+ */
+
+#include "contiki.h"
+#include "at-master.h"
+#include "la66-at.h"
+#include <string.h>
+
+/*---------------------------------------------------------------------------*/
+/* Strings na flash */
+#define LA66_AT_CMD_STR(id, str) static const char cmd_##id[] PROGMEM = str;
+LA66_AT_COMMANDS(LA66_AT_CMD_STR)
+
+#define LA66_AT_RSP_STR(id, hdr, max, cb) \
+  static const char rsp_##id[] PROGMEM = hdr;
+LA66_AT_RESPONSES(LA66_AT_RSP_STR)
+
+/* Comandos por índice */
+#define LA66_AT_CMD_PTR(id, str) cmd_##id,
+static PGM_P const commands[LA66_AT_CMD_COUNT] PROGMEM = {
+  LA66_AT_COMMANDS(LA66_AT_CMD_PTR)
+};
+
+/* Registro de respostas lido pelo at-master (sizeof inclui o '\0') */
+#define LA66_AT_RSP_ENTRY(id, hdr, max, cb) \
+  { rsp_##id, sizeof(hdr) - 1, max, cb },
+static const struct at_entry responses[LA66_AT_RSP_COUNT] PROGMEM = {
+  LA66_AT_RESPONSES(LA66_AT_RSP_ENTRY)
+};
+/*---------------------------------------------------------------------------*/
+PGM_P
+la66_at_cmd(la66_at_cmd_t id)
+{
+  PGM_P p;
+
+  memcpy_P(&p, &commands[id], sizeof(p));
+  return p;
+}
+/*---------------------------------------------------------------------------*/
+PGM_P
+la66_at_rsp(la66_at_rsp_t id)
+{
+  PGM_P p;
+
+  memcpy_P(&p, &responses[id].cmd_header, sizeof(p));
+  return p;
+}
+/*---------------------------------------------------------------------------*/
+void
+la66_at_init(void)
+{
+  at_register_table(responses, LA66_AT_RSP_COUNT);
+}
+/*---------------------------------------------------------------------------*/
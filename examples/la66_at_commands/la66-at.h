@@ -0,0 +1,86 @@
+#ifndef LA66_AT_H_
+#define LA66_AT_H_
+
+#include "contiki.h"
+#include "at-master.h"
+
+/*
+ * Tabela declarativa dos comandos e respostas AT do LA66.
+ *
+ * As listas abaixo são X-macros, expandidas mais de uma vez: aqui geram os
+ * índices fixos (enums) e os protótipos dos handlers; em la66-at.c geram as
+ * strings em PROGMEM e o registro const de respostas que o at-master lê com
+ * pgm_read_byte(). Nenhum comando ou cabeçalho ocupa SRAM e nenhuma
+ * struct at_cmd é montada em tempo de execução.
+ *
+ * Para um comando novo basta uma linha em LA66_AT_COMMANDS; para uma
+ * resposta nova, uma linha em LA66_AT_RESPONSES e o handler (não static)
+ * no módulo que a trata.
+ */
+
+/* Downlinks (la66-downlink.c) tratados antes do handler padrão */
+#ifndef LA66_CONF_DOWNLINK
+#define LA66_CONF_DOWNLINK 1
+#endif
+
+/* Comandos: C(id, string enviada) */
+#define LA66_AT_COMMANDS(C)                                             \
+  C(RESET,      "ATZ\r\n")                                              \
+  C(JOIN,       "AT+JOIN\r\n")                                          \
+  C(GET_STATUS, "AT+NJS=?\r\n")                                         \
+  C(CFG,        "AT+CFG\r\n")                                           \
+  C(SLEEP,      "AT+SLEEP=1\r\n")                                       \
+  C(WAKE,       "AT+SLEEP=0\r\n")                                       \
+  C(SENDB,      "AT+SENDB=")
+
+/* Respostas: R(id, cabeçalho, tamanho máximo da linha, handler). Vence o
+   cabeçalho mais longo; em empate, o que vem antes. "" é o padrão para
+   linhas sem outro handler, inclusive o payload dos downlinks ("255:" e
+   os bytes já decodificados pela Soft UART, limitados pelo slot). */
+#if LA66_CONF_DOWNLINK
+#define LA66_AT_DOWNLINK_RESPONSES(R)                                   \
+  R(RSSI,       "Rssi=",        64,  la66_downlink_rssi)                \
+  R(RECEIVE,    "Receive data", 64,  la66_downlink_receive)
+#else
+#define LA66_AT_DOWNLINK_RESPONSES(R)
+#endif
+
+#define LA66_AT_RESPONSES(R)                                            \
+  R(OK,         "OK",           64,  la66_handle_ok)                    \
+  R(ERROR,      "ERROR",        64,  la66_handle_error)                 \
+  R(NJS,        "+NJS:",        64,  la66_handle_njs)                   \
+  R(JOINED,     "JOINED",       64,  la66_handle_joined)                \
+  LA66_AT_DOWNLINK_RESPONSES(R)                                         \
+  R(DEFAULT,    "",             512, la66_handle_default)
+
+/* Índices fixos */
+#define LA66_AT_CMD_ID(id, str) LA66_AT_CMD_##id,
+typedef enum {
+  LA66_AT_COMMANDS(LA66_AT_CMD_ID)
+  LA66_AT_CMD_COUNT
+} la66_at_cmd_t;
+#undef LA66_AT_CMD_ID
+
+#define LA66_AT_RSP_ID(id, hdr, max, cb) LA66_AT_RSP_##id,
+typedef enum {
+  LA66_AT_RESPONSES(LA66_AT_RSP_ID)
+  LA66_AT_RSP_COUNT
+} la66_at_rsp_t;
+#undef LA66_AT_RSP_ID
+
+/* Handlers da tabela (chamados com cmd == NULL) */
+#define LA66_AT_RSP_PROTO(id, hdr, max, cb) \
+  void cb(struct at_cmd *cmd, uint16_t len, char *data);
+LA66_AT_RESPONSES(LA66_AT_RSP_PROTO)
+#undef LA66_AT_RSP_PROTO
+
+/** String do comando id em PROGMEM (para at_enqueue_P()). */
+PGM_P la66_at_cmd(la66_at_cmd_t id);
+
+/** Cabeçalho da resposta id em PROGMEM (ex.: expect de at_enqueue_P()). */
+PGM_P la66_at_rsp(la66_at_rsp_t id);
+
+/** Registra a tabela de respostas no at-master. */
+void la66_at_init(void);
+
+#endif /* LA66_AT_H_ */
@@ -0,0 +1,162 @@
+/*
+ * Downlinks do LA66: parser no buffer de linha e despacho por FPort
+ */
+
+#include "contiki.h"
+#include "at-master.h"
+#include "la66.h"
+#include "la66-at.h"
+#include "la66-downlink.h"
+#include "software_uart_serial_line.h"
+#include <stdlib.h>
+#include <string.h>
+
+/*---------------------------------------------------------------------------*/
+static la66_downlink_handler_t handlers[LA66_DOWNLINK_PORTS];
+
+/* A próxima linha sem handler é o payload */
+static uint8_t armed;
+static int16_t rssi = LA66_DOWNLINK_RSSI_UNKNOWN;
+static int8_t snr = LA66_DOWNLINK_SNR_UNKNOWN;
+
+static struct la66_downlink_stats stats;
+/*---------------------------------------------------------------------------*/
+int
+la66_downlink_register(uint8_t port, la66_downlink_handler_t handler)
+{
+  if(port >= LA66_DOWNLINK_PORTS) {
+    return -1;
+  }
+  handlers[port] = handler;
+  return 0;
+}
+/*---------------------------------------------------------------------------*/
+static int8_t
+nibble(char c)
+{
+  if(c >= '0' && c <= '9') {
+    return c - '0';
+  }
+  c |= 0x20;
+  if(c >= 'a' && c <= 'f') {
+    return c - 'a' + 10;
+  }
+  return -1;
+}
+/*---------------------------------------------------------------------------*/
+/* Hex ainda em texto (SOFT_UART_CONF_HEX_LINES = 0): decodifica no próprio
+   buffer, cada byte escrito antes da posição lida */
+static int
+decode(char *hex, uint16_t len)
+{
+  uint8_t *out = (uint8_t *)hex;
+  const char *end = hex + len;
+  uint16_t n = 0;
+  int8_t hi, lo;
+
+  while(hex < end) {
+    if(*hex == ' ') {
+      hex++;
+      continue;
+    }
+    if(end - hex < 2 || (hi = nibble(hex[0])) < 0 ||
+       (lo = nibble(hex[1])) < 0) {
+      return -1;
+    }
+    out[n++] = (hi << 4) | lo;
+    hex += 2;
+  }
+  return n;
+}
+/*---------------------------------------------------------------------------*/
+/* LA66_AT_RSP_RSSI, "Rssi= -45, SNR= 7": guarda os valores para o próximo
+   payload */
+void
+la66_downlink_rssi(struct at_cmd *cmd, uint16_t len, char *data)
+{
+  char *s;
+
+  rssi = atoi(data + sizeof("Rssi=") - 1);
+  s = strstr(data, "SNR=");
+  snr = s != NULL ? atoi(s + sizeof("SNR=") - 1) : LA66_DOWNLINK_SNR_UNKNOWN;
+}
+/*---------------------------------------------------------------------------*/
+/* LA66_AT_RSP_RECEIVE: a próxima linha sem handler é o payload */
+void
+la66_downlink_receive(struct at_cmd *cmd, uint16_t len, char *data)
+{
+  armed = 1;
+}
+/*---------------------------------------------------------------------------*/
+int
+la66_downlink_input(char *line, uint16_t len)
+{
+  struct la66_downlink dl;
+  la66_downlink_handler_t h;
+  uint8_t flags;
+  uint16_t i;
+  uint16_t port = 0;
+  int n;
+
+  if(!armed) {
+    return 0;
+  }
+  armed = 0;
+
+  /* A linha é o slot da Soft UART: sem o final o payload não vale nada */
+  flags = SOFT_UART_LINE(line)->flags;
+  if(flags & SOFT_UART_LINE_F_TRUNCATED) {
+    stats.truncated++;
+    rssi = LA66_DOWNLINK_RSSI_UNKNOWN;
+    snr = LA66_DOWNLINK_SNR_UNKNOWN;
+    return 1;
+  }
+
+  /* "<FPort>:<hex>" */
+  for(i = 0; i < len && line[i] >= '0' && line[i] <= '9'; i++) {
+    port = port * 10 + (line[i] - '0');
+  }
+  if(i == 0 || i == len || line[i] != ':' || port > 255 ||
+     (flags & SOFT_UART_LINE_F_BAD_HEX)) {
+    stats.malformed++;
+    return 0;
+  }
+
+  /* A ISR já troca o hex por bytes; senão a conversão é feita aqui */
+  i++;
+  n = len - i;
+  if(!(flags & SOFT_UART_LINE_F_HEX)) {
+    n = decode(&line[i], n);
+  }
+  if(n < 0 || n > LA66_MAX_PAYLOAD) {
+    stats.malformed++;
+    return 0;
+  }
+
+  dl.port = port;
+  dl.data = (const uint8_t *)&line[i];
+  dl.len = n;
+  dl.rssi = rssi;
+  dl.snr = snr;
+  rssi = LA66_DOWNLINK_RSSI_UNKNOWN;
+  snr = LA66_DOWNLINK_SNR_UNKNOWN;
+
+  h = port < LA66_DOWNLINK_PORTS ? handlers[port] : NULL;
+  if(h == NULL) {
+    h = handlers[0];
+  }
+  if(h == NULL) {
+    stats.unhandled++;
+  } else {
+    stats.received++;
+    h(&dl);
+  }
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
+void
+la66_downlink_stats(struct la66_downlink_stats *s)
+{
+  memcpy(s, &stats, sizeof(stats));
+}
+/*---------------------------------------------------------------------------*/
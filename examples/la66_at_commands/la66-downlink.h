@@ -0,0 +1,74 @@
+#ifndef LA66_DOWNLINK_H_
+#define LA66_DOWNLINK_H_
+
+#include "contiki.h"
+
+/*
+ * Downlinks do LA66 (janelas RX1/RX2).
+ *
+ * O módulo avisa um downlink com linhas não solicitadas:
+ *
+ *   Rssi= -45, SNR= 7        (SNR opcional)
+ *   Receive data
+ *   2:0A0B0C                 (FPort:payload em hex, espaços ignorados)
+ *
+ * A linha do payload é interpretada no próprio buffer de linha da Soft UART:
+ * a ISR já converte o hex em bytes (SOFT_UART_CONF_HEX_LINES) e o
+ * descritor entregue ao handler aponta para eles dentro da linha, sem
+ * cópia. Uma linha truncada pela Soft UART (payload maior que cabe em
+ * SOFT_UART_LINE_SIZE) é descartada: o payload estaria incompleto.
+ *
+ * O handler é escolhido por uma tabela indexada pela FPort (tempo
+ * constante); portas sem handler, ou acima de LA66_DOWNLINK_PORTS, vão para
+ * o handler da porta 0 (FPort 0 só carrega comandos MAC e nunca chega à
+ * aplicação, então o slot serve de padrão).
+ */
+
+/* Tamanho da tabela de handlers (FPorts 1 a LA66_DOWNLINK_PORTS - 1) */
+#ifdef LA66_DOWNLINK_CONF_PORTS
+#define LA66_DOWNLINK_PORTS LA66_DOWNLINK_CONF_PORTS
+#else
+#define LA66_DOWNLINK_PORTS 16
+#endif
+
+/* RSSI/SNR desconhecidos (linha Rssi= não veio antes do payload) */
+#define LA66_DOWNLINK_RSSI_UNKNOWN (-32768)
+#define LA66_DOWNLINK_SNR_UNKNOWN  (-128)
+
+struct la66_downlink {
+  const uint8_t *data; /* payload decodificado, dentro da linha recebida */
+  uint8_t len;
+  uint8_t port;
+  int16_t rssi;      /* dBm */
+  int8_t snr;        /* dB */
+};
+
+/**
+ * Handler de downlink. dl e dl->data só valem durante a chamada: a linha é
+ * o slot da Soft UART, reaproveitado depois que o evento é tratado.
+ */
+typedef void (*la66_downlink_handler_t)(const struct la66_downlink *dl);
+
+/**
+ * Registra o handler de uma FPort (0 = padrão para as demais).
+ * @return 0, ou -1 se port >= LA66_DOWNLINK_PORTS.
+ */
+int la66_downlink_register(uint8_t port, la66_downlink_handler_t handler);
+
+/**
+ * Entrada das linhas sem handler do at-master (chamada por la66.c). line é
+ * o data de soft_uart_line_event, repassado pelo at-master.
+ * @return 1 se a linha era parte de um downlink e foi consumida.
+ */
+int la66_downlink_input(char *line, uint16_t len);
+
+struct la66_downlink_stats {
+  uint16_t received;   /* downlinks entregues a um handler */
+  uint16_t unhandled;  /* sem handler para a porta nem padrão */
+  uint16_t malformed;  /* linha de payload inválida após "Receive data" */
+  uint16_t truncated;  /* payload maior que o slot da Soft UART, descartado */
+};
+
+void la66_downlink_stats(struct la66_downlink_stats *stats);
+
+#endif /* LA66_DOWNLINK_H_ */
@@ -0,0 +1,290 @@
+/*
+ * Gerenciador de conexão do LA66 (join, backoff e tempo no ar)
+ */
+
+#include "contiki.h"
+#include "lib/random.h"
+#include "at-master.h"
+#include "la66.h"
+#include "la66-at.h"
+#include "la66-uplink.h"
+#include "la66-link.h"
+#include <stdio.h>
+#include <string.h>
+
+#ifndef LA66_CONF_VERBOSE
+#define LA66_CONF_VERBOSE     1
+#endif
+#if LA66_CONF_VERBOSE && defined(__AVR__)
+#include <avr/pgmspace.h>
+#define PRINTF(FORMAT, args...) printf_P(PSTR(FORMAT), ##args)
+#elif LA66_CONF_VERBOSE
+#define PRINTF(...) printf(__VA_ARGS__)
+#else
+#define PRINTF(...)
+#endif
+
+/*---------------------------------------------------------------------------*/
+/* Tempo de resposta dos comandos do gerenciador e da consulta AT+NJS=? */
+#define LINK_AT_TIMEOUT  (CLOCK_SECOND * 2)
+#define LINK_NJS_TIMEOUT (CLOCK_SECOND * 3)
+
+/* Maior espera de um etimer: clock_time_t tem 16 bits no AVR */
+#define LINK_MAX_WAIT    60
+
+static la66_link_state_t state;
+static uint8_t join_mode;
+static uint8_t attempts;          /* joins sem sucesso desde o último JOINED */
+static uint8_t failures;          /* uplinks seguidos sem OK */
+static unsigned long start_time;  /* primeiro join-request desde o boot */
+static unsigned long join_next;   /* duty cycle de join-requests */
+
+static uint8_t txn_done;
+static at_txn_status_t txn_status;
+
+static struct la66_link_stats stats;
+
+PROCESS(la66_link_process, "LA66 link manager");
+/*---------------------------------------------------------------------------*/
+void
+la66_link_account(uint8_t dr, uint32_t toa)
+{
+  energest_type_set(ENERGEST_TYPE_TRANSMIT,
+                    energest_type_time(ENERGEST_TYPE_TRANSMIT) +
+                    toa * RTIMER_ARCH_SECOND / 1000);
+  if(dr < LA66_DR_COUNT) {
+    stats.airtime_dr[dr] += toa;
+  }
+}
+/*---------------------------------------------------------------------------*/
+void
+la66_link_tx_result(uint8_t ok)
+{
+  if(ok) {
+    stats.tx_ok++;
+    failures = 0;
+  } else {
+    stats.tx_failed++;
+    if(failures < 255) {
+      failures++;
+    }
+  }
+  process_poll(&la66_link_process);
+}
+/*---------------------------------------------------------------------------*/
+la66_link_state_t
+la66_link_state(void)
+{
+  return state;
+}
+/*---------------------------------------------------------------------------*/
+void
+la66_link_stats(struct la66_link_stats *s)
+{
+  stats.state = state;
+  memcpy(s, &stats, sizeof(stats));
+}
+/*---------------------------------------------------------------------------*/
+/* Backoff da próxima tentativa: exponencial com "equal jitter" */
+static unsigned long
+join_backoff(void)
+{
+  unsigned long d = LA66_LINK_BACKOFF_MIN;
+  uint8_t i;
+
+  for(i = 0; i < attempts && d < LA66_LINK_BACKOFF_MAX; i++) {
+    d <<= 1;
+  }
+  if(d > LA66_LINK_BACKOFF_MAX) {
+    d = LA66_LINK_BACKOFF_MAX;
+  }
+  return d / 2 + (d / 2 > 0 ? random_rand() % (d / 2 + 1) : 0);
+}
+/*---------------------------------------------------------------------------*/
+/* Contabiliza um join-request e o intervalo mínimo até o próximo */
+static void
+join_account(void)
+{
+  unsigned long now = clock_seconds();
+  unsigned long hours;
+  uint32_t toa;
+  uint16_t factor;
+
+  if(stats.join_attempts++ == 0) {
+    start_time = now;
+  }
+  toa = la66_airtime_ms(la66_uplink_get_datarate(), LA66_LINK_JOIN_REQUEST_LEN);
+  la66_duty_account(LA66_LINK_JOIN_REQUEST_LEN);
+
+  /* Duty cycle agregado de join-requests, LoRaWAN 1.0.3 seção 7 */
+  hours = (now - start_time) / 3600;
+  factor = hours < 1 ? 100 : hours < 11 ? 1000 : 10000;
+  join_next = now + (toa * factor + 999) / 1000;
+}
+/*---------------------------------------------------------------------------*/
+static unsigned long
+join_wait(void)
+{
+  unsigned long now = clock_seconds();
+  unsigned long w = (long)(join_next - now) > 0 ? join_next - now : 0;
+  unsigned long d = la66_duty_wait();
+
+  return d > w ? d : w;
+}
+/*---------------------------------------------------------------------------*/
+static void
+txn_callback(at_txn_status_t status, char *line, void *ptr)
+{
+  if(status != AT_TXN_RESPONSE) {
+    txn_status = status;
+    txn_done = 1;
+    process_poll(&la66_link_process);
+  }
+}
+/*---------------------------------------------------------------------------*/
+/* cmd na flash (progmem) ou na RAM */
+static uint8_t
+link_enqueue(const char *cmd, uint8_t progmem)
+{
+  at_status_t s;
+
+  txn_done = 0;
+  la66_wake();
+  if(progmem) {
+    s = at_enqueue_P(cmd, NULL, LINK_AT_TIMEOUT, 1, txn_callback, NULL);
+  } else {
+    s = at_enqueue(cmd, NULL, LINK_AT_TIMEOUT, 1, txn_callback, NULL);
+  }
+  if(s != AT_STATUS_OK) {
+    txn_status = AT_TXN_ERROR;
+    txn_done = 1;
+    return 0;
+  }
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
+static void
+set_state(la66_link_state_t s)
+{
+  state = s;
+  PRINTF("LA66 link: estado %u\n", s);
+}
+/*---------------------------------------------------------------------------*/
+void
+la66_link_start(uint8_t mode)
+{
+  join_mode = mode;
+  attempts = 0;
+  failures = 0;
+  state = LA66_LINK_RESET;
+  process_exit(&la66_link_process);
+  process_start(&la66_link_process, NULL);
+}
+/*---------------------------------------------------------------------------*/
+/* Espera s segundos em fatias que cabem no etimer */
+#define LINK_WAIT_SECONDS(s)                                            \
+  for(wait = (s); wait > 0; wait -= chunk) {                            \
+    chunk = wait < LINK_MAX_WAIT ? wait : LINK_MAX_WAIT;                \
+    etimer_set(&et, (clock_time_t)chunk * CLOCK_SECOND);                \
+    PROCESS_WAIT_EVENT_UNTIL(etimer_expired(&et));                      \
+  }
+
+/* Envia cmd e espera o OK/ERROR/timeout (resultado em txn_status) */
+#define LINK_AT(cmd)                                                    \
+  if(link_enqueue(cmd, 0)) {                                            \
+    PROCESS_WAIT_EVENT_UNTIL(txn_done);                                 \
+  }
+
+/* Idem para um comando da tabela de la66-at.h */
+#define LINK_AT_P(id)                                                   \
+  if(link_enqueue(la66_at_cmd(LA66_AT_CMD_##id), 1)) {                  \
+    PROCESS_WAIT_EVENT_UNTIL(txn_done);                                 \
+  }
+
+PROCESS_THREAD(la66_link_process, ev, data)
+{
+  static struct etimer et;
+  static unsigned long wait;
+  static unsigned long chunk;
+  static char njm[16];
+
+  PROCESS_BEGIN();
+
+  while(1) {
+    if(state == LA66_LINK_RESET) {
+      stats.resets++;
+      LINK_AT_P(RESET);
+      if(txn_status == AT_TXN_OK) {
+        set_state(LA66_LINK_CONFIGURED);
+      } else {
+        LINK_WAIT_SECONDS(join_backoff());
+      }
+
+    } else if(state == LA66_LINK_CONFIGURED) {
+      snprintf(njm, sizeof(njm), "AT+NJM=%u\r\n", join_mode);
+      LINK_AT(njm);
+      set_state(txn_status == AT_TXN_OK ? LA66_LINK_JOINING : LA66_LINK_RESET);
+
+    } else if(state == LA66_LINK_JOINING) {
+      /* Backoff com jitter já na primeira tentativa: nós que voltam juntos
+         (queda de energia ou do gateway) não transmitem juntos */
+      stats.backoff = join_backoff();
+      wait = join_wait();
+      if(stats.backoff > wait) {
+        wait = stats.backoff;
+      }
+      LINK_WAIT_SECONDS(wait);
+
+      LINK_AT_P(JOIN);
+      if(txn_status == AT_TXN_OK) {
+        join_account();
+        etimer_set(&et, LA66_LINK_JOIN_TIMEOUT);
+        PROCESS_WAIT_EVENT_UNTIL(ev == PROCESS_EVENT_LA66_JOINED ||
+                                 etimer_expired(&et));
+        if(ev != PROCESS_EVENT_LA66_JOINED) {
+          /* O JOINED pode ter se perdido na linha: confere com o módulo */
+          LA66_DRIVER.get_join_status();
+          etimer_set(&et, LINK_NJS_TIMEOUT);
+          PROCESS_WAIT_EVENT_UNTIL(ev == PROCESS_EVENT_LA66_JOINED ||
+                                   etimer_expired(&et));
+        }
+        if(ev == PROCESS_EVENT_LA66_JOINED) {
+          stats.joins++;
+          attempts = 0;
+          failures = 0;
+          set_state(LA66_LINK_JOINED);
+          continue;
+        }
+      }
+      if(attempts < 255) {
+        attempts++;
+      }
+      if(attempts >= LA66_LINK_RESET_AFTER) {
+        attempts = 0;
+        set_state(LA66_LINK_RESET);
+      }
+
+    } else if(state == LA66_LINK_JOINED) {
+      PROCESS_WAIT_EVENT_UNTIL(failures >= LA66_LINK_MAX_FAILURES);
+      stats.degraded++;
+      set_state(LA66_LINK_DEGRADED);
+
+    } else if(state == LA66_LINK_DEGRADED) {
+      /* Os uplinks falharam: se o módulo ainda está na rede o problema é
+         de cobertura, senão volta a fazer join */
+      LA66_DRIVER.get_join_status();
+      etimer_set(&et, LINK_NJS_TIMEOUT);
+      PROCESS_WAIT_EVENT_UNTIL(ev == PROCESS_EVENT_LA66_JOINED ||
+                               etimer_expired(&et));
+      if(ev == PROCESS_EVENT_LA66_JOINED) {
+        failures = 0;
+        set_state(LA66_LINK_JOINED);
+      } else {
+        set_state(LA66_LINK_JOINING);
+      }
+    }
+  }
+
+  PROCESS_END();
+}
+/*---------------------------------------------------------------------------*/
@@ -0,0 +1,105 @@
+#ifndef LA66_LINK_H_
+#define LA66_LINK_H_
+
+#include "contiki.h"
+#include "la66-uplink.h"
+
+/*
+ * Gerenciador de conexão do LA66.
+ *
+ *   RESET -> CONFIGURED -> JOINING -> JOINED <-> DEGRADED
+ *
+ * RESET manda ATZ, CONFIGURED ajusta o modo (AT+NJM) e JOINING repete o
+ * AT+JOIN até o JOINED (ou +NJS:1). Cada nova tentativa espera um backoff
+ * exponencial com jitter ("equal jitter": metade fixa, metade aleatória),
+ * nunca menor que o limite de duty cycle de join-requests do LoRaWAN 1.0.3
+ * (seção 7: 1% na primeira hora, 0,1% até 11 h, 0,01% depois). Um nó que
+ * perde o link não volta a transmitir junto com os outros milhares que
+ * caíram com o mesmo gateway.
+ *
+ * Em JOINED, LA66_LINK_MAX_FAILURES uplinks seguidos sem OK levam a
+ * DEGRADED, que confere AT+NJS=? antes de voltar a JOINING. Depois de
+ * LA66_LINK_RESET_AFTER joins sem sucesso o módulo volta a RESET.
+ */
+
+typedef enum {
+  LA66_LINK_RESET,
+  LA66_LINK_CONFIGURED,
+  LA66_LINK_JOINING,
+  LA66_LINK_JOINED,
+  LA66_LINK_DEGRADED,
+} la66_link_state_t;
+
+/* Primeiro backoff (s); dobra a cada join sem sucesso */
+#ifdef LA66_LINK_CONF_BACKOFF_MIN
+#define LA66_LINK_BACKOFF_MIN LA66_LINK_CONF_BACKOFF_MIN
+#else
+#define LA66_LINK_BACKOFF_MIN 16
+#endif
+
+/* Teto do backoff (s) */
+#ifdef LA66_LINK_CONF_BACKOFF_MAX
+#define LA66_LINK_BACKOFF_MAX LA66_LINK_CONF_BACKOFF_MAX
+#else
+#define LA66_LINK_BACKOFF_MAX 3600
+#endif
+
+/* Espera pelo JOINED depois do AT+JOIN (JOIN_ACCEPT_DELAY2 = 6 s + folga) */
+#ifdef LA66_LINK_CONF_JOIN_TIMEOUT
+#define LA66_LINK_JOIN_TIMEOUT LA66_LINK_CONF_JOIN_TIMEOUT
+#else
+#define LA66_LINK_JOIN_TIMEOUT (CLOCK_SECOND * 8)
+#endif
+
+#ifdef LA66_LINK_CONF_MAX_FAILURES
+#define LA66_LINK_MAX_FAILURES LA66_LINK_CONF_MAX_FAILURES
+#else
+#define LA66_LINK_MAX_FAILURES 3
+#endif
+
+#ifdef LA66_LINK_CONF_RESET_AFTER
+#define LA66_LINK_RESET_AFTER LA66_LINK_CONF_RESET_AFTER
+#else
+#define LA66_LINK_RESET_AFTER 8
+#endif
+
+/* Join-request: MHDR + AppEUI + DevEUI + DevNonce + MIC = 23 bytes, ou
+   seja 10 além dos 13 de overhead somados por la66_airtime_ms() */
+#define LA66_LINK_JOIN_REQUEST_LEN 10
+
+struct la66_link_stats {
+  uint8_t state;                 /* la66_link_state_t */
+  uint16_t join_attempts;        /* AT+JOIN enviados */
+  uint16_t joins;                /* JOINED confirmados */
+  uint16_t degraded;             /* entradas em DEGRADED */
+  uint16_t resets;               /* ATZ enviados pelo gerenciador */
+  uint16_t tx_ok;
+  uint16_t tx_failed;
+  uint32_t backoff;              /* última espera antes de um join (s) */
+  uint32_t airtime_dr[LA66_DR_COUNT];  /* ms por data rate */
+};
+
+/**
+ * Inicia (ou reinicia, a partir de RESET) o gerenciador de conexão.
+ * @param mode 0 = ABP, 1 = OTAA (AT+NJM)
+ */
+void la66_link_start(uint8_t mode);
+
+la66_link_state_t la66_link_state(void);
+
+/** Resultado de um uplink (chamado pelo driver ao fim de cada envio). */
+void la66_link_tx_result(uint8_t ok);
+
+/**
+ * Soma toa ms de tempo no ar ao data rate dr e a ENERGEST_TYPE_TRANSMIT.
+ * Não há contagem por sub-banda: o driver não configura a máscara de
+ * canais (o LA66 escolhe os canais sozinho), então o tempo no ar vale
+ * para um orçamento único de duty cycle, o de la66-uplink.c.
+ */
+void la66_link_account(uint8_t dr, uint32_t toa);
+
+void la66_link_stats(struct la66_link_stats *stats);
+
+PROCESS_NAME(la66_link_process);
+
+#endif /* LA66_LINK_H_ */
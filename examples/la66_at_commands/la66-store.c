@@ -0,0 +1,324 @@
+/*
+ * Fila persistente de uplinks do LA66 (store-and-forward em CFS/Coffee)
+ */
+
+#include "contiki.h"
+#include "cfs/cfs.h"
+#if COFFEE_FILES || defined(LA66_STORE_CONF_RESERVE)
+#include "cfs/cfs-coffee.h"
+#endif
+#include "la66.h"
+#include "la66-uplink.h"
+#include "la66-store.h"
+#include <string.h>
+
+/*---------------------------------------------------------------------------*/
+#define STORE_MAGIC     0x6c71
+#define STORE_HDR_SIZE  6
+#define STORE_REC_SIZE  (2 + LA66_STORE_DATA_SIZE)
+#define STORE_FILE_SIZE (STORE_HDR_SIZE + \
+                         (cfs_offset_t)LA66_STORE_RECORDS * STORE_REC_SIZE)
+
+/* head e tail andam em [0, 2N): head == tail é vazia, tail - head == N é
+   cheia, e o slot é o índice módulo N */
+#define STORE_WRAP      (2 * LA66_STORE_RECORDS)
+#define STORE_SLOT(i)   ((i) % LA66_STORE_RECORDS)
+
+/* Maior espera de um etimer: clock_time_t tem 16 bits no AVR */
+#define STORE_MAX_WAIT  60
+
+/* Espera antes de tentar de novo quando o driver já tem um envio pendente */
+#define STORE_BUSY_WAIT 1
+
+static uint16_t head;
+static uint16_t tail;
+
+/* Único registro em RAM: o que está sendo enviado */
+static struct {
+  uint8_t port;
+  uint8_t len;
+  uint8_t data[LA66_STORE_DATA_SIZE];
+} rec;
+
+/* 1 enquanto rec é o registro do head e o envio dele não terminou. Se a
+   fila encher nesse meio tempo, la66_store_put() tira esse registro do
+   arquivo (o envio segue da cópia em rec) e zera a marca: o OK não pode
+   descartar mais um registro, que nunca teria saído */
+static uint8_t sending;
+
+static struct la66_store_stats stats;
+
+PROCESS(la66_store_process, "LA66 uplink store");
+/*---------------------------------------------------------------------------*/
+static uint16_t
+advance(uint16_t i)
+{
+  return i + 1 < STORE_WRAP ? i + 1 : 0;
+}
+/*---------------------------------------------------------------------------*/
+uint16_t
+la66_store_count(void)
+{
+  return tail >= head ? tail - head : tail + STORE_WRAP - head;
+}
+/*---------------------------------------------------------------------------*/
+static int
+write_at(int fd, cfs_offset_t offset, const void *buf, uint8_t len)
+{
+  if(cfs_seek(fd, offset, CFS_SEEK_SET) != offset ||
+     cfs_write(fd, buf, len) != len) {
+    return -1;
+  }
+  return 0;
+}
+/*---------------------------------------------------------------------------*/
+/* Cabeçalho em little-endian, independente da arquitetura */
+static int
+write_header(int fd)
+{
+  uint8_t hdr[STORE_HDR_SIZE];
+
+  hdr[0] = STORE_MAGIC & 0xff;
+  hdr[1] = STORE_MAGIC >> 8;
+  hdr[2] = head & 0xff;
+  hdr[3] = head >> 8;
+  hdr[4] = tail & 0xff;
+  hdr[5] = tail >> 8;
+  return write_at(fd, 0, hdr, sizeof(hdr));
+}
+/*---------------------------------------------------------------------------*/
+static int
+read_header(void)
+{
+  uint8_t hdr[STORE_HDR_SIZE];
+  uint16_t h, t;
+  int fd;
+  int r;
+
+  fd = cfs_open(LA66_STORE_FILENAME, CFS_READ);
+  if(fd < 0) {
+    return -1;
+  }
+  r = cfs_read(fd, hdr, sizeof(hdr));
+  cfs_close(fd);
+
+  if(r != sizeof(hdr) || (hdr[0] | (hdr[1] << 8)) != STORE_MAGIC) {
+    return -1;
+  }
+  h = hdr[2] | (hdr[3] << 8);
+  t = hdr[4] | (hdr[5] << 8);
+  if(h >= STORE_WRAP || t >= STORE_WRAP) {
+    return -1;
+  }
+  head = h;
+  tail = t;
+  if(la66_store_count() > LA66_STORE_RECORDS) {
+    head = tail = 0;
+    return -1;
+  }
+  return 0;
+}
+/*---------------------------------------------------------------------------*/
+static int
+save_header(void)
+{
+  int fd;
+  int r;
+
+  fd = cfs_open(LA66_STORE_FILENAME, CFS_READ | CFS_WRITE);
+  if(fd < 0) {
+    return -1;
+  }
+  r = write_header(fd);
+  cfs_close(fd);
+  return r;
+}
+/*---------------------------------------------------------------------------*/
+int
+la66_store_init(void)
+{
+  if(read_header() < 0) {
+    /* Arquivo novo ou corrompido: começa uma fila vazia */
+#if COFFEE_FILES || defined(LA66_STORE_CONF_RESERVE)
+    cfs_remove(LA66_STORE_FILENAME);
+    cfs_coffee_reserve(LA66_STORE_FILENAME, STORE_FILE_SIZE);
+#endif
+    head = tail = 0;
+    if(save_header() < 0) {
+      return -1;
+    }
+  }
+
+  process_start(&la66_store_process, NULL);
+  return la66_store_count();
+}
+/*---------------------------------------------------------------------------*/
+int
+la66_store_put(uint8_t port, const uint8_t *data, uint8_t len)
+{
+  uint8_t hdr[2];
+  cfs_offset_t offset;
+  int fd;
+  int r;
+
+  if(len > LA66_STORE_DATA_SIZE || (data == NULL && len > 0)) {
+    return -1;
+  }
+
+  fd = cfs_open(LA66_STORE_FILENAME, CFS_READ | CFS_WRITE);
+  if(fd < 0) {
+    return -1;
+  }
+
+  if(la66_store_count() == LA66_STORE_RECORDS) {
+    /* Fila cheia: o slot do tail é o do head, perde o mais antigo */
+    head = advance(head);
+    sending = 0;
+    stats.overwritten++;
+  }
+
+  /* Registro primeiro, cabeçalho depois: uma queda no meio perde só o
+     registro novo */
+  offset = STORE_HDR_SIZE + (cfs_offset_t)STORE_SLOT(tail) * STORE_REC_SIZE;
+  hdr[0] = port;
+  hdr[1] = len;
+  r = write_at(fd, offset, hdr, sizeof(hdr));
+  if(r == 0 && len > 0) {
+    r = write_at(fd, offset + sizeof(hdr), data, len);
+  }
+  if(r == 0) {
+    tail = advance(tail);
+    r = write_header(fd);
+  }
+  cfs_close(fd);
+
+  if(r == 0) {
+    stats.stored++;
+    process_poll(&la66_store_process);
+  }
+  return r;
+}
+/*---------------------------------------------------------------------------*/
+/* Lê o registro do head em rec */
+static int
+read_head(void)
+{
+  cfs_offset_t offset;
+  int fd;
+  int r = -1;
+
+  fd = cfs_open(LA66_STORE_FILENAME, CFS_READ);
+  if(fd < 0) {
+    return -1;
+  }
+  offset = STORE_HDR_SIZE + (cfs_offset_t)STORE_SLOT(head) * STORE_REC_SIZE;
+  if(cfs_seek(fd, offset, CFS_SEEK_SET) == offset &&
+     cfs_read(fd, &rec.port, 2) == 2 && rec.len <= LA66_STORE_DATA_SIZE &&
+     cfs_read(fd, rec.data, rec.len) == rec.len) {
+    r = 0;
+  }
+  cfs_close(fd);
+  return r;
+}
+/*---------------------------------------------------------------------------*/
+/* Tira o registro em envio do head, se la66_store_put() já não tirou */
+static void
+pop(void)
+{
+  if(sending) {
+    sending = 0;
+    head = advance(head);
+    save_header();
+  }
+}
+/*---------------------------------------------------------------------------*/
+void
+la66_store_stats(struct la66_store_stats *s)
+{
+  memcpy(s, &stats, sizeof(stats));
+}
+/*---------------------------------------------------------------------------*/
+/* Espera da drenagem: os eventos que não a encerram não se perdem. Um
+   JOINED fica em rejoined e EXIT (process_exit()) encerra o processo; o
+   POLL de um registro novo não muda nada, a drenagem já vai chegar nele */
+#define STORE_WAIT_UNTIL(cond) do {                                     \
+    PROCESS_WAIT_EVENT();                                               \
+    if(ev == PROCESS_EVENT_LA66_JOINED) {                               \
+      rejoined = 1;                                                     \
+    } else if(ev == PROCESS_EVENT_EXIT) {                               \
+      etimer_stop(&et);                                                 \
+      sending = 0;                                                      \
+      PROCESS_EXIT();                                                   \
+    }                                                                   \
+  } while(!(cond))
+
+#define STORE_WAIT_TIMER() \
+  STORE_WAIT_UNTIL(ev == PROCESS_EVENT_TIMER && data == &et)
+
+PROCESS_THREAD(la66_store_process, ev, data)
+{
+  static struct etimer et;
+  static uint8_t link_ok;
+  static uint8_t rejoined;
+  static unsigned long wait;
+  const struct la66_response *resp;
+
+  PROCESS_BEGIN();
+
+  link_ok = la66_is_joined();
+
+  while(1) {
+    PROCESS_WAIT_EVENT_UNTIL(ev == PROCESS_EVENT_LA66_JOINED ||
+                             ev == PROCESS_EVENT_POLL);
+    if(ev == PROCESS_EVENT_LA66_JOINED) {
+      link_ok = 1;
+    }
+
+    /* Drena um registro por vez no ritmo que o duty cycle permite */
+    while(link_ok && la66_store_count() > 0) {
+      while((wait = la66_duty_wait()) > 0) {
+        etimer_set(&et, (clock_time_t)(wait < STORE_MAX_WAIT ?
+                                       wait : STORE_MAX_WAIT) * CLOCK_SECOND);
+        STORE_WAIT_TIMER();
+      }
+
+      sending = 1;
+      if(read_head() < 0) {
+        /* Registro ilegível: descarta para não travar a fila */
+        pop();
+        continue;
+      }
+
+      if(LA66_DRIVER.send_bin(rec.port, LA66_STORE_CONFIRM,
+                              rec.data, rec.len) != 0) {
+        sending = 0;
+        etimer_set(&et, STORE_BUSY_WAIT * CLOCK_SECOND);
+        STORE_WAIT_TIMER();
+        continue;
+      }
+
+      rejoined = 0;
+      STORE_WAIT_UNTIL(ev == PROCESS_EVENT_LA66_RESPONSE);
+      resp = (const struct la66_response *)data;
+
+      if(resp->len == 2 && memcmp(resp->data, "OK", 2) == 0) {
+        la66_duty_account(rec.len);
+        stats.sent++;
+        pop();
+      } else {
+        /* Timeout pode ter transmitido; ERROR não. Em ambos os casos o
+           link caiu: espera o próximo +NJS:1 ou JOINED, a menos que ele
+           tenha chegado durante a espera */
+        if(resp->len == 0) {
+          la66_duty_account(rec.len);
+        }
+        sending = 0;
+        stats.failures++;
+        link_ok = rejoined;
+      }
+    }
+  }
+
+  PROCESS_END();
+}
+/*---------------------------------------------------------------------------*/
@@ -0,0 +1,80 @@
+#ifndef LA66_STORE_H_
+#define LA66_STORE_H_
+
+#include "contiki.h"
+
+/*
+ * Fila persistente (store-and-forward) de uplinks para quedas do LA66.
+ *
+ * Os uplinks que não puderam sair ficam em um arquivo CFS (Coffee onde
+ * houver) como um anel de registros de tamanho fixo, com head/tail no
+ * cabeçalho do arquivo. Quando PROCESS_EVENT_LA66_JOINED chega (+NJS:1 ou
+ * JOINED), o processo esvazia a fila do mais antigo para o mais novo, um
+ * registro por vez e no ritmo do duty cycle (la66_duty_wait()). Em RAM fica
+ * só o cabeçalho e um registro, qualquer que seja o tamanho da fila.
+ *
+ * Os registros são reescritos no lugar (CFS_READ | CFS_WRITE + cfs_seek),
+ * como Coffee e cfs-eeprom permitem; cfs-posix trunca o arquivo nesse modo
+ * e não serve para a fila.
+ *
+ * Layout do arquivo:
+ *   [magic:2][head:2][tail:2]
+ *   LA66_STORE_RECORDS x [port:1][len:1][LA66_STORE_DATA_SIZE bytes]
+ */
+
+#ifdef LA66_STORE_CONF_FILENAME
+#define LA66_STORE_FILENAME LA66_STORE_CONF_FILENAME
+#else
+#define LA66_STORE_FILENAME "la66q"
+#endif
+
+/* Número de registros no anel */
+#ifdef LA66_STORE_CONF_RECORDS
+#define LA66_STORE_RECORDS LA66_STORE_CONF_RECORDS
+#else
+#define LA66_STORE_RECORDS 16
+#endif
+
+/* Maior payload guardado por registro */
+#ifdef LA66_STORE_CONF_DATA_SIZE
+#define LA66_STORE_DATA_SIZE LA66_STORE_CONF_DATA_SIZE
+#else
+#define LA66_STORE_DATA_SIZE 51
+#endif
+
+/* 1 para enviar os registros guardados como uplinks confirmados */
+#ifdef LA66_STORE_CONF_CONFIRM
+#define LA66_STORE_CONFIRM LA66_STORE_CONF_CONFIRM
+#else
+#define LA66_STORE_CONFIRM 0
+#endif
+
+struct la66_store_stats {
+  uint16_t stored;      /* registros gravados */
+  uint16_t sent;        /* registros enviados com OK */
+  uint16_t overwritten; /* mais antigos perdidos com a fila cheia */
+  uint16_t failures;    /* envios recusados ou sem resposta na drenagem */
+};
+
+/**
+ * Abre (ou cria) o arquivo da fila, recupera head/tail e inicia o processo.
+ * @return Número de registros pendentes, ou -1 se o arquivo não abriu.
+ */
+int la66_store_init(void);
+
+/**
+ * Grava um uplink no fim da fila. Com a fila cheia o registro mais antigo
+ * é sobrescrito; se ele estiver sendo enviado, o envio continua, mas não é
+ * repetido se falhar.
+ * @return 0, ou -1 se len > LA66_STORE_DATA_SIZE ou a escrita falhar.
+ */
+int la66_store_put(uint8_t port, const uint8_t *data, uint8_t len);
+
+/** Registros pendentes na fila */
+uint16_t la66_store_count(void);
+
+void la66_store_stats(struct la66_store_stats *stats);
+
+PROCESS_NAME(la66_store_process);
+
+#endif /* LA66_STORE_H_ */
@@ -0,0 +1,340 @@
+/*
+ * Agregador de uplinks LoRaWAN sobre o driver LA66
+ */
+
+#include "contiki.h"
+#include "la66.h"
+#include "la66-uplink.h"
+#include "la66-link.h"
+#if LA66_UPLINK_STORE
+#include "la66-store.h"
+#endif
+#include <string.h>
+
+/*---------------------------------------------------------------------------*/
+/* Overhead LoRaWAN somado ao payload: MHDR(1) + FHDR(7) + FPort(1) + MIC(4) */
+#define LA66_LORAWAN_OVERHEAD 13
+
+/* Maior espera de um etimer: clock_time_t tem 16 bits no AVR */
+#define LA66_UPLINK_MAX_WAIT  60
+
+/* Espera antes de tentar de novo quando o driver já tem um envio pendente */
+#define LA66_UPLINK_BUSY_WAIT 1
+
+struct la66_dr {
+  uint8_t sf;
+  uint8_t bw500;      /* 1 = 500 kHz, 0 = 125 kHz */
+  uint8_t max_payload;
+};
+
+#if LA66_UPLINK_REGION == LA66_REGION_US915
+static const struct la66_dr dr_table[LA66_DR_COUNT] = {
+  { 10, 0, 11 }, { 9, 0, 53 }, { 8, 0, 125 }, { 7, 0, 242 }, { 8, 1, 242 },
+};
+/* Sem duty cycle em US915 (o limite lá é de dwell time por canal) */
+#define LA66_DUTY_OFF_FACTOR 0
+#else
+static const struct la66_dr dr_table[LA66_DR_COUNT] = {
+  { 12, 0, 51 }, { 11, 0, 51 }, { 10, 0, 51 },
+  { 9, 0, 115 }, { 8, 0, 242 }, { 7, 0, 242 },
+};
+/* 1% nas sub-bandas g/g1: espera 99 vezes o tempo no ar. Um orçamento só,
+   para todos os canais: o driver não sabe em que sub-banda o módulo
+   transmitiu, e 1% é o limite mais restrito que os canais padrão usam */
+#define LA66_DUTY_OFF_FACTOR 99
+#endif
+
+#define DR_COUNT LA66_DR_COUNT
+
+/*---------------------------------------------------------------------------*/
+/* Buffers de payload: um enchendo, outro no ar (send_bin não copia) */
+static uint8_t payload[2][LA66_UPLINK_BUFSIZE];
+static uint8_t payload_len[2];
+static uint8_t payload_records[2];
+static uint8_t fill;              /* índice do buffer que recebe registros */
+static uint8_t air_len;           /* 0 = nenhum payload esperando envio */
+static uint8_t air_tries;
+static uint8_t in_flight;         /* AT+SENDB na fila do driver */
+static uint8_t flush_req;
+static unsigned long base_time;   /* clock_seconds() do primeiro registro */
+static unsigned long next_allowed;
+
+static uint8_t uplink_port;
+static uint8_t uplink_confirm;
+static uint8_t datarate;
+
+static struct la66_uplink_stats stats;
+static struct etimer wait_timer;
+
+PROCESS(la66_uplink_process, "LA66 uplink aggregator");
+/*---------------------------------------------------------------------------*/
+uint8_t
+la66_max_payload(uint8_t dr)
+{
+  uint8_t max;
+
+  if(dr >= DR_COUNT) {
+    dr = DR_COUNT - 1;
+  }
+  max = dr_table[dr].max_payload;
+  return max < LA66_UPLINK_BUFSIZE ? max : LA66_UPLINK_BUFSIZE;
+}
+/*---------------------------------------------------------------------------*/
+/*
+ * Tempo no ar (Semtech AN1200.13), CR 4/5, preâmbulo de 8 símbolos, header
+ * explícito e CRC ligado, otimização de data rate baixo em SF11/SF12 125 kHz:
+ *   nsym = 8 + max(ceil((8*PL - 4*SF + 28 + 16) / (4*(SF - 2*DE))) * 5, 0)
+ *   T    = (nsym + 12.25) * 2^SF / BW
+ */
+uint32_t
+la66_airtime_ms(uint8_t dr, uint8_t len)
+{
+  const struct la66_dr *d;
+  int16_t num;
+  uint8_t den;
+  uint16_t nsym;
+  uint32_t tsym_us;
+
+  if(dr >= DR_COUNT) {
+    dr = DR_COUNT - 1;
+  }
+  d = &dr_table[dr];
+
+  num = 8 * ((int16_t)len + LA66_LORAWAN_OVERHEAD) - 4 * d->sf + 44;
+  den = 4 * (d->sf - ((d->sf >= 11 && !d->bw500) ? 2 : 0));
+  nsym = 8 + (num > 0 ? ((num + den - 1) / den) * 5 : 0);
+
+  tsym_us = ((uint32_t)1 << d->sf) * 1000UL / (d->bw500 ? 500 : 125);
+  /* (nsym + 12.25) em quartos de símbolo, arredondado para cima em ms */
+  return ((uint32_t)(4 * nsym + 49) * tsym_us / 4 + 999) / 1000;
+}
+/*---------------------------------------------------------------------------*/
+unsigned long
+la66_duty_wait(void)
+{
+  unsigned long now = clock_seconds();
+
+  return (long)(next_allowed - now) > 0 ? next_allowed - now : 0;
+}
+/*---------------------------------------------------------------------------*/
+void
+la66_duty_account(uint8_t len)
+{
+  uint32_t toa = la66_airtime_ms(datarate, len);
+
+  stats.airtime_ms += toa;
+  la66_link_account(datarate, toa);
+  next_allowed = clock_seconds() + (toa * LA66_DUTY_OFF_FACTOR + 999) / 1000;
+}
+/*---------------------------------------------------------------------------*/
+static void
+put_be(uint8_t *p, uint32_t v, uint8_t n)
+{
+  while(n-- > 0) {
+    p[n] = v & 0xff;
+    v >>= 8;
+  }
+}
+/*---------------------------------------------------------------------------*/
+/* Passa o buffer cheio para envio se o anterior já saiu */
+static uint8_t
+hand_off(void)
+{
+  if(air_len > 0 || payload_len[fill] == 0) {
+    return 0;
+  }
+  air_len = payload_len[fill];
+  air_tries = 0;
+  fill ^= 1;
+  payload_len[fill] = 0;
+  payload_records[fill] = 0;
+  flush_req = 0;
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
+int
+la66_uplink_add(uint8_t type, const void *data, uint8_t len)
+{
+  uint8_t max = la66_max_payload(datarate);
+  uint8_t need = LA66_UPLINK_REC_HDR_LEN + len;
+  unsigned long now = clock_seconds();
+  uint8_t *p;
+
+  if(LA66_UPLINK_HDR_LEN + need > max || (data == NULL && len > 0)) {
+    return -1;
+  }
+
+  /* Não cabe, ou dt estouraria 16 bits: fecha o payload atual */
+  if(payload_len[fill] > 0 &&
+     (payload_len[fill] + need > max || now - base_time > 0xffff)) {
+    flush_req = 1;
+    if(!hand_off()) {
+      /* Os dois buffers ocupados: perde o registro novo */
+      stats.dropped++;
+      process_poll(&la66_uplink_process);
+      return -1;
+    }
+  }
+
+  p = payload[fill];
+  if(payload_len[fill] == 0) {
+    base_time = now;
+    put_be(p, base_time, LA66_UPLINK_HDR_LEN);
+    payload_len[fill] = LA66_UPLINK_HDR_LEN;
+  }
+  p += payload_len[fill];
+  put_be(p, now - base_time, 2);
+  p[2] = type;
+  p[3] = len;
+  memcpy(&p[LA66_UPLINK_REC_HDR_LEN], data, len);
+  payload_len[fill] += need;
+  payload_records[fill]++;
+  stats.records++;
+
+  /* O processo recalcula a espera (idade, duty cycle) */
+  process_poll(&la66_uplink_process);
+  return 0;
+}
+/*---------------------------------------------------------------------------*/
+void
+la66_uplink_flush(void)
+{
+  if(payload_len[fill] > 0) {
+    flush_req = 1;
+    process_poll(&la66_uplink_process);
+  }
+}
+/*---------------------------------------------------------------------------*/
+void
+la66_uplink_set_datarate(uint8_t dr)
+{
+  datarate = dr < DR_COUNT ? dr : DR_COUNT - 1;
+  /* Um payload já maior que o novo limite sai como está; se o módulo o
+     recusar, as tentativas esgotam e os registros contam em dropped */
+  if(payload_len[fill] > la66_max_payload(datarate)) {
+    la66_uplink_flush();
+  }
+}
+/*---------------------------------------------------------------------------*/
+uint8_t
+la66_uplink_get_datarate(void)
+{
+  return datarate;
+}
+/*---------------------------------------------------------------------------*/
+void
+la66_uplink_stats(struct la66_uplink_stats *s)
+{
+  memcpy(s, &stats, sizeof(stats));
+}
+/*---------------------------------------------------------------------------*/
+void
+la66_uplink_init(uint8_t port, uint8_t confirm)
+{
+  uplink_port = port;
+  uplink_confirm = confirm;
+  process_start(&la66_uplink_process, NULL);
+}
+/*---------------------------------------------------------------------------*/
+/* Resultado do AT+SENDB do buffer no ar */
+static void
+send_result(const struct la66_response *resp)
+{
+  uint8_t air = fill ^ 1;
+  uint8_t ok = resp->len == 2 && memcmp(resp->data, "OK", 2) == 0;
+
+  in_flight = 0;
+  if(ok) {
+    stats.uplinks++;
+  } else {
+    stats.failures++;
+  }
+
+  if(!ok && resp->len > 0) {
+    /* ERROR: o módulo não transmitiu, tenta de novo em seguida */
+    next_allowed = clock_seconds() + LA66_UPLINK_BUSY_WAIT;
+  } else {
+    /* OK, ou timeout (pode ter transmitido): conta o tempo no ar e a
+       espera do duty cycle */
+    la66_duty_account(air_len);
+    if(ok) {
+      air_len = 0;
+      return;
+    }
+  }
+
+  if(++air_tries > LA66_UPLINK_RETRIES) {
+#if LA66_UPLINK_STORE
+    /* Guarda o payload para quando o link voltar */
+    if(la66_store_put(uplink_port, payload[air], air_len) == 0) {
+      air_len = 0;
+      return;
+    }
+#endif
+    stats.dropped += payload_records[air];
+    air_len = 0;
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+wait_seconds(unsigned long s)
+{
+  if(s > LA66_UPLINK_MAX_WAIT) {
+    s = LA66_UPLINK_MAX_WAIT;
+  }
+  etimer_set(&wait_timer, (clock_time_t)s * CLOCK_SECOND);
+}
+/*---------------------------------------------------------------------------*/
+/* Envia o que for possível agora e arma o timer para o próximo passo */
+static void
+schedule(void)
+{
+  unsigned long now = clock_seconds();
+
+  etimer_stop(&wait_timer);
+
+  if(payload_len[fill] > 0 &&
+     (flush_req || now - base_time >= LA66_UPLINK_MAX_AGE)) {
+    flush_req = 1;
+    hand_off();
+  }
+
+  if(air_len > 0) {
+    if(la66_duty_wait() > 0) {
+      wait_seconds(la66_duty_wait());
+      return;
+    }
+    if(LA66_DRIVER.send_bin(uplink_port, uplink_confirm,
+                            payload[fill ^ 1], air_len) == 0) {
+      in_flight = 1;
+    } else {
+      wait_seconds(LA66_UPLINK_BUSY_WAIT);
+    }
+    return;
+  }
+
+  if(payload_len[fill] > 0) {
+    wait_seconds(base_time + LA66_UPLINK_MAX_AGE - now);
+  }
+}
+/*---------------------------------------------------------------------------*/
+PROCESS_THREAD(la66_uplink_process, ev, data)
+{
+  PROCESS_BEGIN();
+
+  next_allowed = clock_seconds();
+
+  while(1) {
+    PROCESS_WAIT_EVENT();
+
+    if(ev == PROCESS_EVENT_LA66_RESPONSE && in_flight) {
+      send_result((const struct la66_response *)data);
+    }
+    if(!in_flight) {
+      schedule();
+    }
+  }
+
+  PROCESS_END();
+}
+/*---------------------------------------------------------------------------*/
@@ -0,0 +1,126 @@
+#ifndef LA66_UPLINK_H_
+#define LA66_UPLINK_H_
+
+#include "contiki.h"
+
+/*
+ * Agregador de uplinks sobre o driver LA66.
+ *
+ * Cada leitura vira um registro com carimbo de tempo; vários registros são
+ * empacotados em um único payload (até o máximo do data rate atual) e
+ * enviados com LA66_DRIVER.send_bin(). O envio acontece quando o próximo
+ * registro não cabe, quando o registro mais antigo passa de
+ * LA66_UPLINK_MAX_AGE segundos, ou em la66_uplink_flush(). O tempo no ar de
+ * cada uplink é contabilizado e o próximo envio espera o duty cycle
+ * regional, então o módulo nunca recusa um envio por duty cycle.
+ *
+ * Formato do payload:
+ *   [base:4]                  clock_seconds() do primeiro registro (BE)
+ *   [dt:2][tipo:1][n:1][n bytes] por registro, dt em segundos desde base
+ */
+
+/* Região LoRaWAN (tabelas de data rate e duty cycle) */
+#define LA66_REGION_EU868 0
+#define LA66_REGION_US915 1
+
+#ifdef LA66_UPLINK_CONF_REGION
+#define LA66_UPLINK_REGION LA66_UPLINK_CONF_REGION
+#else
+#define LA66_UPLINK_REGION LA66_REGION_EU868
+#endif
+
+/* Data rates da região */
+#if LA66_UPLINK_REGION == LA66_REGION_US915
+#define LA66_DR_COUNT 5
+#else
+#define LA66_DR_COUNT 6
+#endif
+
+/* Tamanho de cada um dos dois buffers de payload (enchendo / no ar) */
+#ifdef LA66_UPLINK_CONF_BUFSIZE
+#define LA66_UPLINK_BUFSIZE LA66_UPLINK_CONF_BUFSIZE
+#else
+#define LA66_UPLINK_BUFSIZE 51
+#endif
+
+/* Idade máxima do registro mais antigo antes de forçar o envio (segundos) */
+#ifdef LA66_UPLINK_CONF_MAX_AGE
+#define LA66_UPLINK_MAX_AGE LA66_UPLINK_CONF_MAX_AGE
+#else
+#define LA66_UPLINK_MAX_AGE 300
+#endif
+
+/* Tentativas de reenvio de um payload recusado antes de descartá-lo */
+#ifdef LA66_UPLINK_CONF_RETRIES
+#define LA66_UPLINK_RETRIES LA66_UPLINK_CONF_RETRIES
+#else
+#define LA66_UPLINK_RETRIES 3
+#endif
+
+/* Payloads que esgotaram as tentativas vão para a fila persistente
+   (la66-store) em vez de serem descartados */
+#ifdef LA66_UPLINK_CONF_STORE
+#define LA66_UPLINK_STORE LA66_UPLINK_CONF_STORE
+#else
+#define LA66_UPLINK_STORE 1
+#endif
+
+#define LA66_UPLINK_HDR_LEN     4
+#define LA66_UPLINK_REC_HDR_LEN 4
+
+struct la66_uplink_stats {
+  uint16_t records;     /* registros aceitos */
+  uint16_t uplinks;     /* payloads confirmados com OK */
+  uint16_t failures;    /* envios recusados ou sem resposta */
+  uint16_t dropped;     /* registros perdidos após esgotar as tentativas */
+  uint32_t airtime_ms;  /* tempo no ar acumulado */
+};
+
+/**
+ * Tempo no ar (ms) de um uplink de len bytes de aplicação no data rate dr
+ * da região configurada (inclui os 13 bytes de overhead LoRaWAN).
+ */
+uint32_t la66_airtime_ms(uint8_t dr, uint8_t len);
+
+/**
+ * Maior payload de aplicação aceito no data rate dr.
+ */
+uint8_t la66_max_payload(uint8_t dr);
+
+/**
+ * Segundos até o duty cycle permitir o próximo uplink (0 = já pode).
+ */
+unsigned long la66_duty_wait(void);
+
+/**
+ * Contabiliza um uplink de len bytes no data rate atual: soma o tempo no
+ * ar em airtime_ms e adia o próximo uplink conforme o duty cycle. Quem
+ * envia por fora do agregador (ex.: la66-store) deve chamar isto também.
+ */
+void la66_duty_account(uint8_t len);
+
+/**
+ * Inicia o processo agregador.
+ * @param port    FPort dos uplinks
+ * @param confirm 1 para uplinks confirmados
+ */
+void la66_uplink_init(uint8_t port, uint8_t confirm);
+
+/**
+ * Acrescenta um registro com carimbo clock_seconds().
+ * @return 0, ou -1 se o registro não couber em nenhum payload.
+ */
+int la66_uplink_add(uint8_t type, const void *data, uint8_t len);
+
+/** Envia o que estiver acumulado assim que o duty cycle permitir. */
+void la66_uplink_flush(void);
+
+/** Data rate em uso pelo módulo (define o tamanho máximo e o tempo no ar). */
+void la66_uplink_set_datarate(uint8_t dr);
+uint8_t la66_uplink_get_datarate(void);
+
+void la66_uplink_stats(struct la66_uplink_stats *stats);
+
+PROCESS_NAME(la66_uplink_process);
+
+#endif /* LA66_UPLINK_H_ */
@@ -4,63 +4,100 @@
 
 #include "contiki.h"
 #include "la66.h"
+#include "la66-link.h"
 #include "at-master.h"
+#include "la66-at.h"
+#include "software_uart_serial_line.h"
 #include <stdio.h>
 #include <string.h>
 
 /*---------------------------------------------------------------------------*/
-/* Definições de comandos AT específicos do LA66 */
-#define LA66_AT_RESET         "ATZ\r\n"
-#define LA66_AT_JOIN          "AT+JOIN\r\n"
-#define LA66_AT_SEND          "AT+SEND="
-#define LA66_AT_GET_STATUS    "AT+NJS=?\r\n"
-#define LA66_AT_CFG           "AT+CFG\r\n"
-
-/* Estrutura para armazenar respostas */
-struct la66_response {
-  uint16_t len;
-  char data[128];
-};
+/* Os comandos e respostas AT do LA66 estão na tabela de la66-at.h */
 
-/* Eventos do processo */
-process_event_t PROCESS_EVENT_LA66_RESPONSE; // <--- ADICIONE ESTA LINHA AQUI!
-PROCESS_NAME(la66_process);
+/* Tempo de linha para len bytes em hex: 20 bits por byte de payload */
+#define LA66_HEX_TX_TIME(len) \
+  ((clock_time_t)(((uint32_t)(len) * 20 * CLOCK_SECOND) / soft_uart_get_baud() + 1))
 
-/* Comandos AT */
-static struct at_cmd at_cmd_la66;
-static struct ctimer la66_timer;
-
-/* Comandos estruturas de confirmacao de resposta */
-static struct at_cmd at_cmd_ok_response;
-static struct at_cmd at_cmd_error_response;
-static struct at_cmd at_cmd_njs_response;
-
-static void handle_ok(struct at_cmd *cmd, uint8_t len, char *data);
-static void handle_error(struct at_cmd *cmd, uint8_t len, char *data);
-static void handle_njs(struct at_cmd *cmd, uint8_t len, char *data);
-static void join_timeout(void *ptr); // Ou a assinatura correta do seu timer callback
+/* Tempo de resposta e tentativas de cada comando na fila do at-master */
+#ifndef LA66_AT_TIMEOUT
+#define LA66_AT_TIMEOUT       (CLOCK_SECOND * 2)
+#endif
+#ifndef LA66_AT_RETRIES
+#define LA66_AT_RETRIES       2
+#endif
 
+/* Eco das respostas no console (0 para benchmarks e uso em produção) */
+#ifndef LA66_CONF_VERBOSE
+#define LA66_CONF_VERBOSE     1
+#endif
+#if LA66_CONF_VERBOSE && defined(__AVR__)
+/* Formato na flash, como os comandos */
+#define PRINTF(FORMAT, args...) printf_P(PSTR(FORMAT), ##args)
+#elif LA66_CONF_VERBOSE
+#define PRINTF(...) printf(__VA_ARGS__)
+#else
+#define PRINTF(...)
+#endif
 
+/* Downlinks (la66-downlink.c, LA66_CONF_DOWNLINK em la66-at.h) tratados
+   antes do handler padrão */
+#if LA66_CONF_DOWNLINK
+#include "la66-downlink.h"
+#endif
 
+/* Sono do módulo (AT+SLEEP) depois de LA66_SLEEP_IDLE sem tráfego AT. O
+   intervalo cobre as janelas RX1/RX2 (1 s e 2 s depois do uplink) */
+#ifndef LA66_CONF_SLEEP
+#define LA66_CONF_SLEEP       1
+#endif
+#ifndef LA66_SLEEP_IDLE
+#define LA66_SLEEP_IDLE       (CLOCK_SECOND * 10)
+#endif
+#if LA66_CONF_SLEEP
+static void la66_idle_restart(void);
+#else
+#define la66_idle_restart()
+#endif
 
+/* Eventos do processo */
+process_event_t PROCESS_EVENT_LA66_RESPONSE; // <--- ADICIONE ESTA LINHA AQUI!
+process_event_t PROCESS_EVENT_LA66_JOINED;
+PROCESS_NAME(la66_process);
 
+static void set_joined(uint8_t j);
 
 /*---------------------------------------------------------------------------*/
-/* Funções de callback */
-static void
-la66_callback(struct at_cmd *cmd, uint8_t len, char *data)
+/* Handler padrão (LA66_AT_RSP_DEFAULT): linhas sem outro handler */
+void
+la66_handle_default(struct at_cmd *cmd, uint16_t len, char *data)
 {
   static struct la66_response response;
-  
-  response.len = len;
-  if(len > 0 && data != NULL) {
-    memcpy(response.data, data, len < sizeof(response.data) ? len : sizeof(response.data)-1);
-    response.data[len] = '\0'; // Garante terminação nula
+
+  la66_idle_restart();
+#if LA66_CONF_DOWNLINK
+  /* Payload de downlink: entregue no lugar, sem passar pela cópia abaixo */
+  if(la66_downlink_input(data, len)) {
+    return;
   }
-  
+#endif
+  la66_response_copy(&response, data, len);
   process_post(&la66_process, PROCESS_EVENT_LA66_RESPONSE, &response);
 }
 /*---------------------------------------------------------------------------*/
+void
+la66_response_copy(struct la66_response *resp, const char *data, uint16_t len)
+{
+  if(data == NULL) {
+    len = 0;
+  }
+  if(len > sizeof(resp->data) - 1) {
+    len = sizeof(resp->data) - 1;
+  }
+  memcpy(resp->data, data, len);
+  resp->data[len] = '\0'; // Garante terminação nula
+  resp->len = len;
+}
+/*---------------------------------------------------------------------------*/
 /* Função de inicialização */
 static void
 init(void)
@@ -68,79 +105,270 @@ init(void)
   /* Inicializa interface AT (UART) */
   //at_init(1); // Usando UART1
   
-  /* Configura callback padrão */
-  at_register(&at_cmd_la66, PROCESS_CURRENT(), "", 0, 128, la66_callback);
-  
-  /* Reset do módulo */
-  at_send(LA66_AT_RESET, strlen(LA66_AT_RESET));
-  
-  printf("LA66 Driver Initialized\n");
+  /* Processo que recebe as respostas (aloca PROCESS_EVENT_LA66_RESPONSE) */
+  process_start(&la66_process, NULL);
 
-  /*Mensagens de Erro e Confirmacao*/
-  at_register(&at_cmd_ok_response, &la66_process, "OK", 2, 64, handle_ok);
-  at_register(&at_cmd_error_response, &la66_process, "ERROR", 5, 64, handle_error);
-  at_register(&at_cmd_njs_response, &la66_process, "+NJS:", 5, 64, handle_njs); // Exemplo para +NJS:
+  /* Tabela de respostas em PROGMEM (la66-at.h) */
+  la66_at_init();
   
-  /*Inicio da Rotina*/
-  at_send(LA66_AT_RESET, strlen(LA66_AT_RESET));
-  printf("LA66: Driver inicializado e comando ATZ enviado.\n");
-  ctimer_set(&la66_timer, CLOCK_SECOND * 2, NULL, NULL);
-
-
+  /*Inicio da Rotina: reset do módulo. Os próximos comandos ficam na fila
+    do at-master e só saem depois da resposta (ou timeout) do ATZ */
+  la66_wake();
+  at_enqueue_P(la66_at_cmd(LA66_AT_CMD_RESET), NULL, LA66_AT_TIMEOUT, 0,
+               NULL, NULL);
+  PRINTF("LA66: Driver inicializado e comando ATZ enviado.\n");
 }
 /*---------------------------------------------------------------------------*/
-/* Função para join na rede LoRaWAN */
+/* Função para join na rede LoRaWAN: o gerenciador de conexão (la66-link)
+   faz ATZ, AT+NJM e repete o AT+JOIN com backoff até o JOINED */
 static int
 join_network(uint8_t mode) // 0=ABP, 1=OTAA
 {
-  char cmd[32];
-  
-  /* Configura modo de join */
-  snprintf(cmd, sizeof(cmd), "AT+NJM=%d\r\n", mode);
-  at_send(cmd, strlen(cmd));
-  
-  /* Envia comando JOIN */
-  at_send(LA66_AT_JOIN, strlen(LA66_AT_JOIN));
-  
-  /* Configura timeout para join */
-  ctimer_set(&la66_timer, CLOCK_SECOND * 30, join_timeout, NULL);
-  
+  la66_link_start(mode);
   return 0;
 }
 /*---------------------------------------------------------------------------*/
 /* Função para enviar dados */
+static uint8_t send_pending;
+static struct process *send_client;
+
+/* Fim do AT+SEND/AT+SENDB: devolve a linha terminal ("OK", "...ERROR", ou
+   vazia em timeout) ao processo que pediu o envio */
+static void
+send_done(at_txn_status_t status, char *line, void *ptr)
+{
+  static struct la66_response result;
+
+  if(status == AT_TXN_RESPONSE) {
+    return;
+  }
+  send_pending = 0;
+  la66_idle_restart();
+  la66_link_tx_result(status == AT_TXN_OK);
+  if(send_client != NULL) {
+    la66_response_copy(&result, line, line != NULL ? strlen(line) : 0);
+    process_post(send_client, PROCESS_EVENT_LA66_RESPONSE, &result);
+    send_client = NULL;
+  }
+}
+
 static int
 send_data(uint8_t port, uint8_t confirm, const char *data)
 {
-  char cmd[64];
+  static char cmd[64];
   int len;
+
+  /* O buffer só é liberado quando o AT+SEND anterior terminar */
+  if(send_pending) {
+    return -1;
+  }
+  la66_wake();
   
   /* Monta comando AT+SEND */
-  len = snprintf(cmd, sizeof(cmd), "AT+SEND=%d,%d,%d,%s\r\n", 
-                 port, confirm, strlen(data), data);
+  len = snprintf_P(cmd, sizeof(cmd), PSTR("AT+SEND=%d,%d,%d,%s\r\n"),
+                   port, confirm, (int)strlen(data), data);
   
-  if(len > 0 && len < sizeof(cmd)) {
-    at_send(cmd, len);
+  if(len > 0 && len < sizeof(cmd) &&
+     at_enqueue(cmd, NULL, LA66_AT_TIMEOUT, LA66_AT_RETRIES, send_done, NULL) == AT_STATUS_OK) {
+    send_pending = 1;
+    send_client = PROCESS_CURRENT();
     return 0;
   }
   
   return -1;
 }
 /*---------------------------------------------------------------------------*/
+/* Envio binário: AT+SENDB=<confirm>,<porta>,<tamanho>,<hex>. O cabeçalho é
+   montado sem printf e o payload vai em hex direto do buffer do chamador
+   para a Soft UART (a ISR codifica os nibbles), sem cópia intermediária. */
+static struct {
+  const uint8_t *buf;
+  uint8_t len;
+  uint8_t port;
+  uint8_t confirm;
+} bin_send;
+
+static uint8_t
+put_dec(char *p, uint8_t v)
+{
+  uint8_t n = 0;
+
+  if(v >= 100) {
+    p[n++] = '0' + v / 100;
+    v %= 100;
+    p[n++] = '0' + v / 10;
+  } else if(v >= 10) {
+    p[n++] = '0' + v / 10;
+  }
+  p[n++] = '0' + v % 10;
+  return n;
+}
+
+static void
+send_bin_writer(void *ptr)
+{
+  /* "AT+SENDB=" + três campos de até 3 dígitos e suas vírgulas */
+  char hdr[sizeof("AT+SENDB=") + 12];
+  PGM_P sendb = la66_at_cmd(LA66_AT_CMD_SENDB);
+  uint8_t n = strlen_P(sendb);
+
+  memcpy_P(hdr, sendb, n);
+  n += put_dec(&hdr[n], bin_send.confirm);
+  hdr[n++] = ',';
+  n += put_dec(&hdr[n], bin_send.port);
+  hdr[n++] = ',';
+  n += put_dec(&hdr[n], bin_send.len);
+  hdr[n++] = ',';
+
+  at_send(hdr, n);
+  soft_uart_write_hex(bin_send.buf, bin_send.len, "\r\n", NULL);
+}
+
+int
+la66_send_bin(uint8_t port, uint8_t confirm, const uint8_t *buf, uint8_t len)
+{
+  if(send_pending || len > LA66_MAX_PAYLOAD || (buf == NULL && len > 0)) {
+    return -1;
+  }
+
+  la66_wake();
+  bin_send.buf = buf;
+  bin_send.len = len;
+  bin_send.port = port;
+  bin_send.confirm = confirm;
+
+  /* Timeout cobre o tempo de linha do payload em hex (2 chars por byte) */
+  if(at_enqueue_writer(send_bin_writer, NULL,
+                       LA66_AT_TIMEOUT + LA66_HEX_TX_TIME(len),
+                       LA66_AT_RETRIES, send_done, NULL) != AT_STATUS_OK) {
+    return -1;
+  }
+  send_pending = 1;
+  send_client = PROCESS_CURRENT();
+  return 0;
+}
+/*---------------------------------------------------------------------------*/
+/* Estado de join visto por +NJS: e JOINED */
+static uint8_t joined;
+
+static void
+set_joined(uint8_t j)
+{
+  joined = j;
+  if(j) {
+    process_post(PROCESS_BROADCAST, PROCESS_EVENT_LA66_JOINED, NULL);
+  }
+}
+
+int
+la66_is_joined(void)
+{
+  return joined;
+}
+/*---------------------------------------------------------------------------*/
 /* Função para verificar status de join */
+static void
+njs_done(at_txn_status_t status, char *line, void *ptr)
+{
+  if(status == AT_TXN_RESPONSE) {
+    line += sizeof("+NJS:") - 1;
+    while(*line == ' ') {
+      line++;
+    }
+    set_joined(*line == '1');
+  }
+}
+
 static int
 get_join_status(void)
 {
-  at_send(LA66_AT_GET_STATUS, strlen(LA66_AT_GET_STATUS));
-  return 0;
+  la66_wake();
+  return at_enqueue_P(la66_at_cmd(LA66_AT_CMD_GET_STATUS),
+                      la66_at_rsp(LA66_AT_RSP_NJS), LA66_AT_TIMEOUT,
+                      LA66_AT_RETRIES, njs_done, NULL) == AT_STATUS_OK ? 0 : -1;
 }
 /*---------------------------------------------------------------------------*/
 /* Função para obter configurações */
 static int
 get_config(void)
 {
-  at_send(LA66_AT_CFG, strlen(LA66_AT_CFG));
+  la66_wake();
+  return at_enqueue_P(la66_at_cmd(LA66_AT_CMD_CFG), NULL, LA66_AT_TIMEOUT,
+                      LA66_AT_RETRIES, NULL, NULL) == AT_STATUS_OK ? 0 : -1;
+}
+/*---------------------------------------------------------------------------*/
+/* Sono do módulo: o ctimer conta LA66_SLEEP_IDLE desde o último comando ou
+   linha recebida; sem nada na fila, o módulo vai para AT+SLEEP. O tempo
+   acordado vai para ENERGEST_TYPE_LISTEN. */
+#if LA66_CONF_SLEEP
+static struct ctimer idle_timer;
+static uint8_t sleeping;
+static clock_time_t awake_last;
+
+static void
+awake_flush(void)
+{
+  clock_time_t now = clock_time();
+
+  if(!sleeping) {
+    energest_type_set(ENERGEST_TYPE_LISTEN,
+                      energest_type_time(ENERGEST_TYPE_LISTEN) +
+                      (unsigned long)(clock_time_t)(now - awake_last) *
+                      RTIMER_ARCH_SECOND / CLOCK_SECOND);
+  }
+  awake_last = now;
+}
+
+static void
+idle_expired(void *ptr)
+{
+  awake_flush();
+  if(at_queue_len() > 0 || send_pending) {
+    ctimer_restart(&idle_timer);
+    return;
+  }
+  if(at_enqueue_P(la66_at_cmd(LA66_AT_CMD_SLEEP), NULL, LA66_AT_TIMEOUT, 0,
+                  NULL, NULL) == AT_STATUS_OK) {
+    sleeping = 1;
+  }
+}
+
+/* Linha recebida ou comando concluído: adia o sono (um módulo dormindo
+   só acorda por comando) */
+static void
+la66_idle_restart(void)
+{
+  if(!sleeping) {
+    awake_flush();
+    ctimer_set(&idle_timer, LA66_SLEEP_IDLE, idle_expired, NULL);
+  }
+}
+#endif
+
+void
+la66_wake(void)
+{
+#if LA66_CONF_SLEEP
+  awake_flush();
+  if(sleeping) {
+    /* O primeiro byte acorda a UART do módulo; o at-master repete o
+       comando se ele se perder */
+    sleeping = 0;
+    at_enqueue_P(la66_at_cmd(LA66_AT_CMD_WAKE), NULL, LA66_AT_TIMEOUT,
+                 LA66_AT_RETRIES, NULL, NULL);
+  }
+  ctimer_set(&idle_timer, LA66_SLEEP_IDLE, idle_expired, NULL);
+#endif
+}
+
+int
+la66_is_sleeping(void)
+{
+#if LA66_CONF_SLEEP
+  return sleeping;
+#else
   return 0;
+#endif
 }
 /*---------------------------------------------------------------------------*/
 /* Estrutura do driver */
@@ -150,33 +378,30 @@ const struct la66_driver LA66_DRIVER = {
   send_data,
   get_join_status,
   get_config,
+  la66_send_bin,
 };
 /*---------------------------------------------------------------------------*/
 /*Confirmacao de erros ou de sucessos*/
-static void handle_ok(struct at_cmd *cmd, uint8_t len, char *data) {
-    printf("LA66: OK received.\n");
+void la66_handle_ok(struct at_cmd *cmd, uint16_t len, char *data) {
+    PRINTF("LA66: OK received.\n");
     // Sinalizar sucesso para o processo principal, talvez via process_post
 }
-static void handle_error(struct at_cmd *cmd, uint8_t len, char *data) {
-    printf("LA66: ERROR received.\n");
+void la66_handle_error(struct at_cmd *cmd, uint16_t len, char *data) {
+    PRINTF("LA66: ERROR received.\n");
     // Sinalizar falha
 }
-static void handle_njs(struct at_cmd *cmd, uint8_t len, char *data) {
-    printf("LA66: NJS response: %.*s\n", len, data);
+void la66_handle_njs(struct at_cmd *cmd, uint16_t len, char *data) {
+    PRINTF("LA66: NJS response: %.*s\n", len, data);
     // Analisar o status de join e atualizar o estado interno do driver
 }
-
-// Em la66.c, perto das outras callbacks ou funções auxiliares
-static void
-join_timeout(void *ptr)
-{
-  printf("LA66: Timeout ao tentar join na rede.\n");
-  // Implemente aqui a lógica para lidar com o timeout,
-  // como tentar novamente ou sinalizar um erro.
+void la66_handle_joined(struct at_cmd *cmd, uint16_t len, char *data) {
+    PRINTF("Network joined successfully!\n");
+    set_joined(1);
 }
 
 
 
+
 /*---------------------------------------------------------------------------*/
 /* Processo LA66 */
 PROCESS(la66_process, "LA66 LoRaWAN Driver");
@@ -185,6 +410,7 @@ PROCESS_THREAD(la66_process, ev, data)
 {
   PROCESS_BEGIN();
   PROCESS_EVENT_LA66_RESPONSE = process_alloc_event();
+  PROCESS_EVENT_LA66_JOINED = process_alloc_event();
   
   while(1) {
     PROCESS_WAIT_EVENT();
@@ -193,12 +419,7 @@ PROCESS_THREAD(la66_process, ev, data)
       struct la66_response *resp = (struct la66_response *)data;
       
       if(resp != NULL && resp->len > 0) {
-        printf("LA66 Response: %.*s\n", resp->len, resp->data);
-        
-        // Aqui você pode adicionar tratamento específico para respostas
-        if(strstr(resp->data, "JOINED")) {
-          printf("Network joined successfully!\n");
-        }
+        PRINTF("LA66 Response: %.*s\n", resp->len, resp->data);
       }
     }
   }
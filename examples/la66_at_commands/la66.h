@@ -6,6 +6,23 @@
 /* Eventos */
 extern process_event_t PROCESS_EVENT_LA66_RESPONSE;
 
+/* Broadcast a cada confirmação de join (+NJS:1 ou JOINED), não só na
+   transição, para quem espera o link voltar depois de uma falha */
+extern process_event_t PROCESS_EVENT_LA66_JOINED;
+
+/* Dados de PROCESS_EVENT_LA66_RESPONSE. Também é postado ao processo que
+   chamou send_data()/send_bin() quando o envio termina: data é "OK", uma
+   linha terminando em ERROR, ou vazia (len 0) em timeout. */
+struct la66_response {
+  uint16_t len;
+  char data[128];
+};
+
+void la66_response_copy(struct la66_response *resp, const char *data, uint16_t len);
+
+/* Maior payload LoRaWAN (aplicação) aceito pelo módulo */
+#define LA66_MAX_PAYLOAD 242
+
 /* Estrutura do driver */
 struct la66_driver {
   void (* init)(void);
@@ -13,8 +30,29 @@ struct la66_driver {
   int (* send_data)(uint8_t port, uint8_t confirm, const char *data);
   int (* get_join_status)(void);
   int (* get_config)(void);
+  int (* send_bin)(uint8_t port, uint8_t confirm, const uint8_t *buf, uint8_t len);
 };
 
+/**
+ * Envia um payload binário (AT+SENDB, hex) sem formatar em RAM. buf deve
+ * continuar válido até o comando terminar; retorna -1 se já houver um envio
+ * pendente ou len > LA66_MAX_PAYLOAD.
+ */
+int la66_send_bin(uint8_t port, uint8_t confirm, const uint8_t *buf, uint8_t len);
+
+/** 1 se o último +NJS: ou JOINED indicou que o módulo está na rede */
+int la66_is_joined(void);
+
+/**
+ * Acorda o módulo (enfileira AT+SLEEP=0) se ele estiver dormindo e
+ * reinicia a contagem de inatividade. Chamado pelo driver antes de cada
+ * comando; quem usa at_enqueue() direto deve chamar antes também.
+ */
+void la66_wake(void);
+
+/** 1 depois do AT+SLEEP=1, até o próximo la66_wake() */
+int la66_is_sleeping(void);
+
 /* Instância do driver */
 extern const struct la66_driver LA66_DRIVER;
 
@@ -3,8 +3,10 @@
 #include "software_uart_serial_line.h"        // Sua Software UART (D2/D3)
 #include "serial-line.h"  // Módulo serial-line
 #include "la66.h"             // Seu driver LA66
+#include "la66-store.h"       // Fila persistente de uplinks
+#include "la66-downlink.h"    // Downlinks por FPort
 #include <stdio.h>            // Para printf
-#include <string.h>           // Para strlen, strstr
+#include <string.h>           // Para strlen
 
 /*---------------------------------------------------------------------------*/
 // Processo principal da sua aplicação
@@ -15,63 +17,61 @@ AUTOSTART_PROCESSES(&soft_uart_serial_line_test_process); // Garante que este pr
 // Mapeamento para comando AT+VER=? (exemplo)
 #define LA66_AT_GET_VERSION   "AT+VER=?\r\n" // Verifique no datasheet do LA66 qual é o comando real para versão!
 
-// Variáveis para registrar callbacks de resposta específicas
-static struct at_cmd at_cmd_ok_response;
-static struct at_cmd at_cmd_error_response;
-static struct at_cmd at_cmd_njs_response_callback_struct; // Callback para resposta de status de join
+// Variáveis para registrar callbacks de resposta específicas. OK, ERROR e
+// +NJS: ficam na tabela PROGMEM de la66.c (LA66_AT_RESPONSES), que vence
+// os empates: registrar esses cabeçalhos aqui não teria efeito.
 static struct at_cmd at_cmd_ver_response_callback_struct; // Callback para resposta de versão
-
-
-// Variáveis de estado global para o LA66 (opcional, pode ser movido para la66.c)
-static volatile uint8_t la66_joined_status = 0; // 0 = not joined, 1 = joined
+static struct at_cmd at_cmd_join_accepted_callback_struct; // Callback para join aceito
 
 /*---------------------------------------------------------------------------*/
 // Funções de callback para respostas AT específicas
 
-// Callback para a resposta "OK"
+// Callback para a resposta do comando AT+VER=? (Versão do Firmware)
 static void
-handle_ok_response(struct at_cmd *cmd, uint8_t len, char *data)
+handle_version_response(struct at_cmd *cmd, uint16_t len, char *data)
 {
-  printf("APP: LA66 respondeu OK.\n");
-  // Aqui você pode adicionar lógica para avançar um estado, se necessário
+  printf("APP: LA66 Versão do Firmware (AT+VER=?): %.*s\n", len, data);
+  // Você pode armazenar a versão em uma variável aqui, se precisar
 }
 
-// Callback para a resposta "ERROR"
+// Callback para a resposta do comando AT+JOIN (Se o LA66 responder com "+JOIN: Accepted")
 static void
-handle_error_response(struct at_cmd *cmd, uint8_t len, char *data)
+handle_join_accepted_response(struct at_cmd *cmd, uint16_t len, char *data)
 {
-  printf("APP: LA66 respondeu ERROR: %.*s\n", len, data);
-  // Aqui você pode adicionar lógica para tratar erros, como tentar novamente
+  printf("APP: LA66 JOIN ACCEPTED: %.*s\n", len, data);
+  // O estado de join fica no driver: veja la66_is_joined()
 }
 
-// Callback para a resposta do comando AT+NJS=? (Status de Join)
+// Downlink na FPort 2: o payload já chega em bytes, no buffer da linha
 static void
-handle_njs_response(struct at_cmd *cmd, uint8_t len, char *data)
+handle_downlink(const struct la66_downlink *dl)
 {
-  printf("APP: LA66 Status de Join (AT+NJS=?): %.*s\n", len, data);
-  if (strstr(data, "+NJS:1")) { // Verifique o formato exato da resposta no datasheet
-    la66_joined_status = 1;
-    printf("APP: LA66 está conectado à rede LoRaWAN.\n");
-  } else {
-    la66_joined_status = 0;
-    printf("APP: LA66 NÃO está conectado à rede LoRaWAN.\n");
-  }
-}
+  uint8_t i;
 
-// Callback para a resposta do comando AT+VER=? (Versão do Firmware)
-static void
-handle_version_response(struct at_cmd *cmd, uint8_t len, char *data)
-{
-  printf("APP: LA66 Versão do Firmware (AT+VER=?): %.*s\n", len, data);
-  // Você pode armazenar a versão em uma variável aqui, se precisar
+  printf("APP: downlink porta %u (RSSI %d, SNR %d), %u bytes:",
+         dl->port, dl->rssi, dl->snr, dl->len);
+  for(i = 0; i < dl->len; i++) {
+    printf(" %02x", dl->data[i]);
+  }
+  printf("\n");
 }
 
-// Callback para a resposta do comando AT+JOIN (Se o LA66 responder com "+JOIN: Accepted")
+// CPU/LPM do ATmega e tempo acordado/no ar do LA66 (energest, em ticks
+// de rtimer)
 static void
-handle_join_accepted_response(struct at_cmd *cmd, uint8_t len, char *data)
+print_energest(void)
 {
-  printf("APP: LA66 JOIN ACCEPTED: %.*s\n", len, data);
-  la66_joined_status = 1; // Marca como conectado
+  unsigned long cpu = energest_type_time(ENERGEST_TYPE_CPU);
+  unsigned long lpm = energest_type_time(ENERGEST_TYPE_LPM);
+  unsigned long listen = energest_type_time(ENERGEST_TYPE_LISTEN);
+  unsigned long tx = energest_type_time(ENERGEST_TYPE_TRANSMIT);
+  unsigned long total = (cpu + lpm) / 100;
+
+  printf("APP: CPU %lu%%, LPM %lu%%; LA66 acordado %lu s, no ar %lu.%02lu s%s\n",
+         total ? cpu / total : 0, total ? lpm / total : 0,
+         listen / RTIMER_ARCH_SECOND, tx / RTIMER_ARCH_SECOND,
+         (tx % RTIMER_ARCH_SECOND) * 100 / RTIMER_ARCH_SECOND,
+         la66_is_sleeping() ? " (dormindo)" : "");
 }
 
 /*---------------------------------------------------------------------------*/
@@ -83,7 +83,7 @@ PROCESS_THREAD(soft_uart_serial_line_test_process, ev, data)
 
   // 1. Inicializar a Software UART (D2/D3)
   soft_uart_init();
-  printf("Software UART (D2/D3) inicializada com %u baud.\n", (unsigned int)SOFT_UART_BAUD_RATE);
+  printf("Software UART (D10/D11) inicializada com %lu baud.\n", (unsigned long)soft_uart_get_baud());
 
   // 2. Inicializar o módulo serial-line (necessário para o at-master)
   serial_line_init();
@@ -94,11 +94,8 @@ PROCESS_THREAD(soft_uart_serial_line_test_process, ev, data)
 
   // 4. Registrar as callbacks de resposta específicas no at-master
   // Use o processo 'la66_process' para receber os eventos das callbacks
-  at_register(&at_cmd_ok_response, &la66_process, "OK", strlen("OK"), 64, handle_ok_response);
-  at_register(&at_cmd_error_response, &la66_process, "ERROR", strlen("ERROR"), 64, handle_error_response);
-  at_register(&at_cmd_njs_response_callback_struct, &la66_process, "+NJS:", strlen("+NJS:"), 64, handle_njs_response);
   at_register(&at_cmd_ver_response_callback_struct, &la66_process, "+VER:", strlen("+VER:"), 64, handle_version_response); // Ajuste "+VER:" para a resposta real do LA66
-  at_register(NULL, &la66_process, "+JOIN: Accepted", strlen("+JOIN: Accepted"), 64, handle_join_accepted_response); // Callback para join aceito
+  at_register(&at_cmd_join_accepted_callback_struct, &la66_process, "+JOIN: Accepted", strlen("+JOIN: Accepted"), 64, handle_join_accepted_response); // Callback para join aceito
 
   printf("AT Master inicializado e callbacks registradas.\n");
 
@@ -106,20 +103,27 @@ PROCESS_THREAD(soft_uart_serial_line_test_process, ev, data)
   LA66_DRIVER.init();
   printf("LA66 Driver iniciado. Enviando ATZ para reset...\n");
 
-  // Configura um timer para enviar comandos periodicamente
-  etimer_set(&et, CLOCK_SECOND * 10); // A cada 10 segundos
+  // Join OTAA pelo gerenciador de conexão (backoff e reconexão automáticos)
+  LA66_DRIVER.join_network(1);
+
+  // 6. Downlinks na FPort 2 (as demais portas não têm handler)
+  la66_downlink_register(2, handle_downlink);
+
+  // 7. Fila persistente: uplinks guardados em quedas anteriores saem assim
+  //    que o módulo confirmar o join
+  printf("LA66 store: %d uplinks pendentes.\n", la66_store_init());
+
+  // Relatório de energia periódico. O gerenciador de conexão já confere o
+  // join sozinho; sem consultas periódicas o LA66 pode dormir entre uplinks.
+  etimer_set(&et, CLOCK_SECOND * 60);
 
   while(1) {
     PROCESS_WAIT_EVENT();
 
     if(ev == PROCESS_EVENT_TIMER) {
       if(etimer_expired(&et)) {
-        printf("\n--- Novo ciclo de comandos ---\n");
-
-        // 1. Consultar status de join
-        LA66_DRIVER.get_join_status();
-        etimer_set(&et, CLOCK_SECOND * 2); // Espera um pouco antes do próximo comando
-
+        print_energest();
+        etimer_reset(&et);
       }
     }
     // Opcional: Você pode adicionar mais lógica aqui para reagir a outros eventos do LA66_DRIVER
@@ -0,0 +1,336 @@
+/*
+ * Emulador do LA66 (lado do módulo) para a plataforma native
+ */
+
+#include "contiki.h"
+#include "lib/random.h"
+#include "software_uart_serial_line.h"
+#include "la66-emu.h"
+#include <stdlib.h>
+#include <string.h>
+
+/*---------------------------------------------------------------------------*/
+/* AT+SENDB com 242 bytes em hex cabe com folga */
+#define EMU_CMD_SIZE  520
+
+/* Linhas de resposta ainda não entregues. Cada slot só é reaproveitado
+   depois de EMU_OUT_SLOTS linhas, bem depois dos processos tratarem o
+   evento. */
+#define EMU_OUT_SLOTS 16
+
+/* Tempo de linha de n caracteres (start + 8 dados + stop) */
+#define LINE_TIME(n) \
+  ((clock_time_t)((uint64_t)(n) * 10 * CLOCK_SECOND / cfg.baud))
+
+process_event_t soft_uart_line_event;
+process_event_t soft_uart_tx_done_event;
+
+static struct la66_emu_config cfg = {
+  SOFTWARE_UART_BAUD_RATE, CLOCK_SECOND / 50, CLOCK_SECOND * 2, 0, 0
+};
+static struct la66_emu_stats stats;
+
+static char cmd[EMU_CMD_SIZE];
+static uint16_t cmd_len;
+static uint8_t cmd_overflow;
+static clock_time_t tx_until;    /* fim do último caractere na linha */
+
+static struct {
+  struct soft_uart_line line;
+  clock_time_t due;
+} out[EMU_OUT_SLOTS];
+static uint8_t out_head;
+static uint8_t out_count;
+static clock_time_t out_last;    /* fim da última linha agendada */
+static struct ctimer out_timer;
+
+static uint8_t joined;
+static struct ctimer join_timer;
+/*---------------------------------------------------------------------------*/
+static void deliver(void *ptr);
+
+static void
+arm(void)
+{
+  clock_time_t now = clock_time();
+  clock_time_t due;
+
+  if(out_count > 0) {
+    due = out[out_head].due;
+    ctimer_set(&out_timer, due > now ? due - now : 0, deliver, NULL);
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+deliver(void *ptr)
+{
+  clock_time_t now = clock_time();
+
+  while(out_count > 0 && out[out_head].due <= now) {
+    process_post_high(PROCESS_BROADCAST, soft_uart_line_event,
+                      &out[out_head].line);
+    stats.lines++;
+    out_head = (out_head + 1) % EMU_OUT_SLOTS;
+    out_count--;
+  }
+  arm();
+}
+/*---------------------------------------------------------------------------*/
+/* Agenda uma linha de resposta para depois de ready (e da linha anterior).
+   Nenhuma resposta do emulador tem a forma "<porta>:<hex>", então a linha
+   é copiada como texto, sem a decodificação hex da ISR. */
+static void
+emit(const char *s, clock_time_t ready)
+{
+  uint8_t slot;
+  uint16_t len = strlen(s);
+  clock_time_t t;
+
+  if(out_count == EMU_OUT_SLOTS) {
+    return;
+  }
+  slot = (out_head + out_count) % EMU_OUT_SLOTS;
+  out[slot].line.flags = 0;
+  if(len > SOFT_UART_LINE_SIZE - 1) {
+    out[slot].line.flags = SOFT_UART_LINE_F_TRUNCATED;
+    len = SOFT_UART_LINE_SIZE - 1;
+  }
+  memcpy(out[slot].line.data, s, len);
+  out[slot].line.data[len] = '\0';
+  out[slot].line.len = len;
+
+  t = ready > out_last ? ready : out_last;
+  t += LINE_TIME(len + 2);
+  out[slot].due = out_last = t;
+  if(out_count++ == 0) {
+    arm();
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+join_done(void *ptr)
+{
+  joined = 1;
+  emit("JOINED", clock_time());
+}
+/*---------------------------------------------------------------------------*/
+static uint8_t
+is_hex(char c)
+{
+  return (c >= '0' && c <= '9') || (c >= 'A' && c <= 'F') ||
+         (c >= 'a' && c <= 'f');
+}
+/*---------------------------------------------------------------------------*/
+/* AT+SEND=c,p,len,texto / AT+SENDB=c,p,len,hex: confere o tamanho */
+static uint8_t
+payload_ok(const char *args, uint8_t hex)
+{
+  const char *p;
+  int len;
+  int n;
+
+  /* Pula confirmação e porta; o terceiro campo é o tamanho em bytes */
+  if((p = strchr(args, ',')) == NULL || (p = strchr(p + 1, ',')) == NULL) {
+    return 0;
+  }
+  len = atoi(++p);
+  if((p = strchr(p, ',')) == NULL) {
+    return 0;
+  }
+  p++;
+  n = strlen(p);
+  if(!hex) {
+    return n == len;
+  }
+  if(n != 2 * len || len > 242) {
+    return 0;
+  }
+  while(*p != '\0') {
+    if(!is_hex(*p++)) {
+      return 0;
+    }
+  }
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
+static void
+handle(const char *c, clock_time_t ready)
+{
+  const char *result = "OK";
+
+  stats.commands++;
+
+  if(cfg.drop_pct > 0 && random_rand() % 100 < cfg.drop_pct) {
+    stats.drops++;
+    return;
+  }
+  if(cfg.error_pct > 0 && random_rand() % 100 < cfg.error_pct) {
+    result = "ERROR";
+  } else if(strcmp(c, "ATZ") == 0) {
+    joined = 0;
+    ctimer_stop(&join_timer);
+    emit("LA66 emulator", ready);
+  } else if(strncmp(c, "AT+NJM=", 7) == 0) {
+    /* nada a fazer */
+  } else if(strcmp(c, "AT+JOIN") == 0) {
+    ctimer_set(&join_timer, ready - clock_time() + cfg.join_delay,
+               join_done, NULL);
+  } else if(strcmp(c, "AT+NJS=?") == 0) {
+    emit(joined ? "+NJS:1" : "+NJS:0", ready);
+  } else if(strncmp(c, "AT+SENDB=", 9) == 0) {
+    if(!joined || !payload_ok(&c[9], 1)) {
+      result = "ERROR";
+    }
+  } else if(strncmp(c, "AT+SEND=", 8) == 0) {
+    if(!joined || !payload_ok(&c[8], 0)) {
+      result = "ERROR";
+    }
+  } else if(strcmp(c, "AT+CFG") == 0) {
+    emit("AT+DEUI=00 00 00 00 00 00 00 01", ready);
+    emit("AT+APPEUI=00 00 00 00 00 00 00 00", ready);
+    emit("AT+ADR=1", ready);
+    emit("AT+DR=5", ready);
+    emit(joined ? "AT+NJS=1" : "AT+NJS=0", ready);
+  } else if(strcmp(c, "AT+SLEEP=0") == 0 || strcmp(c, "AT+SLEEP=1") == 0) {
+    /* nada a fazer: a UART do emulador nunca dorme */
+  } else if(strcmp(c, "AT+VER=?") == 0) {
+    emit("+VER:v1.0.0-emu EU868", ready);
+  } else {
+    result = "ERROR";
+  }
+
+  if(result[0] == 'E') {
+    stats.errors++;
+  }
+  emit(result, ready);
+}
+/*---------------------------------------------------------------------------*/
+/* Bytes escritos pelo master: monta a linha de comando */
+static void
+feed(const uint8_t *data, uint16_t len)
+{
+  clock_time_t now = clock_time();
+  uint16_t i;
+
+  tx_until = (tx_until > now ? tx_until : now) + LINE_TIME(len);
+  stats.tx_chars += len;
+
+  for(i = 0; i < len; i++) {
+    if(data[i] == '\r') {
+      continue;
+    }
+    if(data[i] != '\n') {
+      if(cmd_len < sizeof(cmd) - 1) {
+        cmd[cmd_len++] = data[i];
+      } else {
+        cmd_overflow = 1;
+      }
+      continue;
+    }
+    cmd[cmd_len] = '\0';
+    if(cmd_overflow) {
+      stats.commands++;
+      stats.errors++;
+      emit("ERROR", tx_until + cfg.latency);
+    } else if(cmd_len > 0) {
+      handle(cmd, tx_until + cfg.latency);
+    }
+    cmd_len = 0;
+    cmd_overflow = 0;
+  }
+}
+/*---------------------------------------------------------------------------*/
+void
+la66_emu_configure(const struct la66_emu_config *config)
+{
+  cfg = *config;
+  if(cfg.baud == 0) {
+    cfg.baud = SOFTWARE_UART_BAUD_RATE;
+  }
+}
+/*---------------------------------------------------------------------------*/
+void
+la66_emu_stats(struct la66_emu_stats *s)
+{
+  *s = stats;
+}
+/*---------------------------------------------------------------------------*/
+/* API da Soft UART */
+void
+soft_uart_init(void)
+{
+  if(soft_uart_tx_done_event == 0) {
+    soft_uart_tx_done_event = process_alloc_event();
+    soft_uart_line_event = process_alloc_event();
+  }
+}
+/*---------------------------------------------------------------------------*/
+void
+soft_uart_write_byte(uint8_t data)
+{
+  feed(&data, 1);
+}
+/*---------------------------------------------------------------------------*/
+int
+soft_uart_write_string(const char *str)
+{
+  uint16_t len = strlen(str);
+
+  feed((const uint8_t *)str, len);
+  return len;
+}
+/*---------------------------------------------------------------------------*/
+uint8_t
+soft_uart_write_async(const uint8_t *data, uint8_t len, struct process *p)
+{
+  feed(data, len);
+  if(p != NULL) {
+    process_post_high(p, soft_uart_tx_done_event, NULL);
+  }
+  return len;
+}
+/*---------------------------------------------------------------------------*/
+int
+soft_uart_write_hex(const uint8_t *data, uint8_t len, const char *suffix,
+                    struct process *p)
+{
+  static const char hex_digits[] = "0123456789ABCDEF";
+  uint8_t pair[2];
+  uint8_t i;
+
+  for(i = 0; i < len; i++) {
+    pair[0] = hex_digits[data[i] >> 4];
+    pair[1] = hex_digits[data[i] & 0x0f];
+    feed(pair, 2);
+  }
+  if(suffix != NULL) {
+    feed((const uint8_t *)suffix, strlen(suffix));
+  }
+  if(p != NULL) {
+    process_post_high(p, soft_uart_tx_done_event, NULL);
+  }
+  return 0;
+}
+/*---------------------------------------------------------------------------*/
+uint8_t
+soft_uart_tx_busy(void)
+{
+  return tx_until > clock_time();
+}
+/*---------------------------------------------------------------------------*/
+int
+soft_uart_set_baud(uint32_t baud)
+{
+  if(baud == 0) {
+    return -1;
+  }
+  cfg.baud = baud;
+  return 0;
+}
+/*---------------------------------------------------------------------------*/
+uint32_t
+soft_uart_get_baud(void)
+{
+  return cfg.baud;
+}
+/*---------------------------------------------------------------------------*/
@@ -0,0 +1,40 @@
+#ifndef LA66_EMU_H_
+#define LA66_EMU_H_
+
+#include "contiki.h"
+
+/*
+ * Emulador do módulo LA66 para a plataforma native.
+ *
+ * Implementa a Soft UART (software_uart_serial_line.h) do lado do host: os
+ * comandos escritos pelo at-master são interpretados aqui e as respostas
+ * voltam em soft_uart_line_event, com o atraso que o módulo real
+ * teria: tempo de linha do comando no baud configurado, latência de
+ * processamento e tempo de linha de cada resposta.
+ *
+ * Comandos: ATZ, AT+NJM=, AT+JOIN, AT+NJS=?, AT+SEND=, AT+SENDB=, AT+CFG e
+ * AT+VER=?. Qualquer outro responde ERROR.
+ */
+
+struct la66_emu_config {
+  uint32_t baud;           /* ritmo da linha: 10 bits por caractere */
+  clock_time_t latency;    /* processamento de cada comando no módulo */
+  clock_time_t join_delay; /* AT+JOIN até o JOINED */
+  uint8_t error_pct;       /* % de comandos respondidos com ERROR */
+  uint8_t drop_pct;        /* % de comandos sem resposta (timeout) */
+};
+
+struct la66_emu_stats {
+  uint32_t commands;       /* linhas de comando recebidas */
+  uint32_t errors;         /* ERROR respondidos (injetados ou não) */
+  uint32_t drops;          /* comandos ignorados de propósito */
+  uint32_t lines;          /* linhas de resposta entregues */
+  uint32_t tx_chars;       /* caracteres recebidos do master */
+};
+
+/** Aplica uma configuração; pode ser chamada a qualquer momento. */
+void la66_emu_configure(const struct la66_emu_config *config);
+
+void la66_emu_stats(struct la66_emu_stats *stats);
+
+#endif /* LA66_EMU_H_ */
@@ -0,0 +1,270 @@
+/*
+ * Benchmark do link AT (at-master + la66.c) contra o emulador do LA66.
+ *
+ * Uso: ./la66_bench.native [comandos] [latência ms] [baud] [%erro] [%perda]
+ *
+ * Faz ATZ + join pelo driver e depois mantém a fila do at-master cheia com
+ * uma mistura de AT+NJS=?, AT+VER=?, AT+CFG, AT+SEND e AT+SENDB (este pelo
+ * LA66_DRIVER.send_bin). No fim imprime comandos/s, latência de ida e volta
+ * (p50/p99/máx., do enfileiramento até o OK/ERROR/timeout) e a ocupação
+ * da fila.
+ */
+
+#include "contiki.h"
+#include "at-master.h"
+#include "software_uart_serial_line.h"
+#include "la66.h"
+#include "la66-emu.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*---------------------------------------------------------------------------*/
+#define BENCH_DEFAULT_COMMANDS 1000
+#define BENCH_TIMEOUT          (CLOCK_SECOND / 2)
+#define BENCH_JOIN_TIMEOUT     (CLOCK_SECOND * 10)
+
+extern int contiki_argc;
+extern char **contiki_argv;
+
+static const char *const mix[] = {
+  "AT+NJS=?\r\n",
+  "AT+VER=?\r\n",
+  "AT+SEND=0,2,8,bench-01\r\n",
+  "AT+CFG\r\n",
+};
+#define MIX_COUNT (sizeof(mix) / sizeof(mix[0]))
+
+/* Um AT+SENDB a cada BIN_EVERY comandos */
+#define BIN_EVERY 8
+
+static const uint8_t bin_payload[24] = {
+  0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08,
+  0x09, 0x0a, 0x0b, 0x0c, 0x0d, 0x0e, 0x0f, 0x10,
+  0x11, 0x12, 0x13, 0x14, 0x15, 0x16, 0x17, 0x18,
+};
+
+static uint32_t total;
+static uint32_t issued;
+static uint32_t done;
+static uint32_t ok, errors, timeouts;
+static clock_time_t *latency;
+static clock_time_t start[AT_QUEUE_SIZE];
+static uint8_t slot_used[AT_QUEUE_SIZE];
+static clock_time_t bin_start;
+static uint8_t bin_pending;
+static uint32_t depth_sum, depth_samples;
+static uint8_t depth_max;
+/* Linhas da UART entregues a este processo: com AT_EXCLUSIVE_LINES só o
+   at-master deve recebê-las */
+static uint32_t stray_lines;
+
+PROCESS(la66_bench_process, "LA66 AT link benchmark");
+AUTOSTART_PROCESSES(&la66_bench_process);
+/*---------------------------------------------------------------------------*/
+static void
+record(clock_time_t t0, uint8_t status)
+{
+  latency[done++] = clock_time() - t0;
+  if(status == AT_TXN_OK) {
+    ok++;
+  } else if(status == AT_TXN_ERROR) {
+    errors++;
+  } else {
+    timeouts++;
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+txn_done(at_txn_status_t status, char *line, void *ptr)
+{
+  uint8_t slot = (uint8_t)(uintptr_t)ptr;
+
+  if(status == AT_TXN_RESPONSE) {
+    return;
+  }
+  slot_used[slot] = 0;
+  record(start[slot], status);
+  process_poll(&la66_bench_process);
+}
+/*---------------------------------------------------------------------------*/
+static void
+sample_depth(void)
+{
+  uint8_t d = at_queue_len();
+
+  depth_sum += d;
+  depth_samples++;
+  if(d > depth_max) {
+    depth_max = d;
+  }
+}
+/*---------------------------------------------------------------------------*/
+/* Enche a fila do at-master até AT_QUEUE_SIZE */
+static void
+fill_queue(void)
+{
+  uint8_t slot;
+
+  while(issued < total && at_queue_len() < AT_QUEUE_SIZE) {
+    if(issued % BIN_EVERY == BIN_EVERY - 1) {
+      if(bin_pending) {
+        return;
+      }
+      if(LA66_DRIVER.send_bin(2, 0, bin_payload, sizeof(bin_payload)) != 0) {
+        return;
+      }
+      bin_pending = 1;
+      bin_start = clock_time();
+    } else {
+      for(slot = 0; slot < AT_QUEUE_SIZE && slot_used[slot]; slot++);
+      if(slot == AT_QUEUE_SIZE) {
+        return;
+      }
+      start[slot] = clock_time();
+      if(at_enqueue(mix[issued % MIX_COUNT], NULL, BENCH_TIMEOUT, 0,
+                    txn_done, (void *)(uintptr_t)slot) != AT_STATUS_OK) {
+        return;
+      }
+      slot_used[slot] = 1;
+    }
+    issued++;
+    sample_depth();
+  }
+}
+/*---------------------------------------------------------------------------*/
+static int
+cmp_clock(const void *a, const void *b)
+{
+  clock_time_t x = *(const clock_time_t *)a;
+  clock_time_t y = *(const clock_time_t *)b;
+
+  return x < y ? -1 : x > y;
+}
+/*---------------------------------------------------------------------------*/
+static unsigned long
+ms(clock_time_t t)
+{
+  return (unsigned long)t * 1000 / CLOCK_SECOND;
+}
+/*---------------------------------------------------------------------------*/
+static void
+report(clock_time_t elapsed)
+{
+  struct la66_emu_stats es;
+#if PROCESS_CONF_STATS
+  struct process_lane_stats hi, lo;
+
+  process_lane_stats(PROCESS_LANE_HIGH, &hi);
+  process_lane_stats(PROCESS_LANE_NORMAL, &lo);
+#endif
+
+  la66_emu_stats(&es);
+  qsort(latency, done, sizeof(clock_time_t), cmp_clock);
+
+  printf("commands   %lu (ok %lu, error %lu, timeout %lu)\n",
+         (unsigned long)done, (unsigned long)ok,
+         (unsigned long)errors, (unsigned long)timeouts);
+  printf("elapsed    %lu ms\n", ms(elapsed));
+  printf("throughput %lu.%02lu cmd/s\n",
+         (unsigned long)(done * 1000UL / ms(elapsed ? elapsed : 1)),
+         (unsigned long)(done * 100000UL / ms(elapsed ? elapsed : 1)) % 100);
+  printf("latency    p50 %lu ms, p99 %lu ms, max %lu ms\n",
+         ms(latency[done / 2]), ms(latency[(done * 99) / 100]),
+         ms(latency[done - 1]));
+  printf("queue      avg %lu.%02lu, max %u (of %u)\n",
+         (unsigned long)(depth_sum / depth_samples),
+         (unsigned long)(depth_sum * 100 / depth_samples) % 100,
+         depth_max, AT_QUEUE_SIZE);
+  printf("emulator   %lu commands, %lu lines, %lu errors, %lu dropped\n",
+         (unsigned long)es.commands, (unsigned long)es.lines,
+         (unsigned long)es.errors, (unsigned long)es.drops);
+  printf("lines      %lu delivered outside at-master%s\n",
+         (unsigned long)stray_lines,
+         AT_EXCLUSIVE_LINES ? " (exclusive)" : "");
+#if PROCESS_CONF_STATS
+  printf("events     high max %u (of %u), normal max %u (of %u), "
+         "overflows %u/%u\n", hi.maxevents, hi.size, lo.maxevents, lo.size,
+         hi.overflows, lo.overflows);
+#endif
+}
+/*---------------------------------------------------------------------------*/
+PROCESS_THREAD(la66_bench_process, ev, data)
+{
+  static struct etimer et;
+  static struct la66_emu_config cfg;
+  static clock_time_t t0;
+  static uint8_t error_pct, drop_pct;
+
+  PROCESS_BEGIN();
+
+  total = contiki_argc > 1 ? strtoul(contiki_argv[1], NULL, 0) :
+    BENCH_DEFAULT_COMMANDS;
+  cfg.latency = (contiki_argc > 2 ? atoi(contiki_argv[2]) : 20) *
+    CLOCK_SECOND / 1000;
+  cfg.baud = contiki_argc > 3 ? strtoul(contiki_argv[3], NULL, 0) : 0;
+  cfg.error_pct = contiki_argc > 4 ? atoi(contiki_argv[4]) : 0;
+  cfg.drop_pct = contiki_argc > 5 ? atoi(contiki_argv[5]) : 0;
+  cfg.join_delay = CLOCK_SECOND / 10;
+
+  latency = malloc(sizeof(clock_time_t) * (total ? total : 1));
+  if(latency == NULL || total == 0) {
+    printf("la66_bench: nothing to do\n");
+    exit(1);
+  }
+
+  /* Erros e perdas só depois do join, que não faz parte da medida */
+  error_pct = cfg.error_pct;
+  drop_pct = cfg.drop_pct;
+  cfg.error_pct = cfg.drop_pct = 0;
+  la66_emu_configure(&cfg);
+
+  soft_uart_init();
+  at_init(0);
+  LA66_DRIVER.init();
+  LA66_DRIVER.join_network(1);
+
+  printf("la66_bench: %lu commands, latency %lu ms, %lu baud, "
+         "error %u%%, drop %u%%\n", (unsigned long)total, ms(cfg.latency),
+         (unsigned long)soft_uart_get_baud(), error_pct, drop_pct);
+
+  /* ATZ, AT+NJM e AT+JOIN passam pela fila; espera o JOINED */
+  etimer_set(&et, BENCH_JOIN_TIMEOUT);
+  PROCESS_WAIT_EVENT_UNTIL(ev == PROCESS_EVENT_LA66_JOINED ||
+                           etimer_expired(&et));
+  if(!la66_is_joined()) {
+    printf("la66_bench: join timed out\n");
+    exit(1);
+  }
+
+  cfg.error_pct = error_pct;
+  cfg.drop_pct = drop_pct;
+  la66_emu_configure(&cfg);
+
+  t0 = clock_time();
+  fill_queue();
+  while(done < total) {
+    PROCESS_WAIT_EVENT();
+    if(ev == soft_uart_line_event) {
+      stray_lines++;
+    }
+    if(ev == PROCESS_EVENT_LA66_RESPONSE && bin_pending) {
+      const struct la66_response *resp = data;
+
+      bin_pending = 0;
+      record(bin_start, resp->len == 0 ? AT_TXN_TIMEOUT :
+             strcmp(resp->data, "OK") == 0 ? AT_TXN_OK : AT_TXN_ERROR);
+    }
+    fill_queue();
+  }
+
+  report(clock_time() - t0);
+  if(AT_EXCLUSIVE_LINES && stray_lines > 0) {
+    printf("la66_bench: soft UART lines reached other processes\n");
+    exit(1);
+  }
+  exit(0);
+
+  PROCESS_END();
+}
+/*---------------------------------------------------------------------------*/
@@ -0,0 +1,52 @@
+#ifndef SOFTWARE_UART_SERIAL_LINE_H
+#define SOFTWARE_UART_SERIAL_LINE_H
+
+/*
+ * Substituto da Soft UART (cpu/avr/software_uart_serial_line.h) para a
+ * plataforma native. Mesma API usada por at-master.c e la66.c, mas os bytes
+ * vão para o emulador do LA66 (la66-emu.c), que devolve as linhas de
+ * resposta em soft_uart_line_event como o motor RX do AVR.
+ */
+
+#include <stdint.h>
+
+#include "contiki.h"
+
+#ifndef SOFTWARE_UART_BAUD_RATE
+#define SOFTWARE_UART_BAUD_RATE 9600UL
+#endif
+
+#ifndef SOFT_UART_LINE_SIZE
+#define SOFT_UART_LINE_SIZE 128
+#endif
+#ifndef SOFT_UART_CONF_HEX_LINES
+#define SOFT_UART_CONF_HEX_LINES 1
+#endif
+
+#define SOFT_UART_LINE_F_TRUNCATED 0x01
+#define SOFT_UART_LINE_F_HEX       0x02
+#define SOFT_UART_LINE_F_BAD_HEX   0x04
+
+struct soft_uart_line {
+  char data[SOFT_UART_LINE_SIZE];
+  uint16_t len;
+  uint8_t flags;
+};
+
+#define SOFT_UART_LINE(data) ((const struct soft_uart_line *)(data))
+
+extern process_event_t soft_uart_line_event;
+extern process_event_t soft_uart_tx_done_event;
+
+void soft_uart_init(void);
+void soft_uart_write_byte(uint8_t data);
+int soft_uart_write_string(const char *str);
+uint8_t soft_uart_write_async(const uint8_t *data, uint8_t len,
+                              struct process *p);
+int soft_uart_write_hex(const uint8_t *data, uint8_t len,
+                        const char *suffix, struct process *p);
+uint8_t soft_uart_tx_busy(void);
+int soft_uart_set_baud(uint32_t baud);
+uint32_t soft_uart_get_baud(void);
+
+#endif
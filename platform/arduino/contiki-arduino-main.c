@@ -35,6 +35,8 @@
 #include <avr/pgmspace.h>
 #include <avr/fuse.h>
 #include <avr/eeprom.h>
+#include <avr/sleep.h>
+#include <avr/power.h>
 
 #include "lib/mmem.h"
 #include "loader/symbols-def.h"
@@ -56,6 +58,7 @@
 //#include "sicslowmac.h"
 
 #include "platform-conf.h"
+#include "sys/energest.h"
 
 #if 0
 FUSES =
@@ -72,6 +75,126 @@ uint8_t mac_address[8] EEMEM = {0x02, 0x11, 0x22, 0xff, 0xfe, 0x33, 0x44, 0x55};
 
 PROCINIT(&etimer_process, &serial_line_process);
 
+/*---------------------------------------------------------------------------*/
+/* Idle sleep between events (LPM_CONF_MODE 1). The clock (TIMER0), the soft
+ * UART bit timer (TIMER1) and the pin change interrupt on its RX pin must
+ * keep running, which rules out power-save and the deeper modes on this
+ * board: SLEEP_MODE_IDLE only stops the CPU clock. The next clock tick, a
+ * start bit from the LA66 or a USART byte wakes the CPU up. With
+ * CLOCK_CONF_TICKLESS the clock only interrupts every few ticks while
+ * sleeping, and the main loop only wakes up for the next etimer.
+ */
+#if ENERGEST_CONF_ON
+/* TIMER1 belongs to the soft UART (prescaler 1), so RTIMER_NOW() can not
+ * time CPU and LPM. Both are measured in TIMER0 counts instead and added to
+ * energest converted to rtimer ticks: one count is idle_mul / idle_div
+ * ticks (the prescalers are powers of two, so one of the two is 1).
+ */
+struct idle_stamp {
+  clock_time_t ticks;
+  uint8_t tcnt;
+};
+
+static const uint16_t tmr0_prescale[8] = { 0, 1, 8, 64, 256, 1024, 0, 0 };
+static uint16_t idle_mul, idle_div;
+static struct idle_stamp awake;
+
+/* Called with interrupts disabled */
+static void
+idle_stamp(struct idle_stamp *s)
+{
+  s->ticks = clock_time();
+  s->tcnt = TCNT0;
+  if(TIFR0 & _BV(OCF0A)) {
+    /* The compare match is pending: TCNT0 has already wrapped */
+    s->ticks++;
+    s->tcnt = TCNT0;
+  }
+}
+
+static void
+idle_account(int type, const struct idle_stamp *from,
+             const struct idle_stamp *to, uint16_t *rem)
+{
+  uint32_t counts;
+
+  counts = (uint32_t)(clock_time_t)(to->ticks - from->ticks) * (OCR0A + 1)
+    + to->tcnt - from->tcnt + *rem;
+  energest_type_set(type, energest_type_time(type) +
+                    counts / idle_div * idle_mul);
+  *rem = counts % idle_div;
+}
+
+static void
+idle_init(void)
+{
+#if RTIMER_ARCH_PRESCALER
+  uint16_t p = tmr0_prescale[TCCR0B & 7];
+#endif
+
+  energest_init();
+  idle_mul = idle_div = 1;
+#if RTIMER_ARCH_PRESCALER
+  if(p && RTIMER_ARCH_PRESCALER > p) {
+    idle_div = RTIMER_ARCH_PRESCALER / p;
+  } else if(p) {
+    /* TIMER0 is the coarser one: each count spans several rtimer ticks */
+    idle_mul = p / RTIMER_ARCH_PRESCALER;
+  }
+#endif
+  cli();
+  idle_stamp(&awake);
+  sei();
+}
+#else
+#define idle_init()
+#endif /* ENERGEST_CONF_ON */
+
+static void
+idle(void)
+{
+#if ENERGEST_CONF_ON
+  static uint16_t cpu_rem, lpm_rem;
+  struct idle_stamp asleep;
+#endif
+
+  cli();
+  if(process_nevents() != 0) {
+    sei();
+    return;
+  }
+#if ENERGEST_CONF_ON
+  idle_stamp(&asleep);
+  idle_account(ENERGEST_TYPE_CPU, &awake, &asleep, &cpu_rem);
+#endif
+#if LPM_CONF_MODE
+#if CLOCK_TICKLESS
+  clock_idle_enter();
+#endif
+  /* Interrupts that post nothing, such as the clock between two etimers,
+     put the CPU back to sleep right away */
+  do {
+    sleep_enable();
+    /* sei takes effect after the next instruction: no wake-up is lost */
+    sei();
+    sleep_cpu();
+    sleep_disable();
+    cli();
+  } while(process_nevents() == 0);
+#if CLOCK_TICKLESS
+  clock_idle_exit();
+#endif
+#endif
+  sei();
+#if ENERGEST_CONF_ON
+  cli();
+  idle_stamp(&awake);
+  sei();
+  idle_account(ENERGEST_TYPE_LPM, &asleep, &awake, &lpm_rem);
+#endif
+}
+/*---------------------------------------------------------------------------*/
+
 void
 init_lowlevel(void)
 {
@@ -87,6 +210,11 @@ init_lowlevel(void)
   rs232_set_input(USART_PORT, serial_line_input_byte);
 #endif
 
+  /* Nothing on this board uses the ADC or TWI: stop their clocks */
+  ADCSRA &= ~_BV(ADEN);
+  power_adc_disable();
+  power_twi_disable();
+  set_sleep_mode(SLEEP_MODE_IDLE);
 }
 
 int
@@ -106,6 +234,9 @@ main(void)
   /* Register initial processes */
   procinit_init();
 
+  /* Callback timers (used by the AT command queue) */
+  ctimer_init();
+
 
   //Give ourselves a prefix
   //init_net();
@@ -122,10 +253,14 @@ main(void)
 
   printf_P(PSTR("System online.\r\n"));
 
+  idle_init();
+
   /* Main scheduler loop */
   do {
 
-    process_run();
+    while(process_run() > 0);
+
+    idle();
 
   } while (1);
 
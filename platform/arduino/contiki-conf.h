@@ -102,6 +102,24 @@
 
 #define PROCESS_CONF_NUMEVENTS 8
 #define PROCESS_CONF_STATS 1
+/* Serial line and soft UART events, ahead of the application's */
+#ifndef PROCESS_CONF_HIGH_NUMEVENTS
+#define PROCESS_CONF_HIGH_NUMEVENTS 4
+#endif
+
+#ifndef LPM_CONF_MODE
+#define LPM_CONF_MODE 1 /* 0: no LPM, 1: SLEEP_MODE_IDLE between events */
+#endif
+
+/* Stop the periodic clock tick while sleeping (needs LPM_CONF_MODE) */
+#ifndef CLOCK_CONF_TICKLESS
+#define CLOCK_CONF_TICKLESS 1
+#endif
+
+/* CPU and LPM time, plus LA66 awake and air time, in rtimer ticks */
+#ifndef ENERGEST_CONF_ON
+#define ENERGEST_CONF_ON 1
+#endif
 
 #ifdef WITH_UIP6
 
@@ -172,6 +172,11 @@ typedef unsigned long clock_time_t;
 
 #define CLOCK_CONF_SECOND 1000
 
+/* The main loop sleeps until the next etimer instead of every tick */
+#ifndef CLOCK_CONF_TICKLESS
+#define CLOCK_CONF_TICKLESS 1
+#endif
+
 #define LOG_CONF_ENABLED 1
 
 /* Not part of C99 but actually present */
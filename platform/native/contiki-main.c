@@ -31,6 +31,7 @@
  *
  */
 
+#include <errno.h>
 #include <stdio.h>
 #include <string.h>
 #include <unistd.h>
@@ -238,8 +239,22 @@ main(int argc, char **argv)
 
     retval = process_run();
 
+#if CLOCK_TICKLESS
+    /* Sleep until the next etimer, a file descriptor or a signal (the
+       rtimer SIGALRM) instead of waking up every millisecond */
+    {
+      clock_time_t ticks = retval ? 0 : etimer_sleep_ticks(CLOCK_SECOND);
+
+      tv.tv_sec = ticks / CLOCK_SECOND;
+      tv.tv_usec = ticks % CLOCK_SECOND * (1000000 / CLOCK_SECOND);
+      if(tv.tv_usec == 0 && tv.tv_sec == 0) {
+        tv.tv_usec = 1;
+      }
+    }
+#else
     tv.tv_sec = 0;
     tv.tv_usec = retval ? 1 : 1000;
+#endif
 
     FD_ZERO(&fdr);
     FD_ZERO(&fdw);
@@ -252,7 +267,9 @@ main(int argc, char **argv)
 
     retval = select(maxfd + 1, &fdr, &fdw, NULL, &tv);
     if(retval < 0) {
-      perror("select");
+      if(errno != EINTR) {
+        perror("select");
+      }
     } else if(retval > 0) {
       /* timeout => retval == 0 */
       for(i = 0; i <= maxfd; i++) {